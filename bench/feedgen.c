@@ -0,0 +1,101 @@
+/**
+* Stand-in producer of a shared memory arrival feed (see inc/feed.h)
+* Draws arrivals as the simulator does (newJobs() with the same options: -r,
+* -j, -l, -s, -a, -e, --profile, --service, --topology) for -t time units and
+* writes them to the feed name, for `sim --feed name` to read:
+*
+*   obj/feedgen /mss -t 1000000 & ./sim --feed /mss -t 1000000 --metrics-every 100000
+*
+* Prints the arrivals written and the rate they were taken at once the
+* consumer drained the feed.
+*
+* Options besides those of the simulator:
+* --ring n  Arrivals in the ring, a power of 2, default FEED_RING_SIZE
+* --pace n  Write at most n arrivals per second of wall clock, as a live
+*           dispatcher would, default 0 (as fast as the consumer reads)
+*/
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+#include "simulation.h"
+#include "kernel.h"
+
+static double seconds(const struct timespec* start) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)(t.tv_sec-start->tv_sec)+1e-9*(double)(t.tv_nsec-start->tv_nsec);
+}
+
+int main(int argc, const char* argv[]) {
+	if ((argc < 2) || (argv[1][0] == '-')) {
+		fprintf(stderr, "Usage: %s name [--ring n] [--pace n] [simulator options]\n", argv[0]);
+		return 1;
+	}
+	uint32_t capacity = FEED_RING_SIZE;
+	double pace = 0;
+	for (int i = 2; i+1 < argc; i ++) {
+		if (strcmp(argv[i], "--ring") == 0) {
+			capacity = (uint32_t)atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "--pace") == 0) {
+			pace = strtod(argv[i+1], NULL);
+		}
+	}
+	SimContext* ctx = newSimContext();
+	if (parseArgs(ctx, argc, argv)) {
+		freeSimContext(ctx);
+		return 1;
+	}
+	if (!ctx->seeded) {
+		uint32_t seed;
+		_rdrand32_step(&seed);
+		ctx->seed = seed;
+	}
+	gsl_rng_env_setup();
+	ctx->rng = gsl_rng_alloc(gsl_rng_default);
+	gsl_rng_set(ctx->rng, (unsigned long)ctx->seed);
+	Feed* feed = createFeed(argv[1], capacity, ctx->regionCnt, ctx->jobTypeCnt);
+	if (feed == NULL) {
+		gsl_rng_free(ctx->rng);
+		freeSimContext(ctx);
+		return 1;
+	}
+	initArrivalRate(ctx);
+	JobBuffer jobBuffer = {NULL, 0, 0};
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (uint32_t timestamp = 0; timestamp < ctx->simulationTime; timestamp ++) {
+		updateArrivalRate(ctx, timestamp);
+		kernelNewJobs(ctx, &jobBuffer);
+		for (uint32_t k = 0; k < jobBuffer.jobCnt; k ++) {
+			Job* job = jobBuffer.jobs[k];
+			pushFeed(feed, job->region, job->jobType, job->timeToFinish);
+			kernelReleaseJob(ctx, job);
+		}
+		pushFeed(feed, 0, FEED_TICK, 0);
+		publishFeed(feed);
+		if (pace > 0) {
+			// Sleep off the time written ahead of the pace
+			double ahead = (double)feed->arrivalCnt/pace-seconds(&start);
+			if (ahead > 1e-3) {
+				struct timespec t = {(time_t)ahead, (long)((ahead-(double)(time_t)ahead)*1e9)};
+				nanosleep(&t, NULL);
+			}
+		}
+	}
+	uint64_t arrivalCnt = feed->arrivalCnt;
+	closeFeed(feed);
+	double elapsed = seconds(&start);
+	printf("%lu arrivals in %d time units, %lf seconds, %.0lf arrivals/s\n", arrivalCnt, ctx->simulationTime, elapsed, (double)arrivalCnt/elapsed);
+	free(jobBuffer.jobs);
+	freeArrivalRate(ctx);
+	freeJobPool(ctx);
+	gsl_rng_free(ctx->rng);
+	ctx->rng = NULL;
+	freeSimContext(ctx);
+	return 0;
+}
@@ -0,0 +1,378 @@
+/**
+* Micro-benchmarks of the queue, server and job primitives
+* Times each primitive of queue.c, server.c and job.c at queue depths from 10
+* to 10^7 and prints one line per (benchmark, depth):
+*
+*   name depth ns/op allocs/op
+*
+* Allocations are counted by wrapping malloc, calloc and realloc at link time
+* (-Wl,--wrap, see the microbench target in the Makefile). Every benchmark is
+* repeated until it ran at least MICROBENCH_MIN_OPS operations and at least
+* MICROBENCH_MIN_ROUNDS times after a warm-up round. The fastest round is
+* reported for ns/op, as noise only ever adds time, and the average over all
+* rounds for allocs/op.
+*
+* Options:
+* -d depth  Largest depth, default 10^7
+* -b file   Compare with a baseline file (same format) and exit with 1 if a
+*           benchmark got slower than the tolerance or allocates more
+* -w file   Write the results as a new baseline
+* -t tol    Relative ns/op tolerance, default 0.5. Large depths are bound by
+*           memory and vary more between runs than small ones
+*/
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "simulation.h"
+#include "kernel.h"
+
+#define MICROBENCH_MIN_OPS 2000000
+#define MICROBENCH_MIN_ROUNDS 3
+#define MICROBENCH_MAX_BENCHMARKS 128
+
+static uint64_t allocCnt = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size) {
+	allocCnt ++;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+	allocCnt ++;
+	return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+	allocCnt ++;
+	return __real_realloc(p, size);
+}
+
+static uint64_t now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec*1000000000ull+(uint64_t)t.tv_nsec;
+}
+
+/**
+* State shared by the benchmarks of one depth
+* @param jobs depth jobs, allocated once so that benchmarks only measure the
+* primitive
+* @param nodes Nodes of queue in push order, for removeQueue
+* @param permutation Random order of 0..depth-1
+*/
+typedef struct Bench {
+	SimContext* ctx;
+	uint32_t depth;
+	Job* jobs;
+	Queue* queue;
+	Node** nodes;
+	uint32_t* permutation;
+	Server* server;
+	double rate[4];
+} Bench;
+
+/**
+* One benchmark: setup is not timed, run is timed and returns the number of
+* operations it did, teardown is not timed
+*/
+typedef struct Benchmark {
+	const char* name;
+	void (*setup)(Bench* b);
+	uint64_t (*run)(Bench* b);
+	void (*teardown)(Bench* b);
+} Benchmark;
+
+static void fillQueue(Bench* b) {
+	b->queue = newQueue();
+	for (uint32_t i = 0; i < b->depth; i ++) {
+		pushQueue(b->queue, &b->jobs[i]);
+	}
+}
+
+static void emptyQueue(Bench* b) {
+	while (!queueIsEmpty(b->queue)) {
+		popQueue(b->queue);
+	}
+	freeQueue(b->queue);
+	b->queue = NULL;
+}
+
+static void setupNewQueue(Bench* b) {
+	b->queue = newQueue();
+}
+
+static void setupWarmQueue(Bench* b) {
+	// Nodes of a full queue go to the free list
+	fillQueue(b);
+	while (!queueIsEmpty(b->queue)) {
+		popQueue(b->queue);
+	}
+}
+
+static uint64_t runPushQueue(Bench* b) {
+	for (uint32_t i = 0; i < b->depth; i ++) {
+		pushQueue(b->queue, &b->jobs[i]);
+	}
+	return b->depth;
+}
+
+static uint64_t runPopQueue(Bench* b) {
+	for (uint32_t i = 0; i < b->depth; i ++) {
+		popQueue(b->queue);
+	}
+	return b->depth;
+}
+
+static void setupRemoveQueue(Bench* b) {
+	fillQueue(b);
+	uint32_t i = 0;
+	for (Node* pos = b->queue->head; pos != NULL; pos = pos->next) {
+		b->nodes[i ++] = pos;
+	}
+}
+
+static uint64_t runRemoveQueue(Bench* b) {
+	// Random order, as jobs leave a virtual queue wherever they are
+	for (uint32_t i = 0; i < b->depth; i ++) {
+		removeQueue(b->queue, b->nodes[b->permutation[i]]);
+	}
+	return b->depth;
+}
+
+static void setupServer(Bench* b) {
+	b->server = newServer(0, UINT32_MAX);
+}
+
+static void teardownServer(Bench* b) {
+	b->server->jobBuffer.jobCnt = 0;
+	freeServer(b->server);
+	b->server = NULL;
+}
+
+static uint64_t runAssignJobToServer(Bench* b) {
+	for (uint32_t i = 0; i < b->depth; i ++) {
+		b->jobs[i].timeToFinish = 1;
+		assignJobToServer(b->ctx, b->server, &b->jobs[i]);
+	}
+	return b->depth;
+}
+
+static void setupServeJobs(Bench* b) {
+	setupServer(b);
+	for (uint32_t i = 0; i < b->depth; i ++) {
+		b->jobs[i].timeToFinish = UINT32_MAX;
+		assignJobToServer(b->ctx, b->server, &b->jobs[i]);
+	}
+}
+
+static uint64_t runServeJobs(Bench* b) {
+	// Nothing finishes, every job is visited and kept
+	serveJobs(b->ctx, b->server);
+	return b->depth;
+}
+
+static void setupServeJobsWaiting(Bench* b) {
+	setupServer(b);
+	for (uint32_t i = 0; i < b->depth; i ++) {
+		pushQueue(b->server->waitingQueue, &b->jobs[i]);
+	}
+}
+
+static void teardownServeJobsWaiting(Bench* b) {
+	while (!queueIsEmpty(b->server->waitingQueue)) {
+		popQueue(b->server->waitingQueue);
+	}
+	teardownServer(b);
+}
+
+static void setupNewJobs(Bench* b) {
+	// depth arrivals per time unit in region 0
+	b->rate[0] = b->depth;
+	b->ctx->rate = b->rate;
+}
+
+static uint64_t runNewJobs(Bench* b) {
+	JobBuffer jobBuffer = newJobs(b->ctx);
+	// Give the jobs back, as serveJobs() does when they finish
+	for (uint32_t i = 0; i < jobBuffer.jobCnt; i ++) {
+		kernelReleaseJob(b->ctx, jobBuffer.jobs[i]);
+	}
+	free(jobBuffer.jobs);
+	return (jobBuffer.jobCnt > 0) ? jobBuffer.jobCnt : 1;
+}
+
+static void teardownNewJobs(Bench* b) {
+	// The job pool stays warm, as it does across time units of a simulation
+	b->ctx->rate = NULL;
+}
+
+static const Benchmark benchmarks[] = {
+	{"pushQueue", setupNewQueue, runPushQueue, emptyQueue},
+	{"pushQueueReuse", setupWarmQueue, runPushQueue, emptyQueue},
+	{"popQueue", fillQueue, runPopQueue, emptyQueue},
+	{"removeQueue", setupRemoveQueue, runRemoveQueue, emptyQueue},
+	{"assignJobToServer", setupServer, runAssignJobToServer, teardownServer},
+	{"serveJobs", setupServeJobs, runServeJobs, teardownServer},
+	{"serveJobsWaiting", setupServeJobsWaiting, runServeJobs, teardownServeJobsWaiting},
+	{"newJobs", setupNewJobs, runNewJobs, teardownNewJobs}
+};
+
+typedef struct Result {
+	char name[64];
+	uint32_t depth;
+	double nsPerOp;
+	double allocsPerOp;
+} Result;
+
+static Result measure(Bench* b, const Benchmark* benchmark) {
+	Result result;
+	strncpy(result.name, benchmark->name, sizeof(result.name)-1);
+	result.name[sizeof(result.name)-1] = '\0';
+	result.depth = b->depth;
+	result.nsPerOp = INFINITY;
+	// Same draws on every measurement, so that allocation counts are exact
+	gsl_rng_set(b->ctx->rng, (unsigned long)b->ctx->seed);
+	// One warm-up round, so that pools and free lists are in their steady state
+	benchmark->setup(b);
+	benchmark->run(b);
+	benchmark->teardown(b);
+	uint64_t totalOps = 0;
+	uint64_t totalAllocs = 0;
+	for (uint32_t round = 0; (round < MICROBENCH_MIN_ROUNDS) || (totalOps < MICROBENCH_MIN_OPS); round ++) {
+		benchmark->setup(b);
+		uint64_t allocs = allocCnt;
+		uint64_t start = now();
+		uint64_t ops = benchmark->run(b);
+		uint64_t elapsed = now()-start;
+		totalAllocs += allocCnt-allocs;
+		benchmark->teardown(b);
+		totalOps += ops;
+		double nsPerOp = (double)elapsed/(double)ops;
+		if (nsPerOp < result.nsPerOp) result.nsPerOp = nsPerOp;
+	}
+	result.allocsPerOp = (double)totalAllocs/(double)totalOps;
+	return result;
+}
+
+static uint32_t readBaseline(const char* path, Result* baseline) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open baseline %s\n", path);
+		return 0;
+	}
+	uint32_t cnt = 0;
+	char line[256];
+	while ((cnt < MICROBENCH_MAX_BENCHMARKS) && (fgets(line, sizeof(line), file) != NULL)) {
+		Result* r = &baseline[cnt];
+		if ((line[0] != '#') && (sscanf(line, "%63s %u %lf %lf", r->name, &r->depth, &r->nsPerOp, &r->allocsPerOp) == 4)) {
+			cnt ++;
+		}
+	}
+	fclose(file);
+	return cnt;
+}
+
+int main(int argc, const char* argv[]) {
+	uint32_t maxDepth = 10000000;
+	const char* baselinePath = NULL;
+	const char* writePath = NULL;
+	double tolerance = 0.5;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-d") == 0) {
+			maxDepth = (uint32_t)strtod(argv[i+1], NULL);
+		} else if (strcmp(argv[i], "-b") == 0) {
+			baselinePath = argv[i+1];
+		} else if (strcmp(argv[i], "-w") == 0) {
+			writePath = argv[i+1];
+		} else if (strcmp(argv[i], "-t") == 0) {
+			tolerance = strtod(argv[i+1], NULL);
+		}
+	}
+	Result baseline[MICROBENCH_MAX_BENCHMARKS];
+	uint32_t baselineCnt = 0;
+	if (baselinePath != NULL) {
+		baselineCnt = readBaseline(baselinePath, baseline);
+		if (baselineCnt == 0) return 1;
+	}
+	FILE* out = NULL;
+	if (writePath != NULL) {
+		out = fopen(writePath, "w");
+		if (out == NULL) {
+			fprintf(stderr, "Cannot write baseline %s\n", writePath);
+			return 1;
+		}
+		fprintf(out, "# name depth ns/op allocs/op\n");
+	}
+
+	Bench b;
+	memset(&b, 0, sizeof(b));
+	b.ctx = newSimContext();
+	b.ctx->seed = 1;
+	b.ctx->rng = gsl_rng_alloc(gsl_rng_default);
+	gsl_rng_set(b.ctx->rng, (unsigned long)b.ctx->seed);
+	b.ctx->delayHistogram = (uint32_t*)calloc(DELAY_HISTOGRAM_SIZE, sizeof(uint32_t));
+	uint32_t regressionCnt = 0;
+	printf("%-20s %10s %10s %10s\n", "name", "depth", "ns/op", "allocs/op");
+	for (uint32_t depth = 10; depth <= maxDepth; depth *= 10) {
+		b.depth = depth;
+		b.jobs = (Job*)calloc(depth, sizeof(Job));
+		b.nodes = (Node**)malloc(depth*sizeof(Node*));
+		b.permutation = (uint32_t*)malloc(depth*sizeof(uint32_t));
+		for (uint32_t i = 0; i < depth; i ++) {
+			b.permutation[i] = i;
+		}
+		gsl_ran_shuffle(b.ctx->rng, b.permutation, depth, sizeof(uint32_t));
+		for (size_t k = 0; k < sizeof(benchmarks)/sizeof(Benchmark); k ++) {
+			Result r = measure(&b, &benchmarks[k]);
+			const Result* base = NULL;
+			for (uint32_t i = 0; i < baselineCnt; i ++) {
+				if ((strcmp(baseline[i].name, r.name) == 0) && (baseline[i].depth == r.depth)) base = &baseline[i];
+			}
+			// Confirm a slowdown with a second measurement before flagging it
+			if ((base != NULL) && (r.nsPerOp > base->nsPerOp*(1+tolerance))) {
+				Result retry = measure(&b, &benchmarks[k]);
+				if (retry.nsPerOp < r.nsPerOp) r.nsPerOp = retry.nsPerOp;
+			}
+			printf("%-20s %10d %10.2lf %10.6lf", r.name, r.depth, r.nsPerOp, r.allocsPerOp);
+			if (out != NULL) {
+				fprintf(out, "%s %d %.2lf %.6lf\n", r.name, r.depth, r.nsPerOp, r.allocsPerOp);
+			}
+			if (base != NULL) {
+				uint8_t slower = (r.nsPerOp > base->nsPerOp*(1+tolerance));
+				// Allocation counts are exact, so any increase is flagged
+				uint8_t allocates = (r.allocsPerOp > base->allocsPerOp*(1+1E-3)+1E-6);
+				if (slower || allocates) {
+					printf("  REGRESSION (baseline %.2lf ns/op, %.6lf allocs/op)", base->nsPerOp, base->allocsPerOp);
+					regressionCnt ++;
+				}
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+		free(b.jobs);
+		free(b.nodes);
+		free(b.permutation);
+	}
+	freeJobPool(b.ctx);
+	free(b.ctx->delayHistogram);
+	b.ctx->delayHistogram = NULL;
+	gsl_rng_free(b.ctx->rng);
+	b.ctx->rng = NULL;
+	freeSimContext(b.ctx);
+	if (out != NULL) {
+		fclose(out);
+	}
+	if (regressionCnt > 0) {
+		printf("%d regressions against %s\n", regressionCnt, baselinePath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,105 @@
+/**
+* Module implementing EASY backfilling reservations
+* backfill and backfillCross serve each queue FCFS, but when the head does not
+* fit, reserve the time unit it can start at (the shadow time) and let later
+* jobs start early if they do not delay it: they either finish by the shadow
+* time, or only use the processors still left over once the head starts
+* (extra). Service times are drawn on arrival, so the time a job holds its
+* processors is known before it starts.
+*
+* Every server keeps a min-heap of the time units its running jobs release
+* their processors at. The shadow time of a head needing n processors is found
+* by visiting the heap in increasing release time until n processors are idle,
+* which touches O(n) entries in O(n log n) instead of sorting the running jobs.
+* Starting and finishing a job is O(log running jobs).
+*/
+#ifndef _BACKFILL_H
+#define _BACKFILL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "param.h"
+#include "job.h"
+#include "server.h"
+#include "topology.h"
+
+// Shadow time of a server without a reservation
+#define BACKFILL_NONE UINT32_MAX
+
+/**
+* Processors released by a running job
+* @param freeAt Time unit the processors are idle again
+* @param need Processors it holds
+*/
+typedef struct Release {
+	uint32_t freeAt;
+	uint32_t need;
+} Release;
+
+/**
+* Reservations of backfill and backfillCross, indexed by server region
+* @param clock Current time unit counted from 1, advanced by tickBackfill()
+* @param releases Heap of the running jobs of each server by freeAt
+* @param shadow Time unit the blocked head of the queue can start at,
+* BACKFILL_NONE if the queue is not blocked
+* @param extra Processors left over at the shadow time once the head starts
+* @param visit Buffer of heap positions for reserveBackfill()
+*/
+typedef struct Backfill {
+	uint32_t regionCnt;
+	uint32_t clock;
+	Release** releases;
+	uint32_t* releaseCnt;
+	uint32_t* releaseSize;
+	uint32_t* shadow;
+	uint32_t* extra;
+	uint32_t* visit;
+	uint32_t visitSize;
+} Backfill;
+
+/**
+* Create empty reservations for the regions of ctx
+* Needs to be freed by calling freeBackfill().
+*/
+Backfill* newBackfill(SimContext* ctx);
+
+void freeBackfill(Backfill* bf);
+
+/**
+* Advance to the next time unit, drop the releases of jobs finished by then and
+* clear all reservations. Called at the start of every time unit.
+*/
+void tickBackfill(Backfill* bf);
+
+/**
+* Time unit a job would release its processors at if it started on server now
+*/
+static inline uint32_t backfillFreeAt(SimContext* ctx, Backfill* bf, Server* server, Job* job) {
+	uint32_t serviceTime = job->timeToFinish*getMeanServiceTime(ctx, server->region, job->region);
+	// A job holds its processors for at least the time unit it starts in
+	return bf->clock+((serviceTime > 0) ? serviceTime : 1);
+}
+
+/**
+* Whether job can start on server now without delaying its reservation
+*/
+static inline uint8_t canBackfill(SimContext* ctx, Backfill* bf, Server* server, Job* job) {
+	uint32_t need = ctx->serverNeeds[job->jobType];
+	if (server->idleCnt < need) return 0;
+	uint32_t shadow = bf->shadow[server->region];
+	if (shadow == BACKFILL_NONE) return 1;
+	return (backfillFreeAt(ctx, bf, server, job) <= shadow) || (need <= bf->extra[server->region]);
+}
+
+/**
+* Start job on server and record its release
+* A job running past the shadow time uses up extra processors.
+*/
+void startBackfill(SimContext* ctx, Backfill* bf, Server* server, Job* job);
+
+/**
+* Reserve the shadow time of a head needing need processors on server
+*/
+void reserveBackfill(Backfill* bf, Server* server, uint32_t need);
+
+#endif
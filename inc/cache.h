@@ -0,0 +1,63 @@
+/**
+* Module implementing the on-disk result cache
+* --cache dir keeps the results of every seeded run in dir, so that a sweep
+* repeating a run gets its results back without simulating. A run is keyed by
+* a 64 bit FNV-1a hash of everything its results depend on once parseArgs()
+* has resolved it: policy, dimensions, processor counts, arrival rates, server
+* needs, resources and packing, mean service times, the contents of --profile, --service and
+* --topology files (not their paths), sampling options, seed, thread count,
+* antithetic role, time units, the rng type and the build id. The build id is
+* a checksum of the sources set by the Makefile, so entries of an older build
+* are never read by a newer one (builds outside the Makefile share id 0).
+*
+* Two entries are written at the end of a run, each to a temporary file in dir
+* renamed over the entry, so that readers and concurrent runs see either a
+* whole entry or none:
+*
+* - <key>.res holds the results, utilization of resources and the offered
+*   work of --vr control.
+* - <key>.state, keyed without the time units, holds the end state of the
+*   longest run so far: servers with their resources, queues and running jobs,
+*   the common queue, delay histogram, counters and the rng state. A run of
+*   more time units resumes from it instead of starting over, and gets the
+*   results it would have got from time unit 0.
+*
+* States are kept for policies passing splittable() (see splitting.h) run
+* without --threads, others only cache results. Runs reading a feed, tracing,
+* printing rolling metrics or splitting are not cached. Entries are never
+* evicted, remove dir (or files in it) to reclaim space.
+*/
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdint.h>
+#include "param.h"
+
+// Written first in every entry, "MSSC"
+#define CACHE_MAGIC 0x4353534du
+
+// Bumped whenever the layout of entries changes
+#define CACHE_FORMAT 2
+
+/**
+* Read the results of a run keyed as ctx into result
+* Returns 1 on a hit, 0 if the run has to be simulated.
+*/
+uint8_t readCachedResult(SimContext* ctx, double* result);
+
+/**
+* Resume ctx from the longest cached state of fewer time units, if any
+* Servers, delayHistogram and rng must be set up as runSimulation() does.
+* Returns the time units done and adds their queue length sum to
+* queueLengthSum, 0 if the run starts over.
+*/
+uint32_t resumeCachedState(SimContext* ctx, double* queueLengthSum);
+
+/**
+* Write the results and the end state of a run of timestamp time units
+* Called before servers are freed. Failures are reported on stderr and
+* otherwise ignored, the run keeps its results.
+*/
+void writeCache(SimContext* ctx, const double* result, uint32_t timestamp, double queueLengthSum);
+
+#endif
@@ -0,0 +1,180 @@
+/**
+* Module implementing an arrival feed in POSIX shared memory
+* --feed name replaces the arrivals drawn by newJobs() with arrivals read from
+* the shared memory object name (see shm_open(3)), written by another process:
+* a live dispatcher mirroring its arrivals, so that a policy is evaluated in
+* shadow mode on real traffic, or the stand-in generator bench/feedgen.c.
+*
+* The object is a FeedHeader followed by a ring of capacity FeedArrivals, with
+* a single producer and a single consumer synchronized by two atomic counters
+* and no lock (as the ring of trace.h, but across processes). The producer
+* writes the arrivals of one time unit followed by a FEED_TICK marker, and
+* publishes head once per time unit. The consumer reads up to the next marker,
+* so the simulation advances one time unit per marker, not by the wall clock.
+* Arrivals keep the order they are written in (they are not shuffled).
+*
+* The producer creates the object and sets ready once the header is written.
+* The consumer waits up to FEED_OPEN_TIMEOUT seconds for it, and checks that
+* regionCnt and jobTypeCnt match its own. Either side waits (yielding the
+* processor, then sleeping) when the ring is full or empty, a live producer
+* that must not block should drop arrivals instead. The producer sets closed
+* when done and waits for the consumer to drain the ring before removing the
+* object, the consumer ends the run once closed is set and the ring is empty.
+* A run fed by obj/feedgen with the seed of a plain run gives the same results
+* for policies drawing no random numbers of their own.
+*
+* Arrivals read become jobs taken from the job pool (see kernel.h), so the
+* consumer allocates nothing per arrival once the pool is warm. Arrivals of an
+* unknown region or job type are counted and skipped.
+*/
+#ifndef _FEED_H
+#define _FEED_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "param.h"
+#include "job.h"
+
+#define FEED_VERSION 1
+
+// Default arrivals in the ring of a new feed, a power of 2
+#define FEED_RING_SIZE (1u << 20)
+
+// Job type of the marker ending a time unit
+#define FEED_TICK UINT8_MAX
+
+// Seconds openFeed() waits for the producer
+#define FEED_OPEN_TIMEOUT 10
+
+/**
+* Header of the shared memory object, head and tail on cache lines of their own
+* @param magic "MSSFEED"
+* @param capacity Arrivals in the ring, a power of 2
+* @param ready Set by the producer once the fields above are written
+* @param head Arrivals written by the producer
+* @param tail Arrivals read by the consumer
+* @param closed Set by the producer after its last arrival
+*/
+typedef struct FeedHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t capacity;
+	uint32_t regionCnt;
+	uint32_t jobTypeCnt;
+	atomic_int ready;
+	_Alignas(64) _Atomic uint64_t head;
+	_Alignas(64) _Atomic uint64_t tail;
+	_Alignas(64) atomic_int closed;
+} FeedHeader;
+
+/**
+* One arrival, 12 bytes
+* @param timeToFinish Service time as newJobs() draws it (before the mean
+* service time of the server it is assigned to is applied)
+* @param jobType Job type, FEED_TICK for the marker ending a time unit
+*/
+typedef struct FeedArrival {
+	uint32_t region;
+	uint32_t timeToFinish;
+	uint8_t jobType;
+	uint8_t reserved[3];
+} FeedArrival;
+
+/**
+* One side of a feed
+* @param producer Whether this side writes the ring
+* @param head Local copy of the counter this side advances (head for the
+* producer, tail for the consumer)
+* @param limit Last value seen of the other counter
+* @param done Set by endOfFeed() once the feed is closed and drained
+* @param arrivalCnt Arrivals written or read so far
+* @param skippedCnt Arrivals read with an unknown region or job type
+*/
+typedef struct Feed {
+	char* name;
+	FeedHeader* header;
+	FeedArrival* ring;
+	size_t mapSize;
+	uint64_t mask;
+	uint8_t producer;
+	uint64_t head;
+	uint64_t limit;
+	uint8_t done;
+	uint64_t arrivalCnt;
+	uint64_t skippedCnt;
+} Feed;
+
+/**
+* Create the feed name with a ring of capacity arrivals (a power of 2) as its
+* producer, replacing a stale object of the same name
+* Returns NULL and prints the reason to stderr on failure. Needs to be closed
+* by calling closeFeed().
+*/
+Feed* createFeed(const char* name, uint32_t capacity, uint32_t regionCnt, uint8_t jobTypeCnt);
+
+/**
+* Open the feed name as its consumer for the dimensions of ctx
+* Returns NULL and prints the reason to stderr if the producer does not create
+* it in time or its dimensions differ. Needs to be closed by calling
+* closeFeed().
+*/
+Feed* openFeed(SimContext* ctx, const char* name);
+
+/**
+* Producer: mark the feed closed, wait for the consumer to drain it and remove
+* it. Consumer: unmap it.
+*/
+void closeFeed(Feed* feed);
+
+/**
+* Wait for the other side to move its counter, after publishing ours
+* waitCnt counts the waits so far for the same counter, the first few yield the
+* processor and later ones sleep.
+*/
+void feedWait(Feed* feed, uint32_t waitCnt);
+
+/**
+* Make the arrivals written so far visible to the consumer
+*/
+static inline void publishFeed(Feed* feed) {
+	atomic_store_explicit(&feed->header->head, feed->head, memory_order_release);
+}
+
+/**
+* Write one arrival, or the marker ending a time unit if jobType is FEED_TICK
+* Waits while the ring is full. The arrival is seen by the consumer after the
+* next publishFeed().
+*/
+static inline void pushFeed(Feed* feed, uint32_t region, uint8_t jobType, uint32_t timeToFinish) {
+	uint32_t waitCnt = 0;
+	while (feed->head-feed->limit > feed->mask) {
+		feed->limit = atomic_load_explicit(&feed->header->tail, memory_order_acquire);
+		if (feed->head-feed->limit > feed->mask) {
+			feedWait(feed, waitCnt ++);
+		}
+	}
+	FeedArrival* arrival = &feed->ring[feed->head & feed->mask];
+	arrival->region = region;
+	arrival->timeToFinish = timeToFinish;
+	arrival->jobType = jobType;
+	feed->head ++;
+	if (jobType != FEED_TICK) {
+		feed->arrivalCnt ++;
+	}
+}
+
+/**
+* Wait until there is an arrival to read, or the feed is closed and drained
+* Returns feed->done, set in the latter case.
+*/
+uint8_t endOfFeed(Feed* feed);
+
+/**
+* Read the arrivals of the next time unit into jobBuffer as newJobs() does
+* Waits for the producer to finish the time unit. Returns the arrivals read so
+* far if the feed closes first, none once it is drained.
+*/
+void readFeed(SimContext* ctx, Feed* feed, JobBuffer* jobBuffer);
+
+#endif
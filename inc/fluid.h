@@ -0,0 +1,62 @@
+/**
+* Module implementing the fluid (mean-field) approximation
+* Instead of simulating jobs, the fluid mode iterates the deterministic limit of
+* the same model once per time unit: job masses waiting in queues and in
+* service, with arrivals at their mean rates and a fraction 1/h of the mass in
+* service departing every time unit (h is the mean holding time of a job). It
+* takes milliseconds where a stochastic run takes seconds, and is meant to
+* screen a sweep for where queues blow up before running the simulator.
+*
+* Policies are mapped to their fluid counterparts:
+* - fcfsLocal, fcfsCross, fcfsCrossPart: waiting mass starts in proportion to
+*   its type mix as capacity frees up, crossing regions in order of mean
+*   service time
+* - o3CrossPart: same as fcfsCrossPart, but smaller jobs start first
+* - backfill, backfillCross: same as fcfsLocal and fcfsCross, fluid queues have
+*   no blocked head to backfill around
+* - jsq, jsqPart, jsqBatch, jsqBatchPart: arrivals are water-filled over
+*   virtual queue sizes, the way jsqBatch routes one time unit
+* - jsqD, jsqDPart: approximated by jsq and jsqPart
+* - jsqMaxweight: arrivals are balanced between the local and common queue,
+*   each server starts the queue with the larger weight first
+* - jsqMaxweightCross: arrivals start locally as far as idle processors allow,
+*   the rest is water-filled as in jsq, each server starts its queues in
+*   decreasing weight
+* Fluid queues do not carry granularity (a job needing 4 processors may start
+* on the last 2 idle ones) or head-of-line blocking, and have no queueing below
+* capacity. The approximation is therefore optimistic: queues stay at zero
+* under light load and blow up at a somewhat higher load than in the
+* simulator when large and small jobs mix.
+*/
+#ifndef _FLUID_H
+#define _FLUID_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "param.h"
+#include "policy.h"
+#include "profile.h"
+#include "service.h"
+
+/**
+* Approximations selected by --approx
+*/
+typedef enum Approx {
+	// Stochastic simulation, no approximation
+	APPROX_NONE,
+	APPROX_FLUID
+} Approx;
+
+/**
+* Run the fluid approximation of ctx for ctx->simulationTime units
+* Writes the same values as runSimulation() to result: expected queue length
+* (per queue) and expected queueing delay (by Little's law). The 99th
+* percentile delay is NAN. Follows the arrival rate profile if any. Without a
+* profile, stops early and extrapolates once the queue lengths settle or grow
+* linearly.
+*/
+void runFluid(SimContext* ctx, double* result);
+
+#endif
@@ -15,16 +15,21 @@ extern const uint32_t INIT_JOB_BUFFER_SIZE;
 
 /**
 * Job struct
-* @param jobType an integer in [0, JOB_TYPE_CNT) defined in param.h
-* @param region an integer in [0, REGION_CNT) defined in param.h
+* @param jobType an integer in [0, jobTypeCnt) defined in SimContext
+* @param region an integer in [0, regionCnt) defined in SimContext
 * @param timeToFinish an integer telling remaining time to finish the job
 * @param waitTime an integer telling time this job already waited
+* @param traceId id of the job in the trace, 0 if not traced (only built with
+* MSS_TRACE, see trace.h)
 */
 typedef struct Job {
 	uint8_t jobType;
 	uint32_t region;
 	uint32_t timeToFinish;
 	uint32_t waitTime;
+#ifdef MSS_TRACE
+	uint32_t traceId;
+#endif
 } Job;
 
 /**
@@ -40,11 +45,11 @@ typedef struct JobBuffer {
 
 /**
 * Create new jobs in one time unit
-* Must init gsl rng first and assign to RNG defined in param.h
+* Must init gsl rng first and assign to ctx->rng
 * Needs to be freed manually or call freeJobBuffer(). If some job pointers are
 * referenced in other places, do not call freeJobBuffer() to avoid conflicts.
 */
-JobBuffer newJobs();
+JobBuffer newJobs(SimContext* ctx);
 
 /**
 * Free a JobBuffer
@@ -52,6 +57,13 @@ JobBuffer newJobs();
 */
 void freeJobBuffer(JobBuffer);
 
+/**
+* Free jobs kept for reuse in ctx->jobPool
+* Finished jobs are returned to the pool by serveJobs() and taken again by
+* newJobs(), call this once the simulation is done.
+*/
+void freeJobPool(SimContext* ctx);
+
 /**
 * Print out job info
 */
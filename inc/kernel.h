@@ -0,0 +1,303 @@
+/**
+* Module implementing the primitives of the simulation loop
+* Serving, assignment, arrivals and virtual sizes are static inline, so that
+* policies in policy.c call them without a function call per job. server.c and
+* job.c wrap them for other modules.
+*
+* Nothing is allocated per time unit: finished jobs go back to a job pool in
+* SimContext and are reused for arrivals, arrivals reuse one buffer
+* (ctx->arrivals) and serving compacts the server buffer in place.
+*/
+#ifndef _KERNEL_H
+#define _KERNEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <gsl/gsl_randist.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "param.h"
+#include "job.h"
+#include "queue.h"
+#include "server.h"
+#include "resource.h"
+#include "service.h"
+#include "topology.h"
+#include "trace.h"
+#include "variance.h"
+#include "feed.h"
+
+/**
+* Mean service time for a server in serverRegion to serve a job from jobRegion
+* Same as getMeanServiceTime(), inlined.
+*/
+static inline uint32_t kernelServiceTime(SimContext* ctx, uint32_t serverRegion, uint32_t jobRegion) {
+	if (ctx->topology != NULL) {
+		return topologyServiceTime(ctx->topology, serverRegion, jobRegion);
+	}
+	return ctx->meanServiceTime[serverRegion*ctx->regionCnt+jobRegion];
+}
+
+/**
+* Take a job from the pool of finished jobs, or allocate one if it is empty
+*/
+static inline Job* kernelAllocJob(SimContext* ctx) {
+	if (ctx->jobPoolCnt > 0) {
+		return ctx->jobPool[-- ctx->jobPoolCnt];
+	}
+	return (Job*)malloc(sizeof(Job));
+}
+
+/**
+* Return a finished job to the pool instead of freeing it
+*/
+static inline void kernelReleaseJob(SimContext* ctx, Job* job) {
+	if (ctx->jobPoolCnt == ctx->jobPoolSize) {
+		ctx->jobPoolSize = (ctx->jobPoolSize == 0) ? INIT_JOB_BUFFER_SIZE : (ctx->jobPoolSize << 1);
+		ctx->jobPool = (Job**)realloc(ctx->jobPool, ctx->jobPoolSize*sizeof(Job*));
+	}
+	ctx->jobPool[ctx->jobPoolCnt ++] = job;
+}
+
+/**
+* Append the random new jobs of region i in one time unit to jobBuffer after its
+* first jobCnt jobs, returns the new job count
+* Arrival counts follow the rates in effect (ctx->rate), service times follow
+* ctx->service if set. Both are drawn by inversion in antithetic pairs
+* (see variance.h).
+*/
+static inline uint32_t kernelNewRegionJobs(SimContext* ctx, uint32_t i, JobBuffer* jobBuffer, uint32_t jobCnt) {
+	uint32_t regionCnt = ctx->regionCnt;
+	uint8_t jobTypeCnt = ctx->jobTypeCnt;
+	uint32_t mean = kernelServiceTime(ctx, i, i);
+	for (uint8_t j = 0; j < jobTypeCnt; j ++) {
+		double rate = ctx->rate[jobTypeCnt*i+j];
+		if (ctx->antithetic != ANTITHETIC_OFF) {
+			ctx->antitheticGroup = ((uint64_t)ctx->antitheticTick*regionCnt+i)*jobTypeCnt+j;
+		}
+		uint32_t arrivingCnt = (ctx->antithetic == ANTITHETIC_OFF) ? gsl_ran_poisson(ctx->rng, rate) : arrivalPoisson(ctx, rate);
+		if (jobCnt+arrivingCnt > jobBuffer->size) {
+			while (jobCnt+arrivingCnt > jobBuffer->size) {
+				jobBuffer->size = (jobBuffer->size == 0) ? INIT_JOB_BUFFER_SIZE : (jobBuffer->size << 1);
+			}
+			jobBuffer->jobs = (Job**)realloc(jobBuffer->jobs, jobBuffer->size*sizeof(Job*));
+		}
+		if (ctx->service == NULL) {
+			for (uint32_t k = 0; k < arrivingCnt; k ++) {
+				Job* job = kernelAllocJob(ctx);
+				job->jobType = j;
+				job->region = i;
+				job->waitTime = 0;
+				double draw = (ctx->antithetic == ANTITHETIC_OFF) ? gsl_ran_exponential(ctx->rng, mean) : gsl_cdf_exponential_Pinv(antitheticUniform(ctx, k), mean);
+				job->timeToFinish = (uint32_t)floor(draw);
+				jobBuffer->jobs[jobCnt+k] = job;
+			}
+		} else {
+			for (uint32_t k = 0; k < arrivingCnt; k ++) {
+				Job* job = kernelAllocJob(ctx);
+				job->jobType = j;
+				job->region = i;
+				job->waitTime = 0;
+				jobBuffer->jobs[jobCnt+k] = job;
+			}
+			// Service times of the group in one batch
+			fillServiceTimes(ctx, i, j, jobBuffer->jobs+jobCnt, arrivingCnt);
+		}
+		if (ctx->workRate != NULL) {
+			// Offered work for the control variate
+			for (uint32_t k = 0; k < arrivingCnt; k ++) {
+				ctx->offeredWork += (uint64_t)ctx->serverNeeds[j]*jobBuffer->jobs[jobCnt+k]->timeToFinish;
+			}
+		}
+		jobCnt += arrivingCnt;
+	}
+	return jobCnt;
+}
+
+/**
+* Create random new jobs of all regions in one time unit into jobBuffer (see
+* kernelNewRegionJobs()), read from ctx->feed instead if set (see feed.h)
+* jobBuffer is reused (it only grows), its previous content is dropped.
+*/
+static inline void kernelNewJobs(SimContext* ctx, JobBuffer* jobBuffer) {
+	if (ctx->feed != NULL) {
+		readFeed(ctx, ctx->feed, jobBuffer);
+		ctx->arrivalCnt += jobBuffer->jobCnt;
+		return;
+	}
+	uint32_t jobCnt = 0;
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		jobCnt = kernelNewRegionJobs(ctx, i, jobBuffer, jobCnt);
+	}
+	ctx->antitheticTick ++;
+	TRACE_ARRIVALS(ctx, jobBuffer->jobs, jobCnt);
+	// Shuffle the jobs (closer to reality)
+	// Only shuffle if jobs is not empty
+	if (jobCnt > 0) {
+		gsl_ran_shuffle(ctx->rng, jobBuffer->jobs, jobCnt, sizeof(Job*));
+	}
+	jobBuffer->jobCnt = jobCnt;
+	ctx->arrivalCnt += jobCnt;
+}
+
+#ifdef __SSE2__
+_Static_assert(RESOURCE_MAX == 4, "resource vectors fill one SSE2 register");
+#endif
+
+/**
+* Whether demand fits in idle, resource by resource (see resource.h)
+*/
+static inline uint8_t kernelFits(const uint32_t* idle, const uint32_t* demand) {
+#ifdef __SSE2__
+	__m128i a = _mm_loadu_si128((const __m128i*)idle);
+	__m128i d = _mm_loadu_si128((const __m128i*)demand);
+	return (_mm_movemask_epi8(_mm_cmpgt_epi32(d, a)) == 0);
+#else
+	uint8_t fits = 1;
+	for (uint32_t k = 0; k < RESOURCE_MAX; k ++) {
+		fits &= (demand[k] <= idle[k]);
+	}
+	return fits;
+#endif
+}
+
+/**
+* Take demand from idle (sign -1) or give it back (sign 1)
+*/
+static inline void kernelAddDemand(uint32_t* idle, const uint32_t* demand, int sign) {
+#ifdef __SSE2__
+	__m128i a = _mm_loadu_si128((const __m128i*)idle);
+	__m128i d = _mm_loadu_si128((const __m128i*)demand);
+	_mm_storeu_si128((__m128i*)idle, (sign > 0) ? _mm_add_epi32(a, d) : _mm_sub_epi32(a, d));
+#else
+	for (uint32_t k = 0; k < RESOURCE_MAX; k ++) {
+		idle[k] = (sign > 0) ? idle[k]+demand[k] : idle[k]-demand[k];
+	}
+#endif
+}
+
+static inline uint8_t kernelCanServe(SimContext* ctx, Server* server, Job* job) {
+	uint8_t jobType = 0;
+	if (job != NULL) jobType = job->jobType;
+	if (ctx->resourceCnt > 1) {
+		return kernelFits(server->idle, ctx->demand+jobType*RESOURCE_MAX);
+	}
+	return (server->idleCnt >= ctx->serverNeeds[jobType]);
+}
+
+static inline void kernelAssignJob(SimContext* ctx, Server* server, Job* job) {
+	// Decay service rate (increase service time)
+	job->timeToFinish *= kernelServiceTime(ctx, server->region, job->region);
+	if (server->region != job->region) {
+		TRACE_JOB(ctx, TRACE_CROSS, job, server->region, job->timeToFinish);
+	}
+	TRACE_JOB(ctx, TRACE_START, job, server->region, job->waitTime);
+	server->jobBuffer.jobCnt ++;
+	server->departedJobCnt ++;
+	server->departedJobDelay += job->waitTime;
+	ctx->delayHistogram[(job->waitTime < DELAY_HISTOGRAM_SIZE) ? job->waitTime : DELAY_HISTOGRAM_SIZE-1] ++;
+	if (server->jobBuffer.jobCnt > server->jobBuffer.size) {
+		if (server->jobBuffer.size == 0) {
+			// If is empty, assign init size
+			server->jobBuffer.size = INIT_JOB_BUFFER_SIZE;
+		} else {
+			// Else double the size
+			server->jobBuffer.size <<= 1;
+		}
+		server->jobBuffer.jobs = (Job**)realloc(server->jobBuffer.jobs, server->jobBuffer.size*sizeof(Job*));
+	}
+	server->jobBuffer.jobs[server->jobBuffer.jobCnt-1] = job;
+	if (ctx->resourceCnt > 1) {
+		kernelAddDemand(server->idle, ctx->demand+job->jobType*RESOURCE_MAX, -1);
+	} else {
+		server->idleCnt -= (ctx->serverNeeds[job->jobType]);
+	}
+}
+
+static inline void kernelServeJobs(SimContext* ctx, Server* server) {
+	// Resources held during this time unit, for utilization
+	if (ctx->resourceCnt > 1) {
+		for (uint32_t k = 0; k < ctx->resourceCnt; k ++) {
+			server->busy[k] += server->capacity[k]-server->idle[k];
+		}
+	} else {
+		server->busy[0] += server->processorCnt-server->idleCnt;
+	}
+	// Compact non-completed jobs in place, keeping their order. Finished jobs go
+	// back to the job pool.
+	Job** jobs = server->jobBuffer.jobs;
+	uint32_t newJobCnt = 0;
+	for (uint32_t i = 0; i < server->jobBuffer.jobCnt; i ++) {
+		Job* job = jobs[i];
+		if (job->timeToFinish > 0) {
+			// Ignore when timeToFinish is already zero
+			job->timeToFinish --;
+		}
+		if (job->timeToFinish > 0) {
+			jobs[newJobCnt] = job;
+			newJobCnt ++;
+		} else {
+			if (ctx->resourceCnt > 1) {
+				kernelAddDemand(server->idle, ctx->demand+job->jobType*RESOURCE_MAX, 1);
+			} else {
+				server->idleCnt += ctx->serverNeeds[job->jobType];
+			}
+			TRACE_JOB(ctx, TRACE_FINISH, job, server->region, 0);
+			kernelReleaseJob(ctx, job);
+		}
+	}
+	server->jobBuffer.jobCnt = newJobCnt;
+	// Walk through the queue and increment job delay by 1
+	for (Node* pos = server->waitingQueue->head; pos != NULL; pos = pos->next) {
+		pos->job->waitTime ++;
+	}
+}
+
+/**
+* Packing score of job on server for ctx->packing, the larger the better (see
+* resource.h)
+*/
+static inline double kernelPackScore(SimContext* ctx, Server* server, Job* job) {
+	const uint32_t* demand = ctx->demand+job->jobType*RESOURCE_MAX;
+	double score = 0;
+	for (uint32_t k = 0; k < ctx->resourceCnt; k ++) {
+		if (server->capacity[k] == 0) continue;
+		double capacity = server->capacity[k];
+		double need = demand[k]/capacity;
+		double idle = server->idle[k]/capacity;
+		score += (ctx->packing == PACK_DOT) ? need*idle : need-idle;
+	}
+	return score;
+}
+
+/**
+* Calculate virtual size of a single job
+*/
+static inline uint32_t kernelVirtualSize(SimContext* ctx, Server* server, Job* job) {
+	return ctx->serverNeeds[job->jobType]*kernelServiceTime(ctx, server->region, job->region);
+}
+
+/**
+* Push a job into queue, the waiting queue of region (regionCnt for the common
+* queue)
+*/
+static inline void kernelEnqueue(SimContext* ctx, Queue* queue, uint32_t region, Job* job) {
+	pushQueue(queue, job);
+	TRACE_JOB(ctx, TRACE_ENQUEUE, job, region, queue->size);
+	(void)ctx;
+	(void)region;
+}
+
+static inline void kernelPushQueueVirtual(SimContext* ctx, Server* server, Job* job) {
+	kernelEnqueue(ctx, server->waitingQueue, server->region, job);
+	server->waitingQueue->virtualSize += kernelVirtualSize(ctx, server, job);
+}
+
+static inline void kernelRemoveQueueVirtual(SimContext* ctx, Server* server, Node* node) {
+	server->waitingQueue->virtualSize -= kernelVirtualSize(ctx, server, node->job);
+	removeQueue(server->waitingQueue, node);
+}
+
+#endif
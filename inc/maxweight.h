@@ -0,0 +1,107 @@
+/**
+* Module implementing incremental MaxWeight over per-(server, origin) queues
+* jsqMaxweightCross generalizes jsqMaxweight to the model of Weina et al.,
+* where server region s keeps a queue Q(s, o) for every origin region o,
+* holding the jobs from o routed to s:
+*
+* - Routing: a job from o joins the server with the least waiting workload once
+*   it joins, among its own region and d regions sampled as jsqD samples them
+*   (see policy.c). The workload of s is serverNeeds*meanServiceTime(s, o) summed
+*   over the jobs waiting in all queues of s.
+* - Scheduling: server s serves the head of its queue with the largest weight
+*   |Q(s, o)|/meanServiceTime(s, o), until that head cannot be served. Servers
+*   schedule at the start of a time unit and whenever a job joins one of their
+*   queues, so routing only counts jobs that really wait.
+*
+* Every server keeps a max-heap of its non-empty queues by weight, indexed so
+* that a queue changing size is one sift and assigning a job costs O(log
+* regionCnt). Weights are compared by cross multiplication in integers. Ties go
+* to the smaller mean service time, then to the next origin after the server in
+* cyclic order. A server only serves its own queues, so the order servers are
+* visited in does not matter (in jsqMaxweight all regions contend for the head
+* of the common queue, region 0 first).
+*
+* Routing on the size of Q(s, o) alone would not see the jobs other origins
+* queue at s, which is why it uses the workload of the whole server.
+* Memory is O(regionCnt^2), queues themselves are created on their first job.
+*/
+#ifndef _MAXWEIGHT_H
+#define _MAXWEIGHT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "param.h"
+#include "job.h"
+#include "queue.h"
+#include "topology.h"
+#include "trace.h"
+
+// Position of a queue not in the heap of its server
+#define MAXWEIGHT_NONE UINT32_MAX
+
+/**
+* Queues and heaps of jsqMaxweightCross, indexed [s*regionCnt+o] for server s
+* and origin o unless noted
+* @param queues Queue Q(s, o), NULL until its first job
+* @param serviceTime Mean service time of server s for jobs from o
+* @param heap Heap of server s, origins of its non-empty queues in
+* heap[s*regionCnt, s*regionCnt+heapSize[s])
+* @param pos Position of o in the heap of s, MAXWEIGHT_NONE if Q(s, o) is empty
+* @param workload Waiting workload of each server, indexed [s]
+* @param queueLength Jobs in all queues
+*/
+typedef struct Maxweight {
+	uint32_t regionCnt;
+	Queue** queues;
+	uint32_t* serviceTime;
+	uint32_t* heap;
+	uint32_t* heapSize;
+	uint32_t* pos;
+	uint64_t* workload;
+	uint32_t queueLength;
+} Maxweight;
+
+/**
+* Create empty queues for the regions and mean service times of ctx
+* Needs to be freed by calling freeMaxweight().
+*/
+Maxweight* newMaxweight(SimContext* ctx);
+
+/**
+* Free all queues and the jobs still inside
+*/
+void freeMaxweight(Maxweight* mw);
+
+/**
+* Workload server has waiting once a job of jobType from origin joins it
+*/
+static inline uint64_t routeWorkload(SimContext* ctx, Maxweight* mw, uint32_t server, uint32_t origin, uint8_t jobType) {
+	return mw->workload[server]+(uint64_t)ctx->serverNeeds[jobType]*mw->serviceTime[server*mw->regionCnt+origin];
+}
+
+/**
+* Origin region of the queue server should serve next, MAXWEIGHT_NONE if all
+* its queues are empty, O(1)
+*/
+static inline uint32_t topMaxweight(Maxweight* mw, uint32_t server) {
+	if (mw->heapSize[server] == 0) return MAXWEIGHT_NONE;
+	return mw->heap[server*mw->regionCnt];
+}
+
+/**
+* Push job into Q(server, job->region), O(log regionCnt)
+*/
+void pushMaxweight(SimContext* ctx, Maxweight* mw, uint32_t server, Job* job);
+
+/**
+* Pop the head of Q(server, origin), O(log regionCnt)
+*/
+void popMaxweight(SimContext* ctx, Maxweight* mw, uint32_t server, uint32_t origin);
+
+/**
+* Increment waitTime of all queued jobs by 1 and return their count
+* Only non-empty queues are visited.
+*/
+uint32_t waitMaxweight(Maxweight* mw);
+
+#endif
@@ -1,41 +1,204 @@
 /**
 * Module including all paramters
-* These parameters should be initialized or parse in the main module. Include
-* this header to share parameters among modules.
+* All parameters and the state of one simulation live in a SimContext, which is
+* passed to every module. Contexts do not share anything, so several
+* simulations may run in one process (one after another or in parallel).
+* Include this header to share parameters among modules.
 */
 #ifndef _PARAM_H
 #define _PARAM_H
 
 #include <stdint.h>
 #include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
 
-// GSL rng, must be assigned before any random operations
-extern gsl_rng* RNG;
+struct Job;
+struct JobBuffer;
+struct Server;
+struct Queue;
+struct Profile;
+struct ServiceModel;
+struct Topology;
+struct Trace;
+struct Feed;
+struct JsqBatch;
 
-// Simulation time units, default 1E6
-// Assign a smaller value for debug and test
-extern uint32_t SIMULATION_TIME;
-
-// Processor count for each server, default 48
-// All servers will have the same number of processors
-// TODO Allow different processor numbers for different servers
-extern uint32_t PROC_CNT;
-
-// Job type count, default 2
-extern uint8_t JOB_TYPE_CNT;
-
-// Arrival rate array, default {10, 4}
-// Must have size of JOB_TYPE_CNT. Arrival count in one time unit follows a
-// Poisson distribution given the mean arrival rate. Adjust according to
-// PROC_CNT.
-extern double* ARRIVAL_RATE;
-
-// Server needs array, default {1, 4}
-// Must have size of JOB_TYPE_CNT. Adjust according to PROC_CNT.
-extern uint32_t* SERVER_NEEDS;
-
-extern uint32_t REGION_CNT;
-
-extern uint32_t* MEAN_SERVICE_TIME;
+/**
+* Simulation context
+* Parameters should be initialized by newSimContext() and may be parsed from
+* command line arguments by parseArgs() (see simulation.h).
+* @param rng GSL rng, assigned by runSimulation() before any random operations
+* @param seed Seed of rng. Drawn by rdrand unless seeded is set
+* @param seeded Whether seed is given explicitly
+* @param simulationTime Simulation time units, default 1E5. Assign a smaller
+* value for debug and test
+* @param procCnt Processor count array, default 48 for every server. Must have
+* size of regionCnt, the (i)th entry is the processor count of the server in the
+* ith region
+* @param jobTypeCnt Job type count, default 2
+* @param arrivalRate Arrival rate array, default {10, 4, 10, 4}. Must have size
+* of regionCnt*jobTypeCnt. Arrival count in one time unit follows a Poisson
+* distribution given the mean arrival rate. Adjust according to procCnt.
+* @param serverNeeds Server needs array, default {1, 4}. Must have size of
+* jobTypeCnt. Adjust according to procCnt.
+* @param regionCnt Region count, default 2
+* @param meanServiceTime Mean service time array, default {1, 2, 2, 1}. Must
+* have size of regionCnt*regionCnt. Unused if topology is set, read it through
+* getMeanServiceTime() (see topology.h)
+* @param sampleCnt Number of regions sampled for each arrival by jsqD and
+* jsqDPart, default 2
+* @param localityWeighted Whether jsqD and jsqDPart sample regions weighted by
+* locality, default 0. When set, region i is sampled for a job from region j
+* with probability proportional to 1/meanServiceTime[i*regionCnt+j].
+* @param resourceCnt Resources of every server, default 1 (processors only, see
+* resource.h)
+* @param resourceNames Name of every resource, processors first
+* @param resourceCapacity Capacities of the resources added by --resource,
+* resource k in row k-1 of size regionCnt
+* @param resourceDemand Demands of the resources added by --resource, resource
+* k in row k-1 of size jobTypeCnt
+* @param packing Server picked by getBestRegion() among remote ones, default
+* PACK_FASTEST
+* @param utilization Utilization of every resource in the last run, of size
+* RESOURCE_MAX
+* @param policy Policy name, default fcfsLocal
+* @param policyId Policy resolved from policy by initPolicy()
+* @param verbose Run simulation verbosely
+* @param approx Approximation used instead of simulation, default APPROX_NONE
+* (see fluid.h)
+* @param planMetric Metric searched for by the capacity planner, default
+* PLAN_NONE (no search, see plan.h)
+* @param planTarget Target value of planMetric
+* @param varianceMode Variance reduction over replications, default VR_NONE
+* (see variance.h)
+* @param replicationCnt Replications run by runReplications(), default 1
+* @param profilePath Arrival rate profile file, default NULL (constant rates)
+* @param profile Profile loaded from profilePath by parseArgs() (see profile.h)
+* @param servicePath Service time distribution file, default NULL (exponential)
+* @param service Service model loaded from servicePath by parseArgs() (see
+* service.h)
+* @param topologyPath Topology file, default NULL (dense meanServiceTime)
+* @param topology Topology loaded from topologyPath by parseArgs() (see
+* topology.h)
+* @param tracePath Event trace file, default NULL (no trace, see trace.h)
+* @param traceSample One arrival in traceSample is traced, default 1
+* @param trace Trace written during runSimulation(), NULL if not tracing
+* @param feedName Shared memory arrival feed, default NULL (arrivals drawn,
+* see feed.h)
+* @param feed Feed read during runSimulation(), NULL if arrivals are drawn
+* @param metricsInterval Time units between rolling metrics printed during
+* runSimulation(), default 0 (none)
+* @param arrivalCnt Arrivals so far in the current run
+* @param threadCnt Threads of a region-sharded run, default 0 (not sharded, see
+* shard.h)
+* @param splitBounds Delay bounds of the tail probabilities estimated by
+* splitting, NULL if not splitting (see splitting.h)
+* @param splitBoundCnt Size of splitBounds
+* @param splitLevels Increasing backlog thresholds of splitting
+* @param splitLevelCnt Size of splitLevels
+* @param splitFactor Runs per threshold crossing, default SPLIT_DEFAULT_FACTOR
+* @param splitProbability P(delay > splitBounds[k]) estimated by the last run,
+* same size as splitBounds
+* @param cacheDir Directory of cached results, default NULL (not cached, see
+* cache.h)
+* @param antithetic Role of the current run in an antithetic pair, default
+* ANTITHETIC_OFF (arrivals and service times drawn from rng, see variance.h)
+* @param antitheticTick Time units drawn so far in the current run
+* @param antitheticGroup Key of the (time unit, region, type) being drawn
+* @param workRate Mean work offered by one arrival per region and type, NULL
+* if the control variate is not needed
+* @param offeredWork Work offered by all arrivals of the last run (serverNeeds
+* times the service time drawn), counted if workRate is set
+* @param meanOfferedWork Mean of offeredWork given the arrival rates in effect
+* @param rate Arrival rates in effect in the current time unit, same shape as
+* arrivalRate. Only valid during runSimulation()
+* @param demand Demands of every job type, RESOURCE_MAX values each (processors
+* first, unused resources 0). Only valid during runSimulation()
+* @param delayHistogram Departed job count by queueing delay, of size
+* DELAY_HISTOGRAM_SIZE (see server.h). Only valid during runSimulation()
+* @param servers Servers of all regions, only valid during runSimulation()
+* @param commonQueue Common queue for jsqMaxweight, NULL for other policies
+* @param maxweight Queues of jsqMaxweightCross (see maxweight.h), NULL for other
+* policies
+* @param backfill Reservations of backfill and backfillCross (see backfill.h),
+* NULL for other policies
+* @param localityTables Per source region sampling tables for locality
+* weighted jsqD, NULL if not weighted
+* @param batch Scratch of jsqBatch and jsqBatchPart (see policy.h), NULL for
+* other policies
+* @param arrivals Arrival buffer reused by policies across time units
+* @param jobPool Finished jobs kept for reuse, so that jobs are not allocated
+* and freed on every arrival and departure
+* @param jobPoolCnt Number of jobs in jobPool
+* @param jobPoolSize Size allocated to jobPool
+*/
+typedef struct SimContext {
+	gsl_rng* rng;
+	uint64_t seed;
+	uint8_t seeded;
+	uint32_t simulationTime;
+	uint32_t* procCnt;
+	uint8_t jobTypeCnt;
+	double* arrivalRate;
+	uint32_t* serverNeeds;
+	uint32_t regionCnt;
+	uint32_t* meanServiceTime;
+	uint32_t sampleCnt;
+	uint8_t localityWeighted;
+	uint8_t resourceCnt;
+	char** resourceNames;
+	uint32_t* resourceCapacity;
+	uint32_t* resourceDemand;
+	uint8_t packing;
+	double* utilization;
+	char policy[20];
+	uint8_t policyId;
+	uint8_t verbose;
+	uint8_t approx;
+	uint8_t planMetric;
+	double planTarget;
+	uint8_t varianceMode;
+	uint32_t replicationCnt;
+	char* profilePath;
+	struct Profile* profile;
+	char* servicePath;
+	struct ServiceModel* service;
+	char* topologyPath;
+	struct Topology* topology;
+	char* tracePath;
+	uint32_t traceSample;
+	struct Trace* trace;
+	char* feedName;
+	struct Feed* feed;
+	uint32_t metricsInterval;
+	uint64_t arrivalCnt;
+	uint32_t threadCnt;
+	uint32_t* splitBounds;
+	uint32_t splitBoundCnt;
+	uint32_t* splitLevels;
+	uint32_t splitLevelCnt;
+	uint32_t splitFactor;
+	double* splitProbability;
+	char* cacheDir;
+	uint8_t antithetic;
+	uint32_t antitheticTick;
+	uint64_t antitheticGroup;
+	double* workRate;
+	uint64_t offeredWork;
+	double meanOfferedWork;
+	double* rate;
+	uint32_t* demand;
+	uint32_t* delayHistogram;
+	struct Server** servers;
+	struct Queue* commonQueue;
+	struct Maxweight* maxweight;
+	struct Backfill* backfill;
+	gsl_ran_discrete_t** localityTables;
+	struct JsqBatch* batch;
+	struct JobBuffer* arrivals;
+	struct Job** jobPool;
+	uint32_t jobPoolCnt;
+	uint32_t jobPoolSize;
+} SimContext;
 
 #endif
@@ -0,0 +1,50 @@
+/**
+* Module implementing the capacity planner
+* --plan mean:X or --plan p99:X searches for the smallest processor count of
+* each region such that the policy meets a target mean or 99th percentile
+* queueing delay X, instead of sweeping processor counts by hand:
+*
+* 1. Start from the offered load of each region (arrival rate times server
+*    needs times mean holding time, rounded up), which no smaller count can
+*    carry on its own.
+* 2. Grow all regions by 1/8 (at least 1 processor) until the target is met.
+* 3. For each region, largest first, binary search its smallest count meeting
+*    the target with the other regions fixed at their counts so far.
+*
+* Every evaluation is a full runSimulation() with the same seed (common random
+* numbers), so two candidates see the same arrivals and service draws, and the
+* comparison between them is not drowned in sampling noise. A run without -e
+* draws one seed for the whole search. Each binary search starts from the
+* counts found so far, so a region costs O(log(count)) evaluations.
+*/
+#ifndef _PLAN_H
+#define _PLAN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "param.h"
+
+// Rounds of growing all regions before giving up on a target
+#define PLAN_MAX_ROUNDS 64
+
+/**
+* Metrics the planner can target, valued the index of the metric in the result
+* of runSimulation()
+*/
+typedef enum PlanMetric {
+	PLAN_NONE = 0,
+	PLAN_MEAN = 1,
+	PLAN_P99 = 2
+} PlanMetric;
+
+/**
+* Search processor counts for ctx->planTarget of ctx->planMetric
+* On return ctx->procCnt holds the counts found and result the values of
+* runSimulation() for them. Returns 1 and prints to stderr if the target is
+* not met even after growing all regions PLAN_MAX_ROUNDS times or a run fails,
+* 0 otherwise.
+*/
+int runPlan(SimContext* ctx, double* result);
+
+#endif
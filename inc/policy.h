@@ -14,6 +14,21 @@
 * - jsqPart: Join the shortest (virtual) queue, but only small jobs.
 * - jsqMaxweight: Proposed in Weina et al. 2016. Push job to join the shortest
 *   queue and use Max Weight algorithm to schedule which queue to serve.
+* - jsqD: Power of d choices. Sample SAMPLE_CNT regions and join the shortest
+*   (virtual) queue among them.
+* - jsqDPart: Power of d choices, but only small jobs.
+* - jsqBatch: Like jsq, but route arrivals of one time unit in batch by
+*   water-filling each (region, type) group at once, one group after another.
+*   A policy of its own: with several groups in a time unit, regions get other
+*   job counts than under jsq (see jsqBatch()).
+* - jsqBatchPart: Same as jsqBatch, but only small jobs.
+* - jsqMaxweightCross: jsqMaxweight with a queue per (server region, origin
+*   region) pair instead of the local and common queue, see maxweight.h.
+* - backfill: fcfsLocal, but when the head does not fit, later jobs may start
+*   if they do not delay the time unit reserved for it (EASY backfilling, see
+*   backfill.h).
+* - backfillCross: backfill, but jobs may be served at a remote server that has
+*   processors left, as in fcfsCross, without delaying its reservation.
 */
 #ifndef _POLICY_H
 #define _POLICY_H
@@ -23,17 +38,89 @@
 #include <stdlib.h>
 #include <string.h>
 #include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
 #include "job.h"
 #include "queue.h"
 #include "server.h"
 #include "param.h"
+#include "topology.h"
+#include "maxweight.h"
+#include "backfill.h"
 
 /**
-* Schedule servers according to policy, returns a sum of queueing length in one
-* time unit (of all regions).
-* @param commonQueue Maintain a common queue for all servers. This is for
-* jsqMaxweight, keep it null for other policies.
+* Policy ids, in the order of the list above
 */
-uint32_t schedule(Server** servers, const char* policy, Queue* commonQueue);
+typedef enum PolicyId {
+	POLICY_FCFS_LOCAL,
+	POLICY_FCFS_CROSS,
+	POLICY_FCFS_CROSS_PART,
+	POLICY_O3_CROSS_PART,
+	POLICY_JSQ,
+	POLICY_JSQ_PART,
+	POLICY_JSQ_MAXWEIGHT,
+	POLICY_JSQ_D,
+	POLICY_JSQ_D_PART,
+	POLICY_JSQ_BATCH,
+	POLICY_JSQ_BATCH_PART,
+	POLICY_JSQ_MAXWEIGHT_CROSS,
+	POLICY_BACKFILL,
+	POLICY_BACKFILL_CROSS,
+	// Number of policies, also the id of an unknown policy
+	POLICY_CNT
+} PolicyId;
+
+/**
+* A region ranked by its virtual queue size
+* Ranks are ordered by (level, region), which is the order the sequential scan
+* in jsq picks regions in (smallest virtual size, ties to the lowest index).
+*/
+typedef struct RegionLevel {
+	uint64_t level;
+	uint32_t region;
+} RegionLevel;
+
+/**
+* Scratch of jsqBatch and jsqBatchPart, kept across time units
+* @param groupStart Start of every (region, type) group in grouped, groupCnt+1
+* entries
+* @param groupFill Next free slot of every group in grouped
+* @param grouped Arrivals of the time unit by group, groupedSize allocated
+* @param ranks Regions by virtual queue size, tmp the scratch of waterFill()
+*/
+typedef struct JsqBatch {
+	uint32_t* groupStart;
+	uint32_t* groupFill;
+	struct Job** grouped;
+	uint32_t groupedSize;
+	RegionLevel* ranks;
+	RegionLevel* tmp;
+} JsqBatch;
+
+/**
+* Get the id of a policy name, POLICY_CNT if unknown
+*/
+uint8_t getPolicyId(const char* policy);
+
+/**
+* Schedule ctx->servers according to ctx->policy, returns a sum of queueing
+* length in one time unit (of all regions and the common queue if any).
+*/
+uint32_t schedule(SimContext* ctx);
+
+/**
+* Prepare any state a policy needs before the first call to schedule()
+* Must be called after parameters of ctx are set and ctx->rng is initialized.
+* This resolves ctx->policyId and creates ctx->commonQueue for
+* jsqMaxweight (ctx->maxweight for jsqMaxweightCross, ctx->backfill for backfill
+* and backfillCross, ctx->batch for jsqBatch and jsqBatchPart). Needs to be
+* freed by calling freePolicy().
+*/
+void initPolicy(SimContext* ctx);
+
+/**
+* Free the state allocated by initPolicy()
+* Jobs still in ctx->commonQueue or ctx->maxweight are freed as well.
+*/
+void freePolicy(SimContext* ctx);
 
 #endif
@@ -0,0 +1,91 @@
+/**
+* Module implementing time-varying arrival rate profiles
+* A profile scales the arrival rates of a region (all job types) over time, so
+* that a diurnal cycle offset between regions can be simulated in one run.
+* Profiles are loaded from a text file given by --profile:
+*
+*   # Comments start with #, one time unit is one minute here
+*   period 1440
+*   0 piecewise 0:0.5 480:1.2 1080:0.8
+*   1 sine 0.5 480
+*
+* - period T: the profile repeats every T time units (required)
+* - r piecewise start:scale ...: from time start (in a period) on, rates of
+*   region r are scaled by scale. Starts are increasing and the first is 0.
+* - r sine amplitude offset: rates of region r are scaled by
+*   1+amplitude*sin(2*pi*(t-offset)/T), clamped at 0
+* Regions without a line keep constant rates.
+*
+* Rates in effect are kept in ctx->rate and updated once per time unit. A
+* piecewise region only rescales when a segment starts, with a cursor that
+* moves forward, and a sine region costs one sin() per time unit. Neither
+* depends on the number of segments.
+*/
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "param.h"
+
+typedef enum ProfileKind {
+	PROFILE_CONSTANT,
+	PROFILE_PIECEWISE,
+	PROFILE_SINE
+} ProfileKind;
+
+/**
+* Scale applied from start (in a period) until the next segment
+*/
+typedef struct ProfileSegment {
+	uint32_t start;
+	double scale;
+} ProfileSegment;
+
+/**
+* Profile of one region
+* @param cursor Segment in effect, only moves forward within a period
+*/
+typedef struct RegionProfile {
+	uint8_t kind;
+	ProfileSegment* segments;
+	uint32_t segmentCnt;
+	uint32_t cursor;
+	double amplitude;
+	double offset;
+} RegionProfile;
+
+typedef struct Profile {
+	uint32_t period;
+	uint32_t regionCnt;
+	RegionProfile* regions;
+} Profile;
+
+/**
+* Load a profile from path for regionCnt regions
+* Returns NULL and prints the reason to stderr if the file cannot be read or
+* is malformed. Needs to be freed by calling freeProfile().
+*/
+Profile* loadProfile(const char* path, uint32_t regionCnt);
+
+void freeProfile(Profile* profile);
+
+/**
+* Point ctx->rate to the rates in effect at time 0
+* Without a profile, ctx->rate is ctx->arrivalRate itself. Needs to be freed by
+* calling freeArrivalRate().
+*/
+void initArrivalRate(SimContext* ctx);
+
+/**
+* Update ctx->rate for time unit timestamp
+* Must be called for consecutive timestamps starting from 0.
+*/
+void updateArrivalRate(SimContext* ctx, uint32_t timestamp);
+
+void freeArrivalRate(SimContext* ctx);
+
+#endif
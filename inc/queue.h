@@ -19,12 +19,15 @@ typedef struct Node {
 
 /**
 * Queue struct
+* Nodes popped or removed are kept in freeNodes (linked by next) and reused by
+* pushQueue(), so that a busy queue does not allocate a node for every job.
 */
 typedef struct Queue {
 	Node* head;
 	Node* tail;
 	uint32_t size;
 	uint32_t virtualSize;
+	Node* freeNodes;
 } Queue;
 
 /**
@@ -50,23 +53,28 @@ void pushQueue(Queue* q, Job* job);
 
 /**
 * Pop the head of a queue
-* This function frees the pointer to the head node, but not freeing the job in
-* the node (the job still needs to be freed manually). The head node is not
+* This function releases the head node, but not freeing the job in the node (the job still needs to be freed manually). The head node is not
 * returned, you may need to store q->head before pop.
 */
 void popQueue(Queue* q);
 
 /**
 * Remove an element pos from the queue
-* This function frees the pointer to the node, but not freeing the job in the
-* node (the job still needs to be freed manually). The node is not returned,
+* This function releases the node, but not freeing the job in the node (the job still needs to be freed manually). The node is not returned,
 * be sure to store node somewhere.
 */
 void removeQueue(Queue* q, Node* node);
 
+/**
+* Copy a queue, with a copy of every job in it
+* Needs to be freed by calling freeQueue().
+*/
+Queue* cloneQueue(Queue* q);
+
 /**
 * Free a queue
-* This function frees all nodes including the jobs inside.
+* This function frees all nodes including the jobs inside, and the released
+* nodes.
 */
 void freeQueue(Queue* q);
 
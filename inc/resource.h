@@ -0,0 +1,99 @@
+/**
+* Module implementing multiple resources per server
+* By default a server has one resource, its processors, and a job of type j
+* needs serverNeeds[j] of them. --resource name:capacity:demand adds another
+* resource (e.g. memory), up to RESOURCE_MAX in all:
+*
+*   --resource mem:256:2,32          256 per server, 2 for type 0, 32 for type 1
+*   --resource mem:256,128,512:2,32  capacity per region
+*
+* A job starts on a server only if every resource it needs is idle, and a job
+* type fitting on no server is rejected (see checkDemands()). Idle amounts of
+* a server and demands of a job type are vectors of RESOURCE_MAX values
+* (processors first, unused resources 0), compared, taken and released in one
+* SSE2 instruction each (see kernelCanServe()). With processors only, the
+* scalar check on idleCnt is kept as is.
+*
+* --packing picks among the remote servers a job fits on when its own server
+* is full (getBestRegion(), i.e. fcfsCross, fcfsCrossPart and o3CrossPart):
+*
+* - fastest: the smallest mean service time (default, as before)
+* - dot: the largest dot product of demand and idle amounts, each scaled by the
+*   capacity of the server, so that a job goes where the resources left over
+*   have its shape (e.g. memory heavy jobs where memory is idle)
+* - bestfit: the least capacity left over, summed over resources scaled by
+*   capacity, so that large holes stay open for large jobs
+*
+* Ties go to the smaller mean service time, then the lower region. Utilization
+* of every resource (held amount over capacity, averaged over time units and
+* servers) is written to ctx->utilization by runSimulation().
+*
+* backfill and backfillCross reserve processors only, and --threads routes on
+* idle processors, neither runs with more resources or with --packing.
+*/
+#ifndef _RESOURCE_H
+#define _RESOURCE_H
+
+#include <stdint.h>
+#include "param.h"
+
+// Resources per server, processors included. Vectors fill one SSE2 register
+#define RESOURCE_MAX 4
+
+// Largest capacity or demand, vectors are compared as signed 32 bit integers
+#define RESOURCE_VALUE_MAX INT32_MAX
+
+/**
+* Packing of getBestRegion(), see above
+*/
+typedef enum Packing {
+	PACK_FASTEST,
+	PACK_DOT,
+	PACK_BEST_FIT
+} Packing;
+
+struct Server;
+
+/**
+* Name of a packing, NULL if out of range
+*/
+const char* packingName(uint8_t packing);
+
+/**
+* Add the resource given by --resource spec (name:capacity:demand) to ctx
+* Capacity is one value for all servers or one per region, demand one per job
+* type. Returns 1 and prints the reason if spec is invalid.
+*/
+int addResource(SimContext* ctx, const char* spec);
+
+/**
+* Check that the demand vector of every job type fits the capacity of at least
+* one server, for processors if processors is set and for every added
+* resource. Returns 1 and prints the job type and its demands otherwise, as
+* such jobs would wait forever.
+*/
+int checkDemands(SimContext* ctx, uint8_t processors);
+
+/**
+* Build ctx->demand from serverNeeds and the added resources, and set up the
+* resources of every server. Called by runSimulation() once servers exist.
+*/
+void initResources(SimContext* ctx);
+
+/**
+* Set the capacity and idle amount of every resource of a new server
+*/
+void initServerResources(SimContext* ctx, struct Server* server);
+
+/**
+* Write the utilization of every resource over timestamp time units to
+* ctx->utilization
+*/
+void sumUtilization(SimContext* ctx, uint32_t timestamp);
+
+/**
+* Free ctx->demand
+*/
+void freeResources(SimContext* ctx);
+
+#endif
@@ -9,12 +9,21 @@
 #include "queue.h"
 #include "job.h"
 #include "param.h"
+#include "resource.h"
+
+// Delays of departed jobs are counted exactly up to this size, longer delays
+// fall into the last bucket
+#define DELAY_HISTOGRAM_SIZE (1u << 16)
 
 /**
 * Server struct
-* @param region an integer in [0, REGION_CNT) defined in param.h
-* @param processorCnt an integer equals to PROC_CNT defined in param.h
+* @param region an integer in [0, regionCnt) defined in SimContext
+* @param processorCnt an integer equals to procCnt[region] defined in SimContext
 * @param idleCnt an integer that tells count of idle processors
+* @param idle idle amount of every resource (see resource.h), idle[0] is
+* idleCnt
+* @param capacity capacity of every resource, capacity[0] is processorCnt
+* @param busy amount of every resource held, summed over time units
 * @param waitingQueue a queue that includes jobs waiting to be serverd
 * @param jobBuffer a job buffer for all jobs that are being served
 * @param departedJobCnt number of jobs that already departed
@@ -23,7 +32,12 @@
 typedef struct Server {
 	uint32_t region;
 	uint32_t processorCnt;
-	uint32_t idleCnt;
+	union {
+		uint32_t idleCnt;
+		uint32_t idle[RESOURCE_MAX];
+	};
+	uint32_t capacity[RESOURCE_MAX];
+	uint64_t busy[RESOURCE_MAX];
 	Queue* waitingQueue;
 	JobBuffer jobBuffer;
 	uint32_t departedJobCnt;
@@ -36,6 +50,12 @@ typedef struct Server {
 */
 Server* newServer(uint32_t region, uint32_t processorCnt);
 
+/**
+* Copy a server, with a copy of every job running or waiting in it
+* Needs to be freed by calling freeServer().
+*/
+Server* cloneServer(Server* server);
+
 /**
 * Free a server
 * This also frees the waiting queue as well as the job buffer (all pending and
@@ -49,30 +69,30 @@ void freeServer(Server* server);
 * call if server has not enough idle processors but add it to the waiting queue
 * instead. Job is considered departed after assigned to a server.
 */
-void assignJobToServer(Server* server, Job* job);
+void assignJobToServer(SimContext* ctx, Server* server, Job* job);
 
 /**
 * Serve ongoing jobs for one time unit
 * This function reduce timeToFinish of jobs from job buffer by 1, and increment
 * waitTime of jobs from waiting queue. Finished jobs will be eliminated and
-* freed.
+* returned to ctx->jobPool.
 */
-void serveJobs(Server* server);
+void serveJobs(SimContext* ctx, Server* server);
 
 /**
 * Determine whether a server can serve the job
 * If job is a NULL, compare against smallest job type.
 */
-uint8_t canServe(Server* server, Job* job);
+uint8_t canServe(SimContext* ctx, Server* server, Job* job);
 
 /**
 * Push a job to the server waiting queue, and add to virtual size
 */
-void pushQueueVirtual(Server* server, Job* job);
+void pushQueueVirtual(SimContext* ctx, Server* server, Job* job);
 
 /**
 * Remove a node from the server waiting queue, and subtract virtual size
 */
-void removeQueueVirtual(Server* server, Node* node);
+void removeQueueVirtual(SimContext* ctx, Server* server, Node* node);
 
 #endif
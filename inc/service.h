@@ -0,0 +1,122 @@
+/**
+* Module implementing service time distributions
+* By default a job from region i draws floor(Exp(meanServiceTime[i*regionCnt+i]))
+* time units of work. A service file given by --service replaces the
+* distribution per (region, job type), one line each:
+*
+*   # region type distribution parameters
+*   0 0 exponential 2
+*   0 1 deterministic 3
+*   1 * lognormal 0.5 1.2
+*   * 1 pareto 1.5 1
+*   1 0 hyperexp 0.9:1 0.1:20
+*   * 0 empirical 1:50 2:30 10:15 60:5
+*   1 1 empirical @histogram.txt
+*
+* - exponential [mean]: mean defaults to the local mean service time
+* - deterministic value
+* - lognormal zeta sigma: exp of a normal with mean zeta and sd sigma
+* - pareto a b: shape a, scale (minimum) b
+* - hyperexp p:mean ...: exponential with mean picked with probability p
+* - empirical value:weight ...: value picked with probability proportional to
+*   weight. @file reads "value weight" lines (e.g. a histogram from logs)
+* * matches every region or type, later lines override earlier ones, pairs
+* without a line stay exponential. As before, the draw is floored and then
+* scaled by the mean service time of the serving region at assignment.
+*
+* Hyperexponential phases and empirical values are picked from Walker alias
+* tables, so every draw is O(1) regardless of the number of phases or values.
+* Service times of one (region, type) group are filled in one batch, choosing
+* the distribution once per group instead of once per job. Antithetic pairs
+* (see variance.h) draw by inversion instead, scanning phases and values.
+*/
+#ifndef _SERVICE_H
+#define _SERVICE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_cdf.h>
+#include "param.h"
+#include "job.h"
+#include "topology.h"
+#include "variance.h"
+
+// Draws are capped at this, and lower if needed so that scaling by the
+// largest mean service time cannot overflow (see capServiceTimes())
+#define SERVICE_TIME_MAX (1u << 24)
+
+typedef enum ServiceKind {
+	SERVICE_EXPONENTIAL,
+	SERVICE_DETERMINISTIC,
+	SERVICE_LOGNORMAL,
+	SERVICE_PARETO,
+	SERVICE_HYPEREXPONENTIAL,
+	SERVICE_EMPIRICAL
+} ServiceKind;
+
+/**
+* Service time distribution of one (region, type)
+* @param a Mean (exponential), value (deterministic), zeta (lognormal) or
+* shape (pareto). A negative exponential mean stands for the local mean
+* service time
+* @param b sigma (lognormal) or scale (pareto)
+* @param values Phase means (hyperexp) or values (empirical)
+* @param weights Probabilities of values, normalized
+* @param table Alias table over values
+*/
+typedef struct ServiceDist {
+	uint8_t kind;
+	double a;
+	double b;
+	double* values;
+	double* weights;
+	uint32_t valueCnt;
+	gsl_ran_discrete_t* table;
+} ServiceDist;
+
+/**
+* Service time distributions of all (region, type) pairs
+* @param timeMax Cap of draws, SERVICE_TIME_MAX until capServiceTimes()
+*/
+typedef struct ServiceModel {
+	uint32_t regionCnt;
+	uint8_t jobTypeCnt;
+	ServiceDist* dists;
+	uint32_t timeMax;
+} ServiceModel;
+
+/**
+* Load a service model from path for regionCnt regions and jobTypeCnt types
+* Returns NULL and prints the reason to stderr if the file cannot be read or
+* is malformed. Needs to be freed by calling freeServiceModel().
+*/
+ServiceModel* loadServiceModel(const char* path, uint32_t regionCnt, uint8_t jobTypeCnt);
+
+void freeServiceModel(ServiceModel* model);
+
+/**
+* Lower ctx->service->timeMax to UINT32_MAX over the largest mean service time
+* of ctx (matrix or topology), so that a draw scaled at assignment fits in
+* timeToFinish. Called by parseArgs() once mean service times are known.
+*/
+void capServiceTimes(SimContext* ctx);
+
+/**
+* Fill timeToFinish of n jobs from region with the service distribution of
+* (region, jobType) in ctx->service
+*/
+void fillServiceTimes(SimContext* ctx, uint32_t region, uint8_t jobType, Job** jobs, uint32_t n);
+
+/**
+* Moments of floor(X) for the service time X of jobs of (region, jobType)
+* Sets p0 = P(floor(X) = 0) and meanFloor = E[floor(X)]. Uses the default
+* exponential if ctx->service is NULL. Used by the fluid approximation.
+*/
+void serviceFloorMoments(SimContext* ctx, uint32_t region, uint8_t jobType, double* p0, double* meanFloor);
+
+#endif
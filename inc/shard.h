@@ -0,0 +1,178 @@
+/**
+* Module implementing region-sharded multithreaded simulation
+* --threads n runs one simulation on n threads for fcfsLocal, fcfsCross,
+* fcfsCrossPart, jsq and jsqPart. Regions are split into n contiguous shards,
+* one per thread, and every time unit runs in phases separated by a barrier.
+* Each phase visits every region once, on whichever thread claims it:
+*
+* 1. Local: serve the head of the waiting queue while it fits, draw the
+*    arrivals of the region and start those that fit locally (fcfs), or hold
+*    all of them for routing (jsq). Record the idle processors (fcfs) or the
+*    virtual queue size (jsq) of the region in a snapshot.
+* 2. Route (origin): pick a target for the waiting jobs of the region that can
+*    leave it (from the queue head until one fits nowhere, then the held
+*    arrivals) with getBestRegion() against the snapshot less what the region
+*    itself routed so far in this phase. Post each to the mailbox of its
+*    target, kept per thread. jsq instead routes the held arrivals of all
+*    regions on one thread, in one shuffled order, to the shortest virtual
+*    queue kept in a heap, as jsq() does.
+* 3. Accept (target): merge the mailboxes of the region from all threads in
+*    (origin, posting) order, routing order for jsq, start the jobs that still
+*    fit (fcfs) or push them to the virtual queue and serve it (jsq). fcfs
+*    records the idle processors left in the snapshot, and phases 2 and 3
+*    repeat for the jobs turned down until a round starts none or turns none
+*    down.
+* 4. Finish (origin): take the started jobs out of the waiting queue, queue the
+*    held arrivals not started, and serve running jobs as serveJobs() does.
+*
+* fcfsLocal only runs phases 1 and 4. fcfsLocal and jsq match a run without
+* --threads up to the random numbers drawn, fcfsCross does not: a region serves
+* its own queue and arrivals before any job routed from another region, where
+* fcfsCross lets the queue of region 0 take idle processors of region 1 before
+* region 1 drains its own queue. Routing sees the state at the end of the
+* previous phase rather than after every job, so a target taken by several
+* origins at once starts the first ones, and the rest are routed again to the
+* processors left elsewhere in the next round.
+*
+* Every region draws from its own rng seeded from (seed, region), and every
+* phase only reads other regions through the snapshot and the sorted mailboxes.
+* Which thread runs a region does not change anything, so results depend on
+* the seed only, and are the same for any thread count (not the same as
+* without --threads, which draws all regions from one rng).
+*
+* Threads first claim chunks of SHARD_CHUNK regions of their own shard, then
+* steal chunks from the other shards (next ones first), so that shards of
+* uneven load finish together. Each thread works on a copy of the SimContext
+* with a delay histogram and job pool of its own, merged into the context at
+* the end.
+*/
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <gsl/gsl_rng.h>
+#include "param.h"
+#include "job.h"
+#include "queue.h"
+
+// Regions claimed at once from a shard
+#define SHARD_CHUNK 4
+
+// Target of a request routed nowhere
+#define SHARD_NONE UINT32_MAX
+
+/**
+* Job of an origin region waiting for a target
+* @param node Its node in the waiting queue of the origin, NULL for an arrival
+* of this time unit
+* @param accepted Whether the target started it (fcfs) or queued it (jsq)
+*/
+typedef struct ShardRequest {
+	Job* job;
+	Node* node;
+	uint32_t target;
+	uint8_t accepted;
+} ShardRequest;
+
+/**
+* Mailbox entry, requests[origin][index]
+* @param seq Position in the merged mailboxes of its target
+*/
+typedef struct ShardMail {
+	uint32_t origin;
+	uint32_t index;
+	uint32_t seq;
+} ShardMail;
+
+/**
+* Cursor of a shard on a cache line of its own
+*/
+typedef struct ShardCursor {
+	_Alignas(64) _Atomic uint64_t next;
+} ShardCursor;
+
+/**
+* State of one thread
+* @param ctx Copy of the simulation context with its own rng (the rng of the
+* region being drawn), delayHistogram and job pool
+* @param shards Run the thread belongs to
+* @param mail Mailbox of every target region, NULL until its first entry
+* @param inbox Merged mailboxes of the region being accepted
+* @param routed Processors routed to each region by the origin being routed,
+* reset through touched
+* @param acceptedCnt Requests this thread started as a target, rejectedCnt
+* those it turned down, counted since the start of the run (see runShard())
+*/
+typedef struct ShardThread {
+	SimContext ctx;
+	struct Shards* shards;
+	uint32_t id;
+	pthread_t thread;
+	ShardMail** mail;
+	uint32_t* mailCnt;
+	uint32_t* mailSize;
+	ShardMail* inbox;
+	uint32_t inboxSize;
+	uint64_t* routed;
+	uint32_t* touched;
+	uint32_t touchedCnt;
+	uint64_t acceptedCnt;
+	uint64_t rejectedCnt;
+	JobBuffer arrivals;
+} ShardThread;
+
+/**
+* Sharded run of ctx
+* @param bound Shard t holds regions [bound[t], bound[t+1])
+* @param cursor Regions claimed from each shard, counted over all phases so
+* far (a shard of size n is exhausted in phase p once it reaches (p+1)*n)
+* @param rngs Rng of every region
+* @param routeRng Rng of the routing order of jsq
+* @param requests Waiting jobs of every origin region routed in this time unit
+* @param heldCnt Held arrivals of every origin, the first of its requests
+* @param snapshot Idle processors (fcfs) or virtual queue size (jsq) of every
+* region at the end of phase 1 and of every accept round (fcfs), updated while
+* routing (jsq)
+* @param order Held arrivals of all regions in routing order (jsq)
+* @param heap Regions by snapshot, heapPos the position of each (jsq)
+* @param queueLength Waiting queue size of every region at the end of the
+* time unit
+*/
+typedef struct Shards {
+	SimContext* ctx;
+	uint32_t threadCnt;
+	ShardThread* threads;
+	uint32_t* bound;
+	ShardCursor* cursor;
+	pthread_barrier_t barrier;
+	gsl_rng** rngs;
+	gsl_rng* routeRng;
+	ShardRequest** requests;
+	uint32_t* requestCnt;
+	uint32_t* requestSize;
+	uint32_t* heldCnt;
+	uint64_t* snapshot;
+	ShardMail* order;
+	uint32_t orderSize;
+	uint32_t* heap;
+	uint32_t* heapPos;
+	uint32_t* queueLength;
+	uint64_t queueLengthSum;
+} Shards;
+
+/**
+* Whether a policy can run sharded
+*/
+uint8_t shardable(uint8_t policyId);
+
+/**
+* Run all ctx->simulationTime units of ctx on ctx->threadCnt threads
+* Servers, delayHistogram and arrival rates must be set up as runSimulation()
+* does. Returns the sum over time units of the queue length per region (the
+* numerator of the expected queue length).
+*/
+double runShards(SimContext* ctx);
+
+#endif
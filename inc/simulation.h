@@ -0,0 +1,91 @@
+/**
+* Module running one simulation on a SimContext
+* This is also the interface of libmss.so. A context is created with default
+* parameters, configured by parseArgs() (same options as the command line, see
+* README) and run by runSimulation(), possibly several times.
+*/
+#ifndef _SIMULATION_H
+#define _SIMULATION_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gsl/gsl_rng.h>
+#include "param.h"
+#include "policy.h"
+#include "fluid.h"
+#include "profile.h"
+#include "service.h"
+#include "topology.h"
+#include "plan.h"
+#include "trace.h"
+#include "variance.h"
+#include "feed.h"
+#include "splitting.h"
+#include "cache.h"
+#include "resource.h"
+
+// Number of values written by runSimulation()
+#define SIM_RESULT_CNT 3
+
+/**
+* Create a context with default parameters
+* Needs to be freed by calling freeSimContext().
+*/
+SimContext* newSimContext();
+
+/**
+* Free a context and all parameters it owns
+*/
+void freeSimContext(SimContext* ctx);
+
+/**
+* Copy the state of a running simulation: servers with their queues and jobs,
+* the common queue and a new rng seeded seed
+* Parameters, policy tables and ctx->delayHistogram are shared with ctx. Only
+* for policies passing splittable() (see splitting.h). Needs to be freed by
+* calling freeSimContextClone().
+*/
+SimContext* cloneSimContext(SimContext* ctx, unsigned long seed);
+
+/**
+* Free a context made by cloneSimContext() and the state it owns
+*/
+void freeSimContextClone(SimContext* clone);
+
+/**
+* Parse command line options into ctx
+* argv[0] is skipped as the program name. Returns 1 if help is printed or an
+* option is invalid (the caller should stop), 0 otherwise. Files given by
+* --profile and --service are loaded once all options are parsed.
+*/
+int parseArgs(SimContext* ctx, int argc, const char* argv[]);
+
+/**
+* Copy the processor count of each region to procCnt unless it is NULL
+* Returns ctx->regionCnt. Lets bindings read the counts found by runPlan().
+*/
+uint32_t getProcCnt(SimContext* ctx, uint32_t* procCnt);
+
+/**
+* Print parameters of ctx for confirmation
+*/
+void printSimContext(SimContext* ctx);
+
+/**
+* Run the simulation for ctx->simulationTime units
+* Servers and rng are created on start and freed on return, so a context can
+* be run again. Writes SIM_RESULT_CNT values to result: expected queue length,
+* expected queueing delay and 99th percentile queueing delay. Runs runFluid()
+* instead if ctx->approx is APPROX_FLUID. Arrivals are read from ctx->feed if
+* the caller opened one (see openFeed()), the run then ends early once the
+* producer closes it. Prints rolling metrics every ctx->metricsInterval time
+* units if set. Runs on ctx->threadCnt threads with regions sharded if set
+* (see runShards()). Reads and writes ctx->cacheDir if set (see cache.h).
+* Returns 1 and prints the reason to stderr if ctx->tracePath cannot be
+* written, 0 otherwise.
+*/
+int runSimulation(SimContext* ctx, double* result);
+
+#endif
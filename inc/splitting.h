@@ -0,0 +1,55 @@
+/**
+* Module implementing multilevel splitting (RESTART) for tail delays
+* --split b1,b2,... estimates P(delay > b) for every bound b, where a brute
+* force run would see too few such delays. The importance of a state is its
+* backlog, the jobs waiting in all queues at the end of a time unit, and
+* --split-levels l1,l2,... are increasing backlog thresholds. Level i holds
+* the states of backlog in [l_i, l_i+1), level 0 those below l1.
+*
+* The main run is the plain simulation, with the same results as without
+* --split. Whenever a run crosses threshold l_i upwards, --split-factor f
+* minus 1 retrials are cloned from it (servers, queues, running jobs and a
+* new rng stream of their own, see cloneSimContext()) and run on until their
+* backlog falls below l_i, or the end of the simulation. A retrial crossing
+* higher thresholds splits again, so a state at level i is reached by about
+* f^i runs for every time the main run reaches it. Jobs started during a time
+* unit that begins at level i are counted with weight f^-i, which keeps the
+* weighted count of delays over b an unbiased estimate of that count in the
+* main run, made of f^i times as many samples at level i. Probabilities are
+* the weighted counts over the jobs started by the main run.
+*
+* Retrials run depth first, each to its end before the run it was cloned from
+* goes on, so at most one per threshold is alive at once. Thresholds pay off
+* when each is crossed upwards by about one in f runs starting from the one
+* below, too low ones multiply retrials that add little. Retrial
+* streams are seeded from (seed, retrial index) in the order retrials start,
+* so results depend on the seed only.
+*
+* Policies keeping scheduling state beyond servers and queues
+* (jsqMaxweightCross, backfill, backfillCross) cannot be cloned, nor can runs
+* following an arrival rate profile.
+*/
+#ifndef _SPLITTING_H
+#define _SPLITTING_H
+
+#include <stdint.h>
+#include "param.h"
+
+// Default runs per threshold crossing, the one crossing included
+#define SPLIT_DEFAULT_FACTOR 4
+
+/**
+* Whether a policy can be cloned by cloneSimContext()
+*/
+uint8_t splittable(uint8_t policyId);
+
+/**
+* Run all ctx->simulationTime units of ctx with splitting, and write
+* P(delay > ctx->splitBounds[k]) to ctx->splitProbability[k]
+* Servers, delayHistogram and arrival rates must be set up as runSimulation()
+* does, delayHistogram holds the jobs of the main run on return. Returns the
+* sum over time units of the queue length per region of the main run.
+*/
+double runSplitting(SimContext* ctx);
+
+#endif
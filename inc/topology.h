@@ -0,0 +1,126 @@
+/**
+* Module implementing the topology service time model
+* The dense meanServiceTime matrix needs regionCnt^2 entries, too many for a
+* fleet of thousands of regions. A topology file given by --topology replaces
+* it: regions belong to datacenters, datacenters to zones, and the mean service
+* time only depends on the closest level two regions share, with sparse
+* overrides for individual pairs:
+*
+*   # Mean service time per level
+*   local 1
+*   datacenter 2
+*   zone 3
+*   remote 5
+*   # first[-last] datacenter zone
+*   0-99 0 0
+*   100-199 1 0
+*   200-299 2 1
+*   # pair serverRegion jobRegion meanServiceTime
+*   pair 5 217 4
+*
+* Datacenter and zone ids are below regionCnt, and a datacenter is in one zone.
+* Regions without a line form a datacenter and zone of their own. Queries are
+* O(1): a few array lookups, plus one hash probe if there are pairs. Memory is
+* O(regionCnt + pairs).
+*
+* With -w, jsqD and jsqDPart sample a level with probability proportional to
+* (regions in the level)/(its mean service time), then a region uniformly in
+* the level, which is O(1) per sample without alias tables of regionCnt^2.
+* This sampler ignores pair overrides.
+*/
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gsl/gsl_rng.h>
+#include "param.h"
+
+typedef enum TopologyLevel {
+	TOPOLOGY_LOCAL,
+	TOPOLOGY_DATACENTER,
+	TOPOLOGY_ZONE,
+	TOPOLOGY_REMOTE,
+	TOPOLOGY_LEVEL_CNT
+} TopologyLevel;
+
+/**
+* Topology of regionCnt regions
+* @param levelTime Mean service time of each TopologyLevel
+* @param datacenter Datacenter of each region
+* @param zone Zone of each region
+* @param pairKeys Open addressing table of overridden pairs, keyed by
+* serverRegion*regionCnt+jobRegion+1 (0 is empty)
+* @param pairTimes Mean service time of each key in pairKeys
+* @param pairMask Size of pairKeys minus 1 (a power of 2 minus 1)
+* @param order Regions sorted by (zone, datacenter), so that every datacenter
+* and zone is a range of order
+* @param datacenterStart Range [datacenterStart, datacenterEnd) of each
+* datacenter in order, same for zones
+*/
+typedef struct Topology {
+	uint32_t regionCnt;
+	uint32_t levelTime[TOPOLOGY_LEVEL_CNT];
+	uint32_t* datacenter;
+	uint32_t* zone;
+	uint64_t* pairKeys;
+	uint32_t* pairTimes;
+	uint32_t pairCnt;
+	uint64_t pairMask;
+	uint32_t* order;
+	uint32_t datacenterCnt;
+	uint32_t zoneCnt;
+	uint32_t* datacenterStart;
+	uint32_t* datacenterEnd;
+	uint32_t* zoneStart;
+	uint32_t* zoneEnd;
+} Topology;
+
+/**
+* Load a topology from path for regionCnt regions
+* Returns NULL and prints the reason to stderr if the file cannot be read or
+* is malformed. Needs to be freed by calling freeTopology().
+*/
+Topology* loadTopology(const char* path, uint32_t regionCnt);
+
+void freeTopology(Topology* topology);
+
+/**
+* Sample a region for a job from jobRegion, weighted by locality (see above)
+*/
+uint32_t sampleTopologyRegion(const Topology* topology, const gsl_rng* rng, uint32_t jobRegion);
+
+static inline uint64_t topologyHash(uint64_t key, uint64_t mask) {
+	return (key*0x9E3779B97F4A7C15ull >> 17) & mask;
+}
+
+/**
+* Mean service time for a server in serverRegion to serve a job from jobRegion
+*/
+static inline uint32_t topologyServiceTime(const Topology* topology, uint32_t serverRegion, uint32_t jobRegion) {
+	if (topology->pairCnt > 0) {
+		uint64_t key = (uint64_t)serverRegion*topology->regionCnt+jobRegion+1;
+		for (uint64_t i = topologyHash(key, topology->pairMask); topology->pairKeys[i] != 0; i = (i+1) & topology->pairMask) {
+			if (topology->pairKeys[i] == key) return topology->pairTimes[i];
+		}
+	}
+	if (serverRegion == jobRegion) return topology->levelTime[TOPOLOGY_LOCAL];
+	if (topology->datacenter[serverRegion] == topology->datacenter[jobRegion]) return topology->levelTime[TOPOLOGY_DATACENTER];
+	if (topology->zone[serverRegion] == topology->zone[jobRegion]) return topology->levelTime[TOPOLOGY_ZONE];
+	return topology->levelTime[TOPOLOGY_REMOTE];
+}
+
+/**
+* Mean service time for a server in serverRegion to serve a job from jobRegion
+* Reads the topology if any, the dense ctx->meanServiceTime otherwise.
+*/
+static inline uint32_t getMeanServiceTime(const SimContext* ctx, uint32_t serverRegion, uint32_t jobRegion) {
+	if (ctx->topology != NULL) {
+		return topologyServiceTime(ctx->topology, serverRegion, jobRegion);
+	}
+	return ctx->meanServiceTime[serverRegion*ctx->regionCnt+jobRegion];
+}
+
+#endif
@@ -0,0 +1,164 @@
+/**
+* Module implementing binary event tracing
+* Built with `make TRACE=1` (-DMSS_TRACE), --trace file records the life of
+* sampled jobs as fixed size binary events:
+*
+* - TRACE_ARRIVE: job arrives in region, value is its drawn service time
+* - TRACE_ENQUEUE: job joins the waiting queue of region (regionCnt is the
+*   common queue of jsqMaxweight), value is the queue size after the push
+* - TRACE_CROSS: job is assigned to region other than its own, value is its
+*   service time there
+* - TRACE_START: job starts in region, value is the time it waited
+* - TRACE_FINISH: job leaves region
+*
+* --trace-sample N traces one arrival in N (every Nth arrival, so tracing draws
+* no random numbers and does not change results). Untraced jobs cost one branch
+* per event site, and the whole facility compiles away without MSS_TRACE.
+*
+* Events go to a ring buffer with a single producer (the simulation) and a
+* single consumer (a writer thread that flushes them to the file), synchronized
+* by two atomic counters and no lock. The producer only waits if the writer
+* falls a full ring behind. The file is a TraceHeader followed by TraceEvents,
+* little endian. Decode it with scripts/trace.py.
+*/
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "param.h"
+#include "job.h"
+
+#define TRACE_VERSION 1
+
+// Events in the ring buffer, a power of 2
+#define TRACE_RING_SIZE (1u << 16)
+
+typedef enum TraceKind {
+	TRACE_ARRIVE,
+	TRACE_ENQUEUE,
+	TRACE_CROSS,
+	TRACE_START,
+	TRACE_FINISH
+} TraceKind;
+
+/**
+* File header
+* @param magic "MSSTRACE"
+* @param sample One arrival in sample is traced
+*/
+typedef struct TraceHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t sample;
+	uint32_t regionCnt;
+	uint32_t jobTypeCnt;
+	uint64_t seed;
+} TraceHeader;
+
+/**
+* One event, 20 bytes
+* @param jobId Traced jobs are numbered from 1 in order of arrival
+* @param value Meaning depends on kind, see above
+*/
+typedef struct TraceEvent {
+	uint32_t timestamp;
+	uint32_t jobId;
+	uint32_t region;
+	uint32_t value;
+	uint8_t kind;
+	uint8_t jobType;
+	uint16_t reserved;
+} TraceEvent;
+
+/**
+* Open ctx->tracePath and start the writer thread
+* Called by runSimulation() once the seed is known. Returns NULL and prints the
+* reason to stderr if the file cannot be written or tracing is not compiled in.
+* Needs to be closed by calling closeTrace().
+*/
+struct Trace* openTrace(SimContext* ctx);
+
+/**
+* Flush remaining events, stop the writer thread and close the file
+*/
+void closeTrace(struct Trace* trace);
+
+#ifdef MSS_TRACE
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+/**
+* Trace of one run
+* @param head Events written by the simulation
+* @param tail Events flushed by the writer thread
+* @param arrivalCnt Arrivals since the last traced one
+* @param jobCnt Traced jobs so far, the id of the last one
+* @param timestamp Current time unit, set by runSimulation()
+*/
+typedef struct Trace {
+	FILE* file;
+	uint32_t sample;
+	uint32_t arrivalCnt;
+	uint32_t jobCnt;
+	uint32_t timestamp;
+	TraceEvent* ring;
+	_Atomic uint64_t head;
+	_Atomic uint64_t tail;
+	atomic_int done;
+	pthread_t writer;
+} Trace;
+
+/**
+* Wait for the writer thread to free a slot of the ring
+*/
+void traceWait(Trace* trace);
+
+static inline void traceEvent(Trace* trace, uint8_t kind, const Job* job, uint32_t region, uint32_t value) {
+	uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+	while (head-atomic_load_explicit(&trace->tail, memory_order_acquire) == TRACE_RING_SIZE) {
+		traceWait(trace);
+	}
+	TraceEvent* event = &trace->ring[head & (TRACE_RING_SIZE-1)];
+	event->timestamp = trace->timestamp;
+	event->jobId = job->traceId;
+	event->region = region;
+	event->value = value;
+	event->kind = kind;
+	event->jobType = job->jobType;
+	event->reserved = 0;
+	atomic_store_explicit(&trace->head, head+1, memory_order_release);
+}
+
+/**
+* Number the sampled jobs among n new jobs and record their arrival
+*/
+static inline void traceArrivals(SimContext* ctx, Job** jobs, uint32_t n) {
+	Trace* trace = ctx->trace;
+	for (uint32_t i = 0; i < n; i ++) {
+		Job* job = jobs[i];
+		job->traceId = 0;
+		if ((trace != NULL) && (++ trace->arrivalCnt == trace->sample)) {
+			trace->arrivalCnt = 0;
+			job->traceId = ++ trace->jobCnt;
+			traceEvent(trace, TRACE_ARRIVE, job, job->region, job->timeToFinish);
+		}
+	}
+}
+
+// Record an event of a job if it is traced
+#define TRACE_JOB(ctx, kind, job, region, value) \
+	do { if ((job)->traceId != 0) traceEvent((ctx)->trace, (kind), (job), (region), (value)); } while (0)
+#define TRACE_ARRIVALS(ctx, jobs, n) traceArrivals((ctx), (jobs), (n))
+#define TRACE_TICK(ctx, t) do { if ((ctx)->trace != NULL) (ctx)->trace->timestamp = (t); } while (0)
+
+#else
+
+#define TRACE_JOB(ctx, kind, job, region, value) ((void)0)
+#define TRACE_ARRIVALS(ctx, jobs, n) ((void)0)
+#define TRACE_TICK(ctx, t) ((void)0)
+
+#endif
+
+#endif
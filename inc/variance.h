@@ -0,0 +1,153 @@
+/**
+* Module implementing variance reduction over replications
+* --reps n runs n replications instead of a single run, seeded seed, seed+1,
+* ..., and prints the mean of their results. --vr picks how the replications
+* are combined:
+*
+* - antithetic: every replication is a pair of runs. Arrival counts and service
+*   times are drawn by inverting their distribution function at uniforms u,
+*   and the second run of the pair uses 1-u. Busy
+*   and quiet periods of one run are mirrored in the other, so that the pair
+*   mean varies less than the mean of two independent runs.
+* - control: the work offered by arriving jobs (serverNeeds times the service
+*   time drawn, summed over arrivals) has a known mean from the arrival rates in
+*   effect and the service distributions. Queue length and delay are corrected
+*   by beta*(offered-expected) per replication, beta fitted by least squares
+*   over the replications. Needs at least VR_CONTROL_MIN_REPS replications.
+* - both: control applied to the pair means of antithetic.
+*
+* The variance reduction factor is the variance of the plain mean of as many
+* independent runs over the variance of the estimator, i.e. how many times
+* fewer simulated time units give the same confidence. Both are estimated
+* from the runs themselves, so the factor carries noise of its own for few
+* replications. The 99th percentile delay is the plain mean over runs.
+*
+* Antithetic uniforms are not taken from a stream but hashed from (seed, time
+* unit, region, type, index), index counting the draws of the group. Arrival
+* counts of the two runs of a pair differ, and a stream would drift apart
+* after the first one. Hashing keeps every draw in step: the kth job of a
+* (region, type) in a time unit mirrors the kth job of the other run, if both
+* runs have one.
+* Empirical values and hyperexp phases are inverted in the order they are
+* listed in the service file, list them in increasing order for the pairs to
+* mirror each other.
+*/
+#ifndef _VARIANCE_H
+#define _VARIANCE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_cdf.h>
+#include "param.h"
+
+// Poisson means above this are drawn as a sum of parts, so that exp(-mean)
+// does not underflow while inverting
+#define POISSON_INVERSE_MAX 256.0
+
+// Number of values written by runReplications() after the result
+#define VR_FACTOR_CNT 2
+
+// Fewest replications for --vr control and both. The residual variance has
+// n-2 degrees of freedom, with fewer than 3 the factor is mostly noise
+#define VR_CONTROL_MIN_REPS 5
+
+// Index of the first antithetic draw of an arrival count, service times
+// count from 0
+#define ANTITHETIC_COUNT_INDEX (1ull << 63)
+
+/**
+* Estimators selected by --vr, control and antithetic can be combined
+*/
+typedef enum VarianceMode {
+	VR_NONE = 0,
+	VR_ANTITHETIC = 1,
+	VR_CONTROL = 2,
+	VR_BOTH = 3
+} VarianceMode;
+
+/**
+* Role of the current run in an antithetic pair
+*/
+typedef enum AntitheticRun {
+	ANTITHETIC_OFF = 0,
+	ANTITHETIC_FIRST = 1,
+	ANTITHETIC_MIRROR = 2
+} AntitheticRun;
+
+/**
+* Uniform in (0, 1) of draw index of the current group (ctx->antitheticGroup),
+* mirrored in the second run of a pair. splitmix64 of the key.
+*/
+static inline double antitheticUniform(SimContext* ctx, uint64_t index) {
+	uint64_t z = ctx->seed+ctx->antitheticGroup*0x9E3779B97F4A7C15ull;
+	z = (z^(z >> 29))*0xBF58476D1CE4E5B9ull+index*0xD6E8FEB86659FD93ull;
+	z = (z^(z >> 30))*0xBF58476D1CE4E5B9ull;
+	z = (z^(z >> 27))*0x94D049BB133111EBull;
+	z ^= z >> 31;
+	double u = ((double)(z >> 11)+0.5)*0x1.0p-53;
+	return (ctx->antithetic == ANTITHETIC_MIRROR) ? 1-u : u;
+}
+
+/**
+* Poisson count of mean for the current group by inversion, non-decreasing in
+* the uniforms drawn
+*/
+static inline uint32_t arrivalPoisson(SimContext* ctx, double mean) {
+	uint32_t cnt = 0;
+	uint64_t index = ANTITHETIC_COUNT_INDEX;
+	while (mean > 0) {
+		double part = (mean > POISSON_INVERSE_MAX) ? POISSON_INVERSE_MAX : mean;
+		mean -= part;
+		double u = antitheticUniform(ctx, index ++);
+		double p = exp(-part);
+		double cdf = p;
+		uint32_t k = 0;
+		while ((cdf < u) && (p > 0)) {
+			k ++;
+			p *= part/k;
+			cdf += p;
+		}
+		cnt += k;
+	}
+	return cnt;
+}
+
+/**
+* Name of a VarianceMode as given to --vr
+*/
+const char* varianceModeName(uint8_t mode);
+
+/**
+* Run ctx->replicationCnt replications combined by ctx->varianceMode
+* Writes the estimates to result as runSimulation() does, and the variance
+* reduction factors of queue length and delay to factor. Returns 1 and prints
+* to stderr if there are too few replications to estimate variances or a run
+* fails, 0 otherwise.
+*/
+int runReplications(SimContext* ctx, double* result, double* factor);
+
+/**
+* Prepare ctx->workRate, the mean work offered by one arrival per region and
+* type (serverNeeds times the mean service time drawn) for meanWorkRate().
+* Needs to be freed by calling freeWorkRate().
+*/
+void initWorkRate(SimContext* ctx);
+
+void freeWorkRate(SimContext* ctx);
+
+/**
+* Mean work offered in one time unit at the arrival rates in effect (see
+* updateArrivalRate())
+*/
+static inline double meanWorkRate(SimContext* ctx) {
+	double work = 0;
+	for (uint32_t i = 0; i < ctx->regionCnt*ctx->jobTypeCnt; i ++) {
+		work += ctx->rate[i]*ctx->workRate[i];
+	}
+	return work;
+}
+
+#endif
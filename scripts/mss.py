@@ -0,0 +1,89 @@
+"""ctypes binding of libmss.so
+Build the library under root directory with `make lib`. Each config runs on its
+own SimContext inside this process, results are written by the simulator
+straight into a numpy array (no copies and no shell per config).
+"""
+import ctypes
+import os
+import shlex
+import numpy as np
+from concurrent.futures import ThreadPoolExecutor
+from typing import *
+
+# Must match SIM_RESULT_CNT in inc/simulation.h
+SIM_RESULT_CNT = 3
+
+libraryPath = os.path.abspath(os.path.join(os.path.dirname(__file__), os.pardir, "libmss.so"))
+
+_lib = None
+
+def load(path: str = libraryPath) -> ctypes.CDLL:
+  """Load the shared library once and declare the function signatures
+  """
+  global _lib
+  if (_lib is None):
+    if (not os.path.isfile(path)):
+      raise Exception("Shared library not found, run `make lib` first")
+    lib = ctypes.CDLL(path)
+    lib.newSimContext.argtypes = []
+    lib.newSimContext.restype = ctypes.c_void_p
+    lib.freeSimContext.argtypes = [ctypes.c_void_p]
+    lib.freeSimContext.restype = None
+    lib.parseArgs.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(ctypes.c_char_p)]
+    lib.parseArgs.restype = ctypes.c_int
+    lib.runSimulation.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_double)]
+    lib.runSimulation.restype = ctypes.c_int
+    lib.runPlan.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_double)]
+    lib.runPlan.restype = ctypes.c_int
+    lib.getProcCnt.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint32)]
+    lib.getProcCnt.restype = ctypes.c_uint32
+    _lib = lib
+  return _lib
+
+def available(path: str = libraryPath) -> bool:
+  return os.path.isfile(path)
+
+def runOne(opts: str, out: np.ndarray) -> Optional[List[int]]:
+  """Run one simulation given command line options, write results to out
+  out must be a contiguous float64 array of SIM_RESULT_CNT entries. With
+  --plan, runs the capacity planner instead, writes the results for the
+  processor counts it found and returns these counts (one per region). Returns
+  None otherwise.
+  """
+  lib = load()
+  args = ["sim"] + shlex.split(opts)
+  argv = (ctypes.c_char_p * len(args))(*[a.encode() for a in args])
+  ctx = lib.newSimContext()
+  try:
+    if (lib.parseArgs(ctx, len(args), argv) != 0):
+      raise Exception("Invalid options `%s`" % opts)
+    result = out.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+    if ("--plan" in args):
+      if (lib.runPlan(ctx, result) != 0):
+        raise Exception("Planning failed for `%s`" % opts)
+      procCnt = (ctypes.c_uint32 * lib.getProcCnt(ctx, None))()
+      lib.getProcCnt(ctx, procCnt)
+      return list(procCnt)
+    if (lib.runSimulation(ctx, result) != 0):
+      raise Exception("Simulation failed for `%s`" % opts)
+    return None
+  finally:
+    lib.freeSimContext(ctx)
+
+def run(configs: List[Any], workers: int = 1, counts: List[Any] = None) -> np.ndarray:
+  """Run a list of configs (anything with toCommand(), see sim.py)
+  Returns an array of shape (len(configs), SIM_RESULT_CNT): expected queue
+  length, expected queueing delay and 99th percentile queueing delay. If counts
+  is a list, the processor counts returned by runOne() are appended to it, one
+  entry per config (None for configs without --plan). Contexts are independent
+  and ctypes releases the GIL, so configs may run in parallel threads.
+  """
+  data = np.empty((len(configs), SIM_RESULT_CNT), dtype=np.float64)
+  if (workers <= 1):
+    found = [runOne(config.toCommand(), data[i]) for i, config in enumerate(configs)]
+  else:
+    with ThreadPoolExecutor(max_workers=workers) as pool:
+      found = list(pool.map(lambda i: runOne(configs[i].toCommand(), data[i]), range(len(configs))))
+  if (counts is not None):
+    counts.extend(found)
+  return data
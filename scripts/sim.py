@@ -5,6 +5,7 @@ import subprocess
 import matplotlib.pyplot as plt
 import numpy as np
 from typing import *
+import mss
 
 class Config:
   """A config object
@@ -14,12 +15,23 @@ class Config:
     self,
     policy: str = None,
     iteration: int = None,
-    processorCnt: int = None,
+    processorCnt: Union[int, List[int]] = None,
     jobTypeCnt: int = None,
     arrivalRate: List[List[int]] = None,
     serverNeeds: List[int] = None,
     regionCnt: int = None,
-    serviceTime: List[List[int]] = None
+    serviceTime: List[List[int]] = None,
+    sampleCnt: int = None,
+    localityWeighted: bool = False,
+    approx: str = None,
+    profile: str = None,
+    service: str = None,
+    topology: str = None,
+    plan: str = None,
+    seed: int = None,
+    cache: str = None,
+    resources: List[str] = None,
+    packing: str = None
     ):
     self.policy = policy
     self.iteration = iteration
@@ -42,32 +54,71 @@ class Config:
     self.arrivalRate = arrivalRate
     self.serverNeeds = serverNeeds
     if (not (
-      ((regionCnt is not None) and (serviceTime is not None)) or
-      ((regionCnt is None) and (serviceTime is None))
+      ((regionCnt is not None) and ((serviceTime is not None) != (topology is not None))) or
+      ((regionCnt is None) and (serviceTime is None) and (topology is None))
     )):
-      raise Exception("serviceTime should be set together with regionCnt")
+      raise Exception("Either serviceTime or topology should be set together with regionCnt")
     elif (serviceTime is not None):
       serviceTime = [x for row in serviceTime for x in row]
       if (len(serviceTime) != (regionCnt*regionCnt)):
         raise Exception("serviceTime should be of shape (regionCnt,regionCnt)")
     self.regionCnt = regionCnt
     self.serviceTime = serviceTime
+    self.sampleCnt = sampleCnt
+    self.localityWeighted = localityWeighted
+    self.approx = approx
+    self.profile = profile
+    self.service = service
+    self.topology = topology
+    self.plan = plan
+    # Processor counts found by plan, set by runSim()
+    self.plannedProcessorCnt = None
+    self.seed = seed
+    self.cache = cache
+    self.resources = resources
+    self.packing = packing
 
   def toCommand(self) -> str:
     opts = ""
-    if (self.processorCnt is not None):
-      opts += " -n %d" % self.processorCnt
     if (self.policy is not None):
       opts += " -p %s" % self.policy
     if (self.iteration is not None):
       opts += " -t %d" % self.iteration
-    if (self.regionCnt is not None):
+    if (self.topology is not None):
+      opts += " -r %d --topology %s" % (self.regionCnt, self.topology)
+    elif (self.regionCnt is not None):
       serviceTime = ",".join([str(x) for x in self.serviceTime])
       opts += " -r %d -a %s" % (self.regionCnt, serviceTime)
+    # After -r, which resets processor counts to one per region
+    if (isinstance(self.processorCnt, list)):
+      opts += " -n %s" % ",".join([str(x) for x in self.processorCnt])
+    elif (self.processorCnt is not None):
+      opts += " -n %d" % self.processorCnt
     if (self.jobTypeCnt is not None):
       arrivalRate = ",".join([str(x) for x in self.arrivalRate])
       serverNeeds = ",".join([str(x) for x in self.serverNeeds])
       opts += " -j %d -l %s -s %s" % (self.jobTypeCnt, arrivalRate, serverNeeds)
+    if (self.sampleCnt is not None):
+      opts += " -d %d" % self.sampleCnt
+    if (self.localityWeighted):
+      opts += " -w"
+    if (self.profile is not None):
+      opts += " --profile %s" % self.profile
+    if (self.service is not None):
+      opts += " --service %s" % self.service
+    if (self.approx is not None):
+      opts += " --approx %s" % self.approx
+    if (self.plan is not None):
+      opts += " --plan %s" % self.plan
+    if (self.seed is not None):
+      opts += " -e %d" % self.seed
+    if (self.cache is not None):
+      opts += " --cache %s" % self.cache
+    if (self.resources is not None):
+      for resource in self.resources:
+        opts += " --resource %s" % resource
+    if (self.packing is not None):
+      opts += " --packing %s" % self.packing
     return opts
 
 def plot(
@@ -91,7 +142,17 @@ def plot(
 
 def runSim(configs: List[Config]) -> List[float]:
   """Run a list of configs and return a list of results
+  Uses libmss.so in process when it is built (`make lib`), otherwise spawns the
+  executable for each config. For a config with plan, the results are those of
+  the processor counts found, which are stored in its plannedProcessorCnt.
   """
+  if (mss.available()):
+    print("Running %d configs with %s" % (len(configs), mss.libraryPath))
+    counts = []
+    data = mss.run(configs, counts=counts)
+    for config, procCnt in zip(configs, counts):
+      config.plannedProcessorCnt = procCnt
+    return data
   executableFilePath = os.path.abspath(os.path.join(os.path.dirname(__file__), os.pardir, "sim"))
   if (not os.path.isfile(executableFilePath)):
     raise Exception("Executable file not found")
@@ -105,10 +166,15 @@ def runSim(configs: List[Config]) -> List[float]:
     if (process.returncode != 0):
       raise Exception("Error executing command `%s`" % command)
     else:
-      data.append([float(x) for x in output.split()])
+      lines = output.split()
+      if (config.plan is not None):
+        # Processor counts are printed on the line before the results
+        config.plannedProcessorCnt = [int(x) for x in lines[0].split(",")]
+        lines = lines[1:]
+      data.append([float(x) for x in lines])
   return data
 
-policies = ["fcfsLocal", "fcfsCross", "fcfsCrossPart", "o3CrossPart", "jsq", "jsqPart", "jsqMaxweight"]
+policies = ["fcfsLocal", "fcfsCross", "fcfsCrossPart", "o3CrossPart", "jsq", "jsqPart", "jsqMaxweight", "jsqD", "jsqDPart", "jsqBatch", "jsqBatchPart", "jsqMaxweightCross", "backfill", "backfillCross"]
 
 def test1():
   # NOTE When choosing parameters, always choose carefully and start from
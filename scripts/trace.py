@@ -0,0 +1,85 @@
+"""Decode traces written by ./sim --trace (built with make TRACE=1)
+See inc/trace.h for the format.
+
+  python3 scripts/trace.py t.bin                 print a summary
+  python3 scripts/trace.py t.bin --dump          print all events
+  python3 scripts/trace.py t.bin --job 7         print events of traced job 7
+  python3 scripts/trace.py t.bin --kind cross    print cross-region assignments
+"""
+import argparse
+import struct
+import sys
+from typing import *
+
+HEADER = struct.Struct('<8sIIIIQ')
+EVENT = struct.Struct('<IIIIBBH')
+KINDS = ['arrive', 'enqueue', 'cross', 'start', 'finish']
+
+def readTrace(path: str) -> Tuple[Dict[str, int], List[Tuple[int, ...]]]:
+  """Return the header as a dict and the events as tuples of
+  (timestamp, jobId, region, value, kind, jobType)
+  """
+  with open(path, 'rb') as f:
+    data = f.read()
+  magic, version, sample, regionCnt, jobTypeCnt, seed = HEADER.unpack_from(data, 0)
+  if (magic != b'MSSTRACE'):
+    raise Exception(f"{path} is not a trace")
+  if (version != 1):
+    raise Exception(f"Unsupported trace version {version}")
+  header = {
+    'sample': sample,
+    'regionCnt': regionCnt,
+    'jobTypeCnt': jobTypeCnt,
+    'seed': seed
+  }
+  events = [event[:6] for event in EVENT.iter_unpack(data[HEADER.size:])]
+  return header, events
+
+def formatEvent(event: Tuple[int, ...]) -> str:
+  timestamp, jobId, region, value, kind, jobType = event
+  return f"{timestamp:>10} job {jobId:<8} type {jobType:<3} {KINDS[kind]:<8} region {region:<6} {value}"
+
+def summarize(header: Dict[str, int], events: List[Tuple[int, ...]]) -> None:
+  regionCnt = header['regionCnt']
+  print(f"seed {header['seed']}, one arrival in {header['sample']} traced, {len(events)} events")
+  counts = [0]*len(KINDS)
+  for event in events:
+    counts[event[4]] += 1
+  for kind, count in zip(KINDS, counts):
+    print(f"  {kind:<8} {count}")
+  # Cross-region assignments, job region to server region
+  origin = {}
+  cross = {}
+  waits = []
+  for timestamp, jobId, region, value, kind, jobType in events:
+    if (kind == 0):
+      origin[jobId] = region
+    elif (kind == 2):
+      key = (origin.get(jobId, regionCnt), region)
+      cross[key] = cross.get(key, 0) + 1
+    elif (kind == 3):
+      waits.append(value)
+  if (waits):
+    print(f"mean wait of started jobs {sum(waits)/len(waits):.6f} time units")
+  if (cross):
+    print("cross-region assignments (job region -> server region)")
+    for (o, s), count in sorted(cross.items(), key=lambda item: -item[1]):
+      print(f"  {o:>6} -> {s:<6} {count}")
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(description="Decode a binary trace of ./sim --trace")
+  parser.add_argument('path')
+  parser.add_argument('--dump', action='store_true', help="print all events")
+  parser.add_argument('--job', type=int, help="print events of one traced job")
+  parser.add_argument('--kind', choices=KINDS, help="print events of one kind")
+  args = parser.parse_args()
+  header, events = readTrace(args.path)
+  if ((not args.dump) and (args.job is None) and (args.kind is None)):
+    summarize(header, events)
+    sys.exit(0)
+  for event in events:
+    if ((args.job is not None) and (event[1] != args.job)):
+      continue
+    if ((args.kind is not None) and (KINDS[event[4]] != args.kind)):
+      continue
+    print(formatEvent(event))
@@ -0,0 +1,158 @@
+#include "backfill.h"
+
+static inline void siftUp(Release* heap, uint32_t k) {
+	Release item = heap[k];
+	while (k > 0) {
+		uint32_t parent = (k-1)/2;
+		if (heap[parent].freeAt <= item.freeAt) break;
+		heap[k] = heap[parent];
+		k = parent;
+	}
+	heap[k] = item;
+}
+
+static inline void siftDown(Release* heap, uint32_t k, uint32_t size) {
+	Release item = heap[k];
+	while (2*k+1 < size) {
+		uint32_t child = 2*k+1;
+		if ((child+1 < size) && (heap[child+1].freeAt < heap[child].freeAt)) {
+			child ++;
+		}
+		if (item.freeAt <= heap[child].freeAt) break;
+		heap[k] = heap[child];
+		k = child;
+	}
+	heap[k] = item;
+}
+
+Backfill* newBackfill(SimContext* ctx) {
+	uint32_t R = ctx->regionCnt;
+	Backfill* bf = (Backfill*)malloc(sizeof(Backfill));
+	bf->regionCnt = R;
+	bf->clock = 0;
+	bf->releases = (Release**)calloc(R, sizeof(Release*));
+	bf->releaseCnt = (uint32_t*)calloc(R, sizeof(uint32_t));
+	bf->releaseSize = (uint32_t*)calloc(R, sizeof(uint32_t));
+	bf->shadow = (uint32_t*)malloc(R*sizeof(uint32_t));
+	bf->extra = (uint32_t*)calloc(R, sizeof(uint32_t));
+	bf->visit = NULL;
+	bf->visitSize = 0;
+	for (uint32_t s = 0; s < R; s ++) {
+		bf->shadow[s] = BACKFILL_NONE;
+	}
+	return bf;
+}
+
+void freeBackfill(Backfill* bf) {
+	for (uint32_t s = 0; s < bf->regionCnt; s ++) {
+		free(bf->releases[s]);
+	}
+	free(bf->releases);
+	free(bf->releaseCnt);
+	free(bf->releaseSize);
+	free(bf->shadow);
+	free(bf->extra);
+	free(bf->visit);
+	free(bf);
+}
+
+void tickBackfill(Backfill* bf) {
+	bf->clock ++;
+	for (uint32_t s = 0; s < bf->regionCnt; s ++) {
+		// Same jobs serveJobs() released at the end of the last time unit
+		Release* heap = bf->releases[s];
+		while ((bf->releaseCnt[s] > 0) && (heap[0].freeAt <= bf->clock)) {
+			uint32_t size = -- bf->releaseCnt[s];
+			if (size > 0) {
+				heap[0] = heap[size];
+				siftDown(heap, 0, size);
+			}
+		}
+		bf->shadow[s] = BACKFILL_NONE;
+		bf->extra[s] = 0;
+	}
+}
+
+void startBackfill(SimContext* ctx, Backfill* bf, Server* server, Job* job) {
+	uint32_t s = server->region;
+	uint32_t need = ctx->serverNeeds[job->jobType];
+	uint32_t freeAt = backfillFreeAt(ctx, bf, server, job);
+	if ((bf->shadow[s] != BACKFILL_NONE) && (freeAt > bf->shadow[s])) {
+		bf->extra[s] -= need;
+	}
+	assignJobToServer(ctx, server, job);
+	if (bf->releaseCnt[s] == bf->releaseSize[s]) {
+		bf->releaseSize[s] = (bf->releaseSize[s] == 0) ? INIT_JOB_BUFFER_SIZE : (bf->releaseSize[s] << 1);
+		bf->releases[s] = (Release*)realloc(bf->releases[s], bf->releaseSize[s]*sizeof(Release));
+	}
+	uint32_t k = bf->releaseCnt[s] ++;
+	bf->releases[s][k].freeAt = freeAt;
+	bf->releases[s][k].need = need;
+	siftUp(bf->releases[s], k);
+}
+
+/**
+* Push heap position k into the visit heap of size *size, ordered by the
+* freeAt of the release it points to
+*/
+static inline void pushVisit(const Release* heap, uint32_t* visit, uint32_t* size, uint32_t k) {
+	uint32_t i = (*size) ++;
+	while (i > 0) {
+		uint32_t parent = (i-1)/2;
+		if (heap[visit[parent]].freeAt <= heap[k].freeAt) break;
+		visit[i] = visit[parent];
+		i = parent;
+	}
+	visit[i] = k;
+}
+
+static inline uint32_t popVisit(const Release* heap, uint32_t* visit, uint32_t* size) {
+	uint32_t top = visit[0];
+	uint32_t n = -- (*size);
+	if (n == 0) return top;
+	uint32_t item = visit[n];
+	uint32_t i = 0;
+	while (2*i+1 < n) {
+		uint32_t child = 2*i+1;
+		if ((child+1 < n) && (heap[visit[child+1]].freeAt < heap[visit[child]].freeAt)) {
+			child ++;
+		}
+		if (heap[item].freeAt <= heap[visit[child]].freeAt) break;
+		visit[i] = visit[child];
+		i = child;
+	}
+	visit[i] = item;
+	return top;
+}
+
+void reserveBackfill(Backfill* bf, Server* server, uint32_t need) {
+	uint32_t s = server->region;
+	const Release* heap = bf->releases[s];
+	uint32_t cnt = bf->releaseCnt[s];
+	// Every visited release adds at most 2 children
+	if (bf->visitSize < cnt+1) {
+		bf->visitSize = cnt+1;
+		bf->visit = (uint32_t*)realloc(bf->visit, bf->visitSize*sizeof(uint32_t));
+	}
+	uint32_t visitCnt = 0;
+	if (cnt > 0) {
+		pushVisit(heap, bf->visit, &visitCnt, 0);
+	}
+	// Release processors in time order until the head fits, then add the
+	// processors released in the same time unit to extra
+	uint32_t idle = server->idleCnt;
+	uint32_t shadow = BACKFILL_NONE;
+	while (visitCnt > 0) {
+		uint32_t k = popVisit(heap, bf->visit, &visitCnt);
+		if ((shadow != BACKFILL_NONE) && (heap[k].freeAt > shadow)) break;
+		idle += heap[k].need;
+		if ((shadow == BACKFILL_NONE) && (idle >= need)) {
+			shadow = heap[k].freeAt;
+		}
+		if (2*k+1 < cnt) pushVisit(heap, bf->visit, &visitCnt, 2*k+1);
+		if (2*k+2 < cnt) pushVisit(heap, bf->visit, &visitCnt, 2*k+2);
+	}
+	// A head larger than the server never starts, it reserves nothing
+	bf->shadow[s] = shadow;
+	bf->extra[s] = (shadow == BACKFILL_NONE) ? 0 : idle-need;
+}
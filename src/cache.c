@@ -0,0 +1,484 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "simulation.h"
+#include "server.h"
+
+// Checksum of the sources, set by the Makefile
+#ifndef MSS_BUILD_ID
+#define MSS_BUILD_ID 0
+#endif
+
+// 64 bit FNV-1a
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+	const uint8_t* byte = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i ++) {
+		hash = (hash^byte[i])*FNV_PRIME;
+	}
+	return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const char* s) {
+	return hashBytes(hash, s, strlen(s)+1);
+}
+
+/**
+* Hash the contents and size of the file at path
+* A NULL path hashes as size UINT64_MAX, an unreadable file as its path.
+*/
+static uint64_t hashFile(uint64_t hash, const char* path) {
+	uint64_t size = UINT64_MAX;
+	if (path == NULL) {
+		return hashBytes(hash, &size, sizeof(size));
+	}
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return hashString(hash, path);
+	}
+	uint8_t buffer[4096];
+	size_t n;
+	size = 0;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		hash = hashBytes(hash, buffer, n);
+		size += n;
+	}
+	fclose(file);
+	return hashBytes(hash, &size, sizeof(size));
+}
+
+/**
+* Key of the run of ctx, without the time units for its state
+*/
+static uint64_t cacheKey(SimContext* ctx, uint8_t withTime) {
+	uint32_t R = ctx->regionCnt;
+	uint32_t J = ctx->jobTypeCnt;
+	uint32_t format = CACHE_FORMAT;
+	uint64_t buildId = (uint64_t)MSS_BUILD_ID;
+	uint8_t policyId = getPolicyId(ctx->policy);
+	uint8_t control = ((ctx->varianceMode & VR_CONTROL) != 0);
+	uint64_t hash = FNV_OFFSET;
+	hash = hashBytes(hash, &format, sizeof(format));
+	hash = hashBytes(hash, &buildId, sizeof(buildId));
+	hash = hashString(hash, gsl_rng_default->name);
+	hash = hashBytes(hash, &policyId, sizeof(policyId));
+	hash = hashBytes(hash, &R, sizeof(R));
+	hash = hashBytes(hash, &J, sizeof(J));
+	hash = hashBytes(hash, ctx->procCnt, R*sizeof(uint32_t));
+	hash = hashBytes(hash, ctx->arrivalRate, R*J*sizeof(double));
+	hash = hashBytes(hash, ctx->serverNeeds, J*sizeof(uint32_t));
+	if (ctx->topologyPath != NULL) {
+		hash = hashFile(hash, ctx->topologyPath);
+	} else {
+		hash = hashBytes(hash, ctx->meanServiceTime, R*R*sizeof(uint32_t));
+	}
+	hash = hashFile(hash, ctx->profilePath);
+	hash = hashFile(hash, ctx->servicePath);
+	hash = hashBytes(hash, &ctx->sampleCnt, sizeof(ctx->sampleCnt));
+	hash = hashBytes(hash, &ctx->localityWeighted, sizeof(ctx->localityWeighted));
+	hash = hashBytes(hash, &ctx->resourceCnt, sizeof(ctx->resourceCnt));
+	if (ctx->resourceCnt > 1) {
+		hash = hashBytes(hash, ctx->resourceCapacity, (ctx->resourceCnt-1)*R*sizeof(uint32_t));
+		hash = hashBytes(hash, ctx->resourceDemand, (ctx->resourceCnt-1)*J*sizeof(uint32_t));
+	}
+	hash = hashBytes(hash, &ctx->packing, sizeof(ctx->packing));
+	hash = hashBytes(hash, &ctx->seed, sizeof(ctx->seed));
+	hash = hashBytes(hash, &ctx->threadCnt, sizeof(ctx->threadCnt));
+	hash = hashBytes(hash, &ctx->antithetic, sizeof(ctx->antithetic));
+	hash = hashBytes(hash, &control, sizeof(control));
+	if (withTime) {
+		hash = hashBytes(hash, &ctx->simulationTime, sizeof(ctx->simulationTime));
+	}
+	return hash;
+}
+
+/**
+* Path of the entry of key in the cache directory, needs to be freed
+*/
+static char* entryPath(SimContext* ctx, uint64_t key, const char* suffix) {
+	size_t size = strlen(ctx->cacheDir)+strlen(suffix)+18;
+	char* path = (char*)malloc(size*sizeof(char));
+	snprintf(path, size, "%s/%016lx%s", ctx->cacheDir, key, suffix);
+	return path;
+}
+
+static uint8_t put(FILE* file, const void* data, size_t size) {
+	return (fwrite(data, size, 1, file) == 1);
+}
+
+static uint8_t get(FILE* file, void* data, size_t size) {
+	return (fread(data, size, 1, file) == 1);
+}
+
+static uint8_t putHeader(FILE* file, uint64_t key) {
+	uint32_t magic = CACHE_MAGIC;
+	uint32_t format = CACHE_FORMAT;
+	return put(file, &magic, sizeof(magic)) && put(file, &format, sizeof(format)) && put(file, &key, sizeof(key));
+}
+
+static uint8_t getHeader(FILE* file, uint64_t key) {
+	uint32_t magic, format;
+	uint64_t entryKey;
+	return (
+		get(file, &magic, sizeof(magic)) && (magic == CACHE_MAGIC) &&
+		get(file, &format, sizeof(format)) && (format == CACHE_FORMAT) &&
+		get(file, &entryKey, sizeof(entryKey)) && (entryKey == key)
+	);
+}
+
+/**
+* Open a temporary file next to path, renamed over it by closeEntry()
+*/
+static FILE* openEntry(const char* path, char** tmpPath) {
+	*tmpPath = (char*)malloc((strlen(path)+8)*sizeof(char));
+	sprintf(*tmpPath, "%s.XXXXXX", path);
+	int fd = mkstemp(*tmpPath);
+	// mkstemp() creates the file readable by its owner only
+	FILE* file = ((fd >= 0) && (fchmod(fd, 0644) == 0)) ? fdopen(fd, "wb") : NULL;
+	if (file == NULL) {
+		if (fd >= 0) {
+			close(fd);
+			unlink(*tmpPath);
+		}
+		free(*tmpPath);
+		*tmpPath = NULL;
+	}
+	return file;
+}
+
+/**
+* Flush the temporary file to disk and rename it to path if everything was
+* written (ok), remove it otherwise. Returns whether the entry was written.
+*/
+static uint8_t closeEntry(FILE* file, char* tmpPath, const char* path, uint8_t ok) {
+	ok = ok && (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+	ok = (fclose(file) == 0) && ok;
+	ok = ok && (rename(tmpPath, path) == 0);
+	if (!ok) {
+		unlink(tmpPath);
+	}
+	free(tmpPath);
+	return ok;
+}
+
+uint8_t readCachedResult(SimContext* ctx, double* result) {
+	uint64_t key = cacheKey(ctx, 1);
+	char* path = entryPath(ctx, key, ".res");
+	FILE* file = fopen(path, "rb");
+	uint8_t hit = 0;
+	if (file != NULL) {
+		double entry[SIM_RESULT_CNT];
+		uint64_t offeredWork;
+		double meanOfferedWork;
+		double utilization[RESOURCE_MAX];
+		hit = (
+			getHeader(file, key) &&
+			get(file, entry, sizeof(entry)) &&
+			get(file, &offeredWork, sizeof(offeredWork)) &&
+			get(file, &meanOfferedWork, sizeof(meanOfferedWork)) &&
+			get(file, utilization, sizeof(utilization))
+		);
+		fclose(file);
+		if (hit) {
+			memcpy(result, entry, sizeof(entry));
+			ctx->offeredWork = offeredWork;
+			ctx->meanOfferedWork = meanOfferedWork;
+			memcpy(ctx->utilization, utilization, sizeof(utilization));
+			if (ctx->verbose) {
+				printf("Cached results: %s\n", path);
+			}
+		}
+	}
+	free(path);
+	return hit;
+}
+
+/**
+* Whether the end state of ctx is written to the cache
+*/
+static uint8_t keepsState(SimContext* ctx) {
+	return (ctx->threadCnt == 0) && splittable(getPolicyId(ctx->policy));
+}
+
+static uint8_t putJob(FILE* file, Job* job) {
+	return (
+		put(file, &job->jobType, sizeof(job->jobType)) &&
+		put(file, &job->region, sizeof(job->region)) &&
+		put(file, &job->timeToFinish, sizeof(job->timeToFinish)) &&
+		put(file, &job->waitTime, sizeof(job->waitTime))
+	);
+}
+
+static Job* getJob(FILE* file, SimContext* ctx) {
+	Job* job = (Job*)malloc(sizeof(Job));
+#ifdef MSS_TRACE
+	job->traceId = 0;
+#endif
+	uint8_t ok = (
+		get(file, &job->jobType, sizeof(job->jobType)) && (job->jobType < ctx->jobTypeCnt) &&
+		get(file, &job->region, sizeof(job->region)) && (job->region < ctx->regionCnt) &&
+		get(file, &job->timeToFinish, sizeof(job->timeToFinish)) &&
+		get(file, &job->waitTime, sizeof(job->waitTime))
+	);
+	if (!ok) {
+		free(job);
+		return NULL;
+	}
+	return job;
+}
+
+/**
+* Size, virtual size and jobs from head to tail
+*/
+static uint8_t putQueue(FILE* file, Queue* q) {
+	uint8_t ok = put(file, &q->size, sizeof(q->size)) && put(file, &q->virtualSize, sizeof(q->virtualSize));
+	for (Node* node = q->head; ok && (node != NULL); node = node->next) {
+		ok = putJob(file, node->job);
+	}
+	return ok;
+}
+
+static uint8_t getQueue(FILE* file, SimContext* ctx, Queue* q) {
+	uint32_t size, virtualSize;
+	if (!get(file, &size, sizeof(size)) || !get(file, &virtualSize, sizeof(virtualSize))) {
+		return 0;
+	}
+	for (uint32_t i = 0; i < size; i ++) {
+		Job* job = getJob(file, ctx);
+		if (job == NULL) return 0;
+		pushQueue(q, job);
+	}
+	q->virtualSize = virtualSize;
+	return 1;
+}
+
+static uint8_t putServer(FILE* file, Server* server) {
+	uint8_t ok = (
+		put(file, server->idle, sizeof(server->idle)) &&
+		put(file, server->busy, sizeof(server->busy)) &&
+		put(file, &server->departedJobCnt, sizeof(server->departedJobCnt)) &&
+		put(file, &server->departedJobDelay, sizeof(server->departedJobDelay)) &&
+		putQueue(file, server->waitingQueue) &&
+		put(file, &server->jobBuffer.jobCnt, sizeof(server->jobBuffer.jobCnt))
+	);
+	for (uint32_t i = 0; ok && (i < server->jobBuffer.jobCnt); i ++) {
+		ok = putJob(file, server->jobBuffer.jobs[i]);
+	}
+	return ok;
+}
+
+/**
+* Idle amounts of every resource, none above its capacity
+*/
+static uint8_t getIdle(FILE* file, Server* server) {
+	if (!get(file, server->idle, sizeof(server->idle))) return 0;
+	for (uint8_t k = 0; k < RESOURCE_MAX; k ++) {
+		if (server->idle[k] > server->capacity[k]) return 0;
+	}
+	return 1;
+}
+
+static uint8_t getServer(FILE* file, SimContext* ctx, Server* server) {
+	uint32_t jobCnt;
+	uint8_t ok = (
+		getIdle(file, server) &&
+		get(file, server->busy, sizeof(server->busy)) &&
+		get(file, &server->departedJobCnt, sizeof(server->departedJobCnt)) &&
+		get(file, &server->departedJobDelay, sizeof(server->departedJobDelay)) &&
+		getQueue(file, ctx, server->waitingQueue) &&
+		get(file, &jobCnt, sizeof(jobCnt)) && (jobCnt <= server->processorCnt)
+	);
+	if (!ok) return 0;
+	JobBuffer* buffer = &server->jobBuffer;
+	if (jobCnt > buffer->size) {
+		buffer->jobs = (Job**)realloc(buffer->jobs, jobCnt*sizeof(Job*));
+		buffer->size = jobCnt;
+	}
+	for (uint32_t i = 0; i < jobCnt; i ++) {
+		Job* job = getJob(file, ctx);
+		if (job == NULL) return 0;
+		buffer->jobs[buffer->jobCnt ++] = job;
+	}
+	return 1;
+}
+
+/**
+* Counters of a run saved with its state
+*/
+typedef struct CacheCounters {
+	uint32_t timestamp;
+	double queueLengthSum;
+	uint64_t offeredWork;
+	double meanOfferedWork;
+	uint64_t arrivalCnt;
+	uint32_t antitheticTick;
+} CacheCounters;
+
+static uint8_t putCounters(FILE* file, CacheCounters* c) {
+	return (
+		put(file, &c->timestamp, sizeof(c->timestamp)) &&
+		put(file, &c->queueLengthSum, sizeof(c->queueLengthSum)) &&
+		put(file, &c->offeredWork, sizeof(c->offeredWork)) &&
+		put(file, &c->meanOfferedWork, sizeof(c->meanOfferedWork)) &&
+		put(file, &c->arrivalCnt, sizeof(c->arrivalCnt)) &&
+		put(file, &c->antitheticTick, sizeof(c->antitheticTick))
+	);
+}
+
+static uint8_t getCounters(FILE* file, CacheCounters* c) {
+	return (
+		get(file, &c->timestamp, sizeof(c->timestamp)) &&
+		get(file, &c->queueLengthSum, sizeof(c->queueLengthSum)) &&
+		get(file, &c->offeredWork, sizeof(c->offeredWork)) &&
+		get(file, &c->meanOfferedWork, sizeof(c->meanOfferedWork)) &&
+		get(file, &c->arrivalCnt, sizeof(c->arrivalCnt)) &&
+		get(file, &c->antitheticTick, sizeof(c->antitheticTick))
+	);
+}
+
+/**
+* Rng, delay histogram (non-zero buckets), servers and common queue
+*/
+static uint8_t putState(FILE* file, SimContext* ctx) {
+	uint8_t ok = (gsl_rng_fwrite(file, ctx->rng) == 0);
+	uint32_t bucketCnt = 0;
+	for (uint32_t d = 0; d < DELAY_HISTOGRAM_SIZE; d ++) {
+		bucketCnt += (ctx->delayHistogram[d] > 0);
+	}
+	ok = ok && put(file, &bucketCnt, sizeof(bucketCnt));
+	for (uint32_t d = 0; ok && (d < DELAY_HISTOGRAM_SIZE); d ++) {
+		if (ctx->delayHistogram[d] == 0) continue;
+		ok = put(file, &d, sizeof(d)) && put(file, &ctx->delayHistogram[d], sizeof(uint32_t));
+	}
+	for (uint32_t i = 0; ok && (i < ctx->regionCnt); i ++) {
+		ok = putServer(file, ctx->servers[i]);
+	}
+	if (ok && (ctx->commonQueue != NULL)) {
+		ok = putQueue(file, ctx->commonQueue);
+	}
+	return ok;
+}
+
+static uint8_t getState(FILE* file, SimContext* ctx) {
+	uint32_t bucketCnt;
+	uint8_t ok = (
+		(gsl_rng_fread(file, ctx->rng) == 0) &&
+		get(file, &bucketCnt, sizeof(bucketCnt)) && (bucketCnt <= DELAY_HISTOGRAM_SIZE)
+	);
+	for (uint32_t k = 0; ok && (k < bucketCnt); k ++) {
+		uint32_t d;
+		ok = get(file, &d, sizeof(d)) && (d < DELAY_HISTOGRAM_SIZE) && get(file, &ctx->delayHistogram[d], sizeof(uint32_t));
+	}
+	for (uint32_t i = 0; ok && (i < ctx->regionCnt); i ++) {
+		ok = getServer(file, ctx, ctx->servers[i]);
+	}
+	if (ok && (ctx->commonQueue != NULL)) {
+		ok = getQueue(file, ctx, ctx->commonQueue);
+	}
+	return ok;
+}
+
+/**
+* Put servers, common queue, delay histogram and rng back as runSimulation()
+* set them up, after a state was read in part
+*/
+static void resetState(SimContext* ctx) {
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		freeServer(ctx->servers[i]);
+		ctx->servers[i] = newServer(i, ctx->procCnt[i]);
+		initServerResources(ctx, ctx->servers[i]);
+	}
+	if (ctx->commonQueue != NULL) {
+		freeQueue(ctx->commonQueue);
+		ctx->commonQueue = newQueue();
+	}
+	memset(ctx->delayHistogram, 0, DELAY_HISTOGRAM_SIZE*sizeof(uint32_t));
+	gsl_rng_set(ctx->rng, (unsigned long)ctx->seed);
+}
+
+uint32_t resumeCachedState(SimContext* ctx, double* queueLengthSum) {
+	if (!keepsState(ctx)) return 0;
+	uint64_t key = cacheKey(ctx, 0);
+	char* path = entryPath(ctx, key, ".state");
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		free(path);
+		return 0;
+	}
+	CacheCounters c;
+	uint8_t ok = getHeader(file, key) && getCounters(file, &c) && (c.timestamp < ctx->simulationTime);
+	if (ok) {
+		ok = getState(file, ctx);
+		if (!ok) {
+			resetState(ctx);
+		}
+	}
+	fclose(file);
+	if (ok) {
+		*queueLengthSum += c.queueLengthSum;
+		ctx->offeredWork = c.offeredWork;
+		ctx->meanOfferedWork = c.meanOfferedWork;
+		ctx->arrivalCnt = c.arrivalCnt;
+		ctx->antitheticTick = c.antitheticTick;
+		if (ctx->verbose) {
+			printf("Resumed from time unit %d of %s\n", c.timestamp, path);
+		}
+	}
+	free(path);
+	return ok ? c.timestamp : 0;
+}
+
+/**
+* Time units of the state cached at path, 0 if none
+*/
+static uint32_t cachedTimestamp(const char* path, uint64_t key) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) return 0;
+	CacheCounters c;
+	uint8_t ok = getHeader(file, key) && getCounters(file, &c);
+	fclose(file);
+	return ok ? c.timestamp : 0;
+}
+
+void writeCache(SimContext* ctx, const double* result, uint32_t timestamp, double queueLengthSum) {
+	// Created if missing, errors show up when opening entries
+	mkdir(ctx->cacheDir, 0777);
+	uint64_t key = cacheKey(ctx, 1);
+	char* path = entryPath(ctx, key, ".res");
+	char* tmpPath;
+	FILE* file = openEntry(path, &tmpPath);
+	uint8_t ok = (file != NULL);
+	if (ok) {
+		ok = closeEntry(file, tmpPath, path, (
+			putHeader(file, key) &&
+			put(file, result, SIM_RESULT_CNT*sizeof(double)) &&
+			put(file, &ctx->offeredWork, sizeof(ctx->offeredWork)) &&
+			put(file, &ctx->meanOfferedWork, sizeof(ctx->meanOfferedWork)) &&
+			put(file, ctx->utilization, RESOURCE_MAX*sizeof(double))
+		));
+	}
+	if (!ok) {
+		fprintf(stderr, "Cannot write cache entry %s\n", path);
+	}
+	free(path);
+	if (!ok || !keepsState(ctx)) return;
+	// Only the state of the longest run is kept
+	key = cacheKey(ctx, 0);
+	path = entryPath(ctx, key, ".state");
+	if (cachedTimestamp(path, key) < timestamp) {
+		CacheCounters c = {timestamp, queueLengthSum, ctx->offeredWork, ctx->meanOfferedWork, ctx->arrivalCnt, ctx->antitheticTick};
+		file = openEntry(path, &tmpPath);
+		ok = (file != NULL);
+		if (ok) {
+			ok = closeEntry(file, tmpPath, path, putHeader(file, key) && putCounters(file, &c) && putState(file, ctx));
+		}
+		if (!ok) {
+			fprintf(stderr, "Cannot write cache entry %s\n", path);
+		}
+	}
+	free(path);
+}
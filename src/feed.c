@@ -0,0 +1,200 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "feed.h"
+#include "kernel.h"
+
+// Poll interval of openFeed() while the producer has not created the feed
+#define FEED_OPEN_POLL_NS 10000000
+
+// Waits yielding the processor before sleeping FEED_IDLE_NS between polls, so
+// that an idle side (e.g. behind a paced producer) does not take a core
+#define FEED_SPIN_CNT 64
+#define FEED_IDLE_NS 50000
+
+static Feed* newFeed(const char* name, FeedHeader* header, size_t mapSize, uint8_t producer) {
+	Feed* feed = (Feed*)malloc(sizeof(Feed));
+	feed->name = (char*)malloc((strlen(name)+1)*sizeof(char));
+	strcpy(feed->name, name);
+	feed->header = header;
+	feed->ring = (FeedArrival*)(header+1);
+	feed->mapSize = mapSize;
+	feed->mask = header->capacity-1;
+	feed->producer = producer;
+	feed->head = 0;
+	feed->limit = 0;
+	feed->done = 0;
+	feed->arrivalCnt = 0;
+	feed->skippedCnt = 0;
+	return feed;
+}
+
+Feed* createFeed(const char* name, uint32_t capacity, uint32_t regionCnt, uint8_t jobTypeCnt) {
+	if ((capacity == 0) || ((capacity & (capacity-1)) != 0)) {
+		fprintf(stderr, "Feed capacity %d is not a power of 2\n", capacity);
+		return NULL;
+	}
+	shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	size_t mapSize = sizeof(FeedHeader)+(size_t)capacity*sizeof(FeedArrival);
+	if ((fd < 0) || (ftruncate(fd, (off_t)mapSize) != 0)) {
+		fprintf(stderr, "Cannot create feed %s\n", name);
+		if (fd >= 0) {
+			close(fd);
+			shm_unlink(name);
+		}
+		return NULL;
+	}
+	void* map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map feed %s\n", name);
+		shm_unlink(name);
+		return NULL;
+	}
+	// A new object reads as zeros, counters and ready included
+	FeedHeader* header = (FeedHeader*)map;
+	memcpy(header->magic, "MSSFEED", sizeof(header->magic));
+	header->version = FEED_VERSION;
+	header->capacity = capacity;
+	header->regionCnt = regionCnt;
+	header->jobTypeCnt = jobTypeCnt;
+	atomic_store_explicit(&header->ready, 1, memory_order_release);
+	return newFeed(name, header, mapSize, 1);
+}
+
+/**
+* Map the header of the feed name once its producer has written it, NULL if
+* it does not exist yet
+*/
+static FeedHeader* mapFeed(const char* name, size_t* mapSize) {
+	int fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0) return NULL;
+	struct stat st;
+	void* map = MAP_FAILED;
+	// The size is set by ftruncate() right after creating, it may not be yet
+	if ((fstat(fd, &st) == 0) && ((size_t)st.st_size > sizeof(FeedHeader))) {
+		*mapSize = (size_t)st.st_size;
+		map = mmap(NULL, *mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) return NULL;
+	FeedHeader* header = (FeedHeader*)map;
+	if (atomic_load_explicit(&header->ready, memory_order_acquire) == 0) {
+		munmap(map, *mapSize);
+		return NULL;
+	}
+	return header;
+}
+
+Feed* openFeed(SimContext* ctx, const char* name) {
+	struct timespec poll = {0, FEED_OPEN_POLL_NS};
+	size_t mapSize = 0;
+	FeedHeader* header = NULL;
+	for (uint32_t k = 0; k < FEED_OPEN_TIMEOUT*(1000000000/FEED_OPEN_POLL_NS); k ++) {
+		header = mapFeed(name, &mapSize);
+		if (header != NULL) break;
+		nanosleep(&poll, NULL);
+	}
+	if (header == NULL) {
+		fprintf(stderr, "No producer created feed %s within %d seconds\n", name, FEED_OPEN_TIMEOUT);
+		return NULL;
+	}
+	if ((memcmp(header->magic, "MSSFEED", sizeof(header->magic)) != 0) || (header->version != FEED_VERSION) || (mapSize < sizeof(FeedHeader)+(size_t)header->capacity*sizeof(FeedArrival))) {
+		fprintf(stderr, "%s is not a feed of version %d\n", name, FEED_VERSION);
+		munmap(header, mapSize);
+		return NULL;
+	}
+	if ((header->regionCnt != ctx->regionCnt) || (header->jobTypeCnt != ctx->jobTypeCnt)) {
+		fprintf(stderr, "Feed %s has %d regions and %d job types, expected %d and %d\n", name, header->regionCnt, header->jobTypeCnt, ctx->regionCnt, ctx->jobTypeCnt);
+		munmap(header, mapSize);
+		return NULL;
+	}
+	Feed* feed = newFeed(name, header, mapSize, 0);
+	// Resume where a previous consumer stopped
+	feed->head = atomic_load_explicit(&header->tail, memory_order_relaxed);
+	feed->limit = feed->head;
+	return feed;
+}
+
+void closeFeed(Feed* feed) {
+	if (feed->producer) {
+		publishFeed(feed);
+		atomic_store_explicit(&feed->header->closed, 1, memory_order_release);
+		uint32_t waitCnt = 0;
+		while (atomic_load_explicit(&feed->header->tail, memory_order_acquire) != feed->head) {
+			feedWait(feed, waitCnt ++);
+		}
+		shm_unlink(feed->name);
+	}
+	munmap(feed->header, feed->mapSize);
+	free(feed->name);
+	free(feed);
+}
+
+void feedWait(Feed* feed, uint32_t waitCnt) {
+	if (feed->producer) {
+		publishFeed(feed);
+	} else {
+		atomic_store_explicit(&feed->header->tail, feed->head, memory_order_release);
+	}
+	if (waitCnt < FEED_SPIN_CNT) {
+		sched_yield();
+	} else {
+		struct timespec idle = {0, FEED_IDLE_NS};
+		nanosleep(&idle, NULL);
+	}
+}
+
+uint8_t endOfFeed(Feed* feed) {
+	uint32_t waitCnt = 0;
+	while (feed->head == feed->limit) {
+		feed->limit = atomic_load_explicit(&feed->header->head, memory_order_acquire);
+		if (feed->head != feed->limit) break;
+		// closed is set after the last head, look at head once more
+		if (atomic_load_explicit(&feed->header->closed, memory_order_acquire)) {
+			feed->limit = atomic_load_explicit(&feed->header->head, memory_order_acquire);
+			if (feed->head == feed->limit) {
+				feed->done = 1;
+				break;
+			}
+		}
+		feedWait(feed, waitCnt ++);
+	}
+	return feed->done;
+}
+
+void readFeed(SimContext* ctx, Feed* feed, JobBuffer* jobBuffer) {
+	uint32_t jobCnt = 0;
+	while (!endOfFeed(feed)) {
+		const FeedArrival* arrival = &feed->ring[feed->head & feed->mask];
+		feed->head ++;
+		if (arrival->jobType == FEED_TICK) break;
+		if ((arrival->region >= ctx->regionCnt) || (arrival->jobType >= ctx->jobTypeCnt)) {
+			feed->skippedCnt ++;
+			continue;
+		}
+		if (jobCnt == jobBuffer->size) {
+			jobBuffer->size = (jobBuffer->size == 0) ? INIT_JOB_BUFFER_SIZE : (jobBuffer->size << 1);
+			jobBuffer->jobs = (Job**)realloc(jobBuffer->jobs, jobBuffer->size*sizeof(Job*));
+		}
+		Job* job = kernelAllocJob(ctx);
+		job->jobType = arrival->jobType;
+		job->region = arrival->region;
+		job->waitTime = 0;
+		job->timeToFinish = arrival->timeToFinish;
+		jobBuffer->jobs[jobCnt ++] = job;
+	}
+	// Free the slots of the time unit for the producer
+	atomic_store_explicit(&feed->header->tail, feed->head, memory_order_release);
+	feed->arrivalCnt += jobCnt;
+	TRACE_ARRIVALS(ctx, jobBuffer->jobs, jobCnt);
+	jobBuffer->jobCnt = jobCnt;
+}
@@ -0,0 +1,503 @@
+#include "fluid.h"
+
+// Ticks with a settled state before the run is extrapolated
+#define FLUID_SETTLE_TICKS 100
+#define FLUID_EPS 1E-9
+
+/**
+* Fluid state
+* Masses are indexed like the simulator: in service x[(s*R+o)*J+j] for server
+* s serving jobs of type j from origin o, waiting q[(r*R+o)*J+j] in the queue
+* of region r, and cq[o*J+j] in the common queue (jsqMaxweight).
+* @param hold Mean holding time (time units a job occupies its processors) for
+* server s serving a job of type j from origin o, indexed like x
+* @param cap Idle processors of each server
+* @param crossOrder For each origin o, regions in increasing mean service time
+* from o (ties to the lower index), as getBestRegion() picks them
+* @param typeOrder Job types in increasing server needs
+* @param mass Buffer of one mass per job type
+*/
+typedef struct Fluid {
+	uint32_t R;
+	uint32_t J;
+	double* need;
+	double* hold;
+	double* x;
+	double* q;
+	double* cq;
+	double* cap;
+	uint32_t* crossOrder;
+	uint32_t* typeOrder;
+	double* mass;
+} Fluid;
+
+/**
+* A region with its virtual queue size, for water-filling
+*/
+typedef struct FluidLevel {
+	double level;
+	uint32_t region;
+} FluidLevel;
+
+static int compareFluidLevel(const void* a, const void* b) {
+	const FluidLevel* x = (const FluidLevel*)a;
+	const FluidLevel* y = (const FluidLevel*)b;
+	if (x->level != y->level) return (x->level < y->level) ? -1 : 1;
+	return (x->region < y->region) ? -1 : (x->region > y->region);
+}
+
+/**
+* Start waiting mass[j] (from origin o) on server s as far as idle processors
+* allow, leaving the remainder in mass. Only the first typeCnt types start.
+* Types start in proportion to their mix, or in increasing server needs if
+* ordered is set.
+*/
+static void admit(Fluid* f, uint32_t s, uint32_t o, double* mass, uint32_t typeCnt, uint8_t ordered) {
+	double* x = f->x+(s*f->R+o)*f->J;
+	if (ordered) {
+		for (uint32_t k = 0; k < f->J; k ++) {
+			uint32_t j = f->typeOrder[k];
+			if ((j >= typeCnt) || (mass[j] <= 0)) continue;
+			double start = fmin(mass[j], fmax(f->cap[s], 0)/f->need[j]);
+			x[j] += start;
+			mass[j] -= start;
+			f->cap[s] -= start*f->need[j];
+		}
+		return;
+	}
+	double work = 0;
+	for (uint32_t j = 0; j < typeCnt; j ++) {
+		work += f->need[j]*mass[j];
+	}
+	if (work <= 0) return;
+	double frac = fmin(1, fmax(f->cap[s], 0)/work);
+	for (uint32_t j = 0; j < typeCnt; j ++) {
+		x[j] += frac*mass[j];
+		mass[j] -= frac*mass[j];
+	}
+	f->cap[s] -= frac*work;
+}
+
+/**
+* Start mass from origin o locally, then (only the first typeCnt types) on
+* other regions in the order getBestRegion() picks them
+*/
+static void admitCross(Fluid* f, uint32_t o, double* mass, uint32_t typeCnt, uint8_t ordered) {
+	admit(f, o, o, mass, f->J, ordered);
+	for (uint32_t k = 0; k < f->R; k ++) {
+		uint32_t s = f->crossOrder[o*f->R+k];
+		if (s != o) admit(f, s, o, mass, typeCnt, ordered);
+	}
+}
+
+/**
+* Start a queue holding mass[o*J+j] from every origin o on server s, in
+* proportion to its mix
+*/
+static void admitQueue(Fluid* f, uint32_t s, double* mass) {
+	double work = 0;
+	for (uint32_t i = 0; i < f->R*f->J; i ++) {
+		work += f->need[i%f->J]*mass[i];
+	}
+	if (work <= 0) return;
+	double frac = fmin(1, fmax(f->cap[s], 0)/work);
+	for (uint32_t i = 0; i < f->R*f->J; i ++) {
+		f->x[s*f->R*f->J+i] += frac*mass[i];
+		mass[i] -= frac*mass[i];
+	}
+	f->cap[s] -= frac*work;
+}
+
+/**
+* Water-fill mass m of type j from origin o over the virtual queue sizes of
+* all regions, where a job adds need*meanServiceTime to the queue it joins.
+* levels holds the virtual size of every region and is kept up to date.
+*/
+static void waterFill(SimContext* ctx, Fluid* f, FluidLevel* levels, uint32_t o, uint32_t j, double m) {
+	uint32_t R = f->R;
+	qsort(levels, R, sizeof(FluidLevel), compareFluidLevel);
+	double sumInv = 0;
+	double sumLevelInv = 0;
+	double level = 0;
+	uint32_t k = 0;
+	for (; k < R; k ++) {
+		double cost = f->need[j]*getMeanServiceTime(ctx, levels[k].region, o);
+		sumInv += 1/cost;
+		sumLevelInv += levels[k].level/cost;
+		level = (m+sumLevelInv)/sumInv;
+		if ((k+1 == R) || (level <= levels[k+1].level)) break;
+	}
+	for (uint32_t i = 0; i <= k && i < R; i ++) {
+		uint32_t r = levels[i].region;
+		double cost = f->need[j]*getMeanServiceTime(ctx, r, o);
+		f->q[(r*R+o)*f->J+j] += (level-levels[i].level)/cost;
+		levels[i].level = level;
+	}
+}
+
+static void fluidFcfs(SimContext* ctx, Fluid* f, uint8_t policyId) {
+	uint32_t R = f->R;
+	uint32_t J = f->J;
+	uint8_t ordered = (policyId == POLICY_O3_CROSS_PART);
+	uint32_t typeCnt = (policyId == POLICY_FCFS_CROSS) ? J : 1;
+	// Waiting mass first, then arrivals, as in the simulator
+	for (uint32_t r = 0; r < R; r ++) {
+		double* waiting = f->q+(r*R+r)*J;
+		if (policyId == POLICY_FCFS_LOCAL) {
+			admit(f, r, r, waiting, J, 0);
+		} else {
+			admitCross(f, r, waiting, typeCnt, ordered);
+		}
+	}
+	for (uint32_t o = 0; o < R; o ++) {
+		for (uint32_t j = 0; j < J; j ++) {
+			f->mass[j] = ctx->rate[o*J+j];
+		}
+		if (policyId == POLICY_FCFS_LOCAL) {
+			admit(f, o, o, f->mass, J, 0);
+		} else {
+			admitCross(f, o, f->mass, typeCnt, ordered);
+		}
+		for (uint32_t j = 0; j < J; j ++) {
+			f->q[(o*R+o)*J+j] += f->mass[j];
+		}
+	}
+}
+
+static void fluidJsq(SimContext* ctx, Fluid* f, FluidLevel* levels, uint8_t partial) {
+	uint32_t R = f->R;
+	uint32_t J = f->J;
+	for (uint32_t r = 0; r < R; r ++) {
+		levels[r].region = r;
+		levels[r].level = 0;
+		for (uint32_t o = 0; o < R; o ++) {
+			for (uint32_t j = 0; j < J; j ++) {
+				levels[r].level += f->q[(r*R+o)*J+j]*f->need[j]*getMeanServiceTime(ctx, r, o);
+			}
+		}
+	}
+	// Route arrivals in (origin, type) groups, as jsqBatch does
+	for (uint32_t o = 0; o < R; o ++) {
+		for (uint32_t j = 0; j < J; j ++) {
+			double m = ctx->rate[o*J+j];
+			if (m <= 0) continue;
+			if (partial && (j != 0)) {
+				f->q[(o*R+o)*J+j] += m;
+				for (uint32_t i = 0; i < R; i ++) {
+					if (levels[i].region == o) {
+						levels[i].level += m*f->need[j]*getMeanServiceTime(ctx, o, o);
+					}
+				}
+			} else {
+				waterFill(ctx, f, levels, o, j, m);
+			}
+		}
+	}
+	// Serve virtual queues
+	for (uint32_t r = 0; r < R; r ++) {
+		admitQueue(f, r, f->q+r*R*J);
+	}
+}
+
+static void fluidMaxweight(SimContext* ctx, Fluid* f) {
+	uint32_t R = f->R;
+	uint32_t J = f->J;
+	double commonSize = 0;
+	for (uint32_t i = 0; i < R*J; i ++) {
+		commonSize += f->cq[i];
+	}
+	// Join the shorter of the local and common queue (ties to local)
+	for (uint32_t o = 0; o < R; o ++) {
+		double localSize = 0;
+		double m = 0;
+		for (uint32_t j = 0; j < J; j ++) {
+			localSize += f->q[(o*R+o)*J+j];
+			m += ctx->rate[o*J+j];
+		}
+		if (m <= 0) continue;
+		double toLocal;
+		if (localSize <= commonSize) {
+			double gap = fmin(m, commonSize-localSize);
+			toLocal = gap+(m-gap)/2;
+		} else {
+			double gap = fmin(m, localSize-commonSize);
+			toLocal = (m-gap)/2;
+		}
+		for (uint32_t j = 0; j < J; j ++) {
+			double a = ctx->rate[o*J+j];
+			f->q[(o*R+o)*J+j] += a*toLocal/m;
+			f->cq[o*J+j] += a*(m-toLocal)/m;
+		}
+		commonSize += m-toLocal;
+	}
+	// MaxWeight, weights are queue size over mean service time of the head
+	for (uint32_t s = 0; s < R; s ++) {
+		double localSize = 0;
+		double commonServiceTime = 0;
+		for (uint32_t j = 0; j < J; j ++) {
+			localSize += f->q[(s*R+s)*J+j];
+		}
+		commonSize = 0;
+		for (uint32_t o = 0; o < R; o ++) {
+			for (uint32_t j = 0; j < J; j ++) {
+				commonSize += f->cq[o*J+j];
+				commonServiceTime += f->cq[o*J+j]*getMeanServiceTime(ctx, s, o);
+			}
+		}
+		double localWeight = localSize/getMeanServiceTime(ctx, s, s);
+		double commonWeight = (commonSize > 0) ? commonSize*commonSize/commonServiceTime : 0;
+		if (localWeight >= commonWeight) {
+			admit(f, s, s, f->q+(s*R+s)*J, J, 0);
+			admitQueue(f, s, f->cq);
+		} else {
+			admitQueue(f, s, f->cq);
+			admit(f, s, s, f->q+(s*R+s)*J, J, 0);
+		}
+	}
+}
+
+/**
+* Start the queues Q(s, o) of every server s in decreasing weight, size over
+* mean service time. levels is used as a buffer.
+*/
+static void startMaxweight(SimContext* ctx, Fluid* f, FluidLevel* levels) {
+	uint32_t R = f->R;
+	uint32_t J = f->J;
+	for (uint32_t s = 0; s < R; s ++) {
+		for (uint32_t o = 0; o < R; o ++) {
+			levels[o].region = o;
+			levels[o].level = 0;
+			for (uint32_t j = 0; j < J; j ++) {
+				levels[o].level -= f->q[(s*R+o)*J+j];
+			}
+			levels[o].level /= getMeanServiceTime(ctx, s, o);
+		}
+		qsort(levels, R, sizeof(FluidLevel), compareFluidLevel);
+		for (uint32_t k = 0; (k < R) && (levels[k].level < 0); k ++) {
+			uint32_t o = levels[k].region;
+			admit(f, s, o, f->q+(s*R+o)*J, J, 0);
+		}
+	}
+}
+
+static void fluidMaxweightCross(SimContext* ctx, Fluid* f, FluidLevel* levels) {
+	uint32_t R = f->R;
+	uint32_t J = f->J;
+	startMaxweight(ctx, f, levels);
+	// Arrivals start locally if they can, the rest is water-filled over the
+	// waiting workloads
+	for (uint32_t r = 0; r < R; r ++) {
+		levels[r].region = r;
+		levels[r].level = 0;
+		for (uint32_t o = 0; o < R; o ++) {
+			for (uint32_t j = 0; j < J; j ++) {
+				levels[r].level += f->q[(r*R+o)*J+j]*f->need[j]*getMeanServiceTime(ctx, r, o);
+			}
+		}
+	}
+	for (uint32_t o = 0; o < R; o ++) {
+		for (uint32_t j = 0; j < J; j ++) {
+			f->mass[j] = ctx->rate[o*J+j];
+		}
+		admit(f, o, o, f->mass, J, 0);
+		for (uint32_t j = 0; j < J; j ++) {
+			if (f->mass[j] > 0) {
+				waterFill(ctx, f, levels, o, j, f->mass[j]);
+			}
+		}
+	}
+	startMaxweight(ctx, f, levels);
+}
+
+void runFluid(SimContext* ctx, double* result) {
+	uint32_t R = ctx->regionCnt;
+	uint32_t J = ctx->jobTypeCnt;
+	uint8_t policyId = getPolicyId(ctx->policy);
+	Fluid f;
+	f.R = R;
+	f.J = J;
+	f.need = (double*)malloc(J*sizeof(double));
+	f.hold = (double*)malloc(R*R*J*sizeof(double));
+	f.x = (double*)calloc(R*R*J, sizeof(double));
+	f.q = (double*)calloc(R*R*J, sizeof(double));
+	f.cq = (double*)calloc(R*J, sizeof(double));
+	f.cap = (double*)malloc(R*sizeof(double));
+	f.crossOrder = (uint32_t*)malloc(R*R*sizeof(uint32_t));
+	f.typeOrder = (uint32_t*)malloc(J*sizeof(uint32_t));
+	f.mass = (double*)malloc(J*sizeof(double));
+	FluidLevel* levels = (FluidLevel*)malloc(R*sizeof(FluidLevel));
+	double* regionQueue = (double*)calloc(R, sizeof(double));
+	double* regionDelta = (double*)calloc(R, sizeof(double));
+	double* regionSum = (double*)calloc(R, sizeof(double));
+
+	for (uint32_t j = 0; j < J; j ++) {
+		f.need[j] = ctx->serverNeeds[j];
+		// Insertion sort, job type count is small
+		uint32_t k = j;
+		while ((k > 0) && (ctx->serverNeeds[f.typeOrder[k-1]] > ctx->serverNeeds[j])) {
+			f.typeOrder[k] = f.typeOrder[k-1];
+			k --;
+		}
+		f.typeOrder[k] = j;
+	}
+	for (uint32_t s = 0; s < R; s ++) {
+		f.cap[s] = ctx->procCnt[s];
+		for (uint32_t o = 0; o < R; o ++) {
+			for (uint32_t j = 0; j < J; j ++) {
+				// A job from o draws floor(X) from its service distribution and
+				// is scaled by the mean service time of s. It holds its processors
+				// for at least the time unit it starts in.
+				double p0, meanFloor;
+				serviceFloorMoments(ctx, o, (uint8_t)j, &p0, &meanFloor);
+				f.hold[(s*R+o)*J+j] = fmax(1, p0+getMeanServiceTime(ctx, s, o)*meanFloor);
+			}
+		}
+	}
+	for (uint32_t o = 0; o < R; o ++) {
+		for (uint32_t r = 0; r < R; r ++) {
+			levels[r].region = r;
+			levels[r].level = getMeanServiceTime(ctx, r, o);
+		}
+		qsort(levels, R, sizeof(FluidLevel), compareFluidLevel);
+		for (uint32_t k = 0; k < R; k ++) {
+			f.crossOrder[o*R+k] = levels[k].region;
+		}
+	}
+
+	if (ctx->verbose) {
+		printf("Start fluid approximation\n");
+	}
+	double sumQueueLength = 0;
+	double prevQueueLength = 0;
+	double prevDelta = 0;
+	double prevInService = 0;
+	uint32_t settled = 0;
+	double sumArrivalRate = 0;
+	double arrivalRate = 0;
+	uint32_t timestamp = 0;
+	initArrivalRate(ctx);
+	for (; timestamp < ctx->simulationTime; timestamp ++) {
+		updateArrivalRate(ctx, timestamp);
+		arrivalRate = 0;
+		for (uint32_t i = 0; i < R*J; i ++) {
+			arrivalRate += ctx->rate[i];
+		}
+		sumArrivalRate += arrivalRate;
+		switch (policyId) {
+			case POLICY_FCFS_LOCAL:
+			case POLICY_FCFS_CROSS:
+			case POLICY_FCFS_CROSS_PART:
+			case POLICY_O3_CROSS_PART:
+				fluidFcfs(ctx, &f, policyId);
+				break;
+			case POLICY_BACKFILL:
+				fluidFcfs(ctx, &f, POLICY_FCFS_LOCAL);
+				break;
+			case POLICY_BACKFILL_CROSS:
+				fluidFcfs(ctx, &f, POLICY_FCFS_CROSS);
+				break;
+			case POLICY_JSQ:
+			case POLICY_JSQ_D:
+			case POLICY_JSQ_BATCH:
+				fluidJsq(ctx, &f, levels, 0);
+				break;
+			case POLICY_JSQ_PART:
+			case POLICY_JSQ_D_PART:
+			case POLICY_JSQ_BATCH_PART:
+				fluidJsq(ctx, &f, levels, 1);
+				break;
+			case POLICY_JSQ_MAXWEIGHT:
+				fluidMaxweight(ctx, &f);
+				break;
+			case POLICY_JSQ_MAXWEIGHT_CROSS:
+				fluidMaxweightCross(ctx, &f, levels);
+				break;
+			default:
+				break;
+		}
+		// Departures
+		double inService = 0;
+		for (uint32_t s = 0; s < R; s ++) {
+			for (uint32_t o = 0; o < R; o ++) {
+				for (uint32_t j = 0; j < J; j ++) {
+					double* x = f.x+(s*R+o)*J+j;
+					double departed = *x/f.hold[(s*R+o)*J+j];
+					*x -= departed;
+					f.cap[s] += departed*f.need[j];
+					inService += *x;
+				}
+			}
+		}
+		// Record queue lengths
+		double queueLength = 0;
+		for (uint32_t r = 0; r < R; r ++) {
+			double length = 0;
+			for (uint32_t i = 0; i < R*J; i ++) {
+				length += f.q[r*R*J+i];
+			}
+			regionDelta[r] = length-regionQueue[r];
+			regionQueue[r] = length;
+			regionSum[r] += length;
+			queueLength += length;
+		}
+		for (uint32_t i = 0; i < R*J; i ++) {
+			queueLength += f.cq[i];
+		}
+		sumQueueLength += queueLength;
+		// Settled once the mass in service is constant and queues are constant
+		// or grow linearly. Never settled under a time-varying profile.
+		double delta = queueLength-prevQueueLength;
+		double eps = FLUID_EPS*(1+queueLength+inService);
+		if (
+			(ctx->profile == NULL) &&
+			(fabs(inService-prevInService) < eps) &&
+			(fabs(delta-prevDelta) < eps)
+		) {
+			settled ++;
+		} else {
+			settled = 0;
+		}
+		prevQueueLength = queueLength;
+		prevDelta = delta;
+		prevInService = inService;
+		if (settled >= FLUID_SETTLE_TICKS) {
+			timestamp ++;
+			break;
+		}
+	}
+	// Extrapolate the remaining time units
+	double remaining = (double)(ctx->simulationTime-timestamp);
+	sumQueueLength += remaining*prevQueueLength+prevDelta*remaining*(remaining+1)/2;
+	sumArrivalRate += remaining*arrivalRate;
+	for (uint32_t r = 0; r < R; r ++) {
+		regionSum[r] += remaining*regionQueue[r]+regionDelta[r]*remaining*(remaining+1)/2;
+	}
+	double simulationTime = (ctx->simulationTime > 0) ? ctx->simulationTime : 1;
+	if (ctx->verbose) {
+		printf("Settled after %d/%d time units\n", timestamp, ctx->simulationTime);
+		for (uint32_t r = 0; r < R; r ++) {
+			printf("Region %d expected queue length: %lf\n", r, regionSum[r]/simulationTime);
+		}
+		printf("Stop fluid approximation\n");
+	}
+	double expectedQueueLength = sumQueueLength/simulationTime;
+	result[0] = expectedQueueLength/((policyId == POLICY_JSQ_MAXWEIGHT) ? (R+1) : R);
+	result[1] = (sumArrivalRate > 0) ? sumQueueLength/sumArrivalRate : 0;
+	// Fluid masses carry no delay distribution
+	result[2] = NAN;
+	freeArrivalRate(ctx);
+
+	free(f.need);
+	free(f.hold);
+	free(f.x);
+	free(f.q);
+	free(f.cq);
+	free(f.cap);
+	free(f.crossOrder);
+	free(f.typeOrder);
+	free(f.mass);
+	free(levels);
+	free(regionQueue);
+	free(regionDelta);
+	free(regionSum);
+}
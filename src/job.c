@@ -1,38 +1,12 @@
 #include "job.h"
+#include "kernel.h"
 
 // A value that is helpful when queue grows large.
 const uint32_t INIT_JOB_BUFFER_SIZE = 16;
 
-JobBuffer newJobs() {
-	uint32_t jobCnt = 0;
-	Job** jobs = (Job**)malloc(jobCnt);
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
-		for (uint8_t j = 0; j < JOB_TYPE_CNT; j ++) {
-			uint32_t arrivingCnt = gsl_ran_poisson(RNG, ARRIVAL_RATE[JOB_TYPE_CNT*i+j]);
-			jobs = (Job**)realloc(jobs, (jobCnt+arrivingCnt)*sizeof(Job*));
-			for (uint32_t k = 0; k < arrivingCnt; k ++) {
-				Job* job = (Job*)malloc(sizeof(Job));
-				job->jobType = j;
-				job->region = i;
-				job->waitTime = 0;
-				uint32_t mean = MEAN_SERVICE_TIME[job->region*REGION_CNT+job->region];
-				uint32_t serviceTime = (uint32_t)floor(gsl_ran_exponential(RNG, mean));
-				job->timeToFinish = serviceTime;
-				jobs[jobCnt+k] = job;
-			}
-			jobCnt += arrivingCnt;
-		}
-	}
-	// Shuffle the jobs (closer to reality)
-  // Only shuffle if jobs is not empty
-  if (jobCnt > 0) {
-    gsl_ran_shuffle(RNG, jobs, jobCnt, sizeof(Job*));
-  }
-
-	JobBuffer jobBuffer;
-	jobBuffer.jobs = jobs;
-	jobBuffer.jobCnt = jobCnt;
-	jobBuffer.size = jobCnt;
+JobBuffer newJobs(SimContext* ctx) {
+	JobBuffer jobBuffer = {NULL, 0, 0};
+	kernelNewJobs(ctx, &jobBuffer);
 	return jobBuffer;
 }
 
@@ -43,6 +17,16 @@ void freeJobBuffer(JobBuffer jobBuffer) {
 	free(jobBuffer.jobs);
 }
 
+void freeJobPool(SimContext* ctx) {
+	for (uint32_t i = 0; i < ctx->jobPoolCnt; i ++) {
+		free(ctx->jobPool[i]);
+	}
+	free(ctx->jobPool);
+	ctx->jobPool = NULL;
+	ctx->jobPoolCnt = 0;
+	ctx->jobPoolSize = 0;
+}
+
 void printJob(Job* job) {
 	printf("job from region %d, type %d, time to finish %d\n", job->region, job->jobType, job->timeToFinish);
 }
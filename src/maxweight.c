@@ -0,0 +1,148 @@
+#include "maxweight.h"
+
+/**
+* Whether region a comes before b counting from region from (cyclic)
+* Breaking ties this way gives every server its own order, so that ties of all
+* servers do not land on the lowest region.
+*/
+static inline uint8_t cyclicBefore(uint32_t R, uint32_t from, uint32_t a, uint32_t b) {
+	return ((a+R-from)%R) < ((b+R-from)%R);
+}
+
+/**
+* Whether Q(s, a) has a larger weight than Q(s, b), both non-empty
+*/
+static inline uint8_t serveBefore(const Maxweight* mw, uint32_t s, uint32_t a, uint32_t b) {
+	uint32_t R = mw->regionCnt;
+	uint64_t timeA = mw->serviceTime[s*R+a];
+	uint64_t timeB = mw->serviceTime[s*R+b];
+	// sizeA/timeA > sizeB/timeB
+	uint64_t x = mw->queues[s*R+a]->size*timeB;
+	uint64_t y = mw->queues[s*R+b]->size*timeA;
+	if (x != y) return x > y;
+	if (timeA != timeB) return timeA < timeB;
+	return cyclicBefore(R, s, a, b);
+}
+
+static inline void siftUp(const Maxweight* mw, uint32_t* heap, uint32_t* pos, uint32_t s, uint32_t k) {
+	uint32_t item = heap[k];
+	while (k > 0) {
+		uint32_t parent = (k-1)/2;
+		if (!serveBefore(mw, s, item, heap[parent])) break;
+		heap[k] = heap[parent];
+		pos[heap[k]] = k;
+		k = parent;
+	}
+	heap[k] = item;
+	pos[item] = k;
+}
+
+static inline void siftDown(const Maxweight* mw, uint32_t* heap, uint32_t* pos, uint32_t s, uint32_t k, uint32_t size) {
+	uint32_t item = heap[k];
+	while (2*k+1 < size) {
+		uint32_t child = 2*k+1;
+		if ((child+1 < size) && serveBefore(mw, s, heap[child+1], heap[child])) {
+			child ++;
+		}
+		if (!serveBefore(mw, s, heap[child], item)) break;
+		heap[k] = heap[child];
+		pos[heap[k]] = k;
+		k = child;
+	}
+	heap[k] = item;
+	pos[item] = k;
+}
+
+Maxweight* newMaxweight(SimContext* ctx) {
+	uint32_t R = ctx->regionCnt;
+	Maxweight* mw = (Maxweight*)malloc(sizeof(Maxweight));
+	mw->regionCnt = R;
+	mw->queues = (Queue**)calloc((size_t)R*R, sizeof(Queue*));
+	mw->serviceTime = (uint32_t*)malloc((size_t)R*R*sizeof(uint32_t));
+	mw->heap = (uint32_t*)malloc((size_t)R*R*sizeof(uint32_t));
+	mw->heapSize = (uint32_t*)calloc(R, sizeof(uint32_t));
+	mw->pos = (uint32_t*)malloc((size_t)R*R*sizeof(uint32_t));
+	mw->workload = (uint64_t*)calloc(R, sizeof(uint64_t));
+	mw->queueLength = 0;
+	for (uint32_t s = 0; s < R; s ++) {
+		for (uint32_t o = 0; o < R; o ++) {
+			mw->serviceTime[s*R+o] = getMeanServiceTime(ctx, s, o);
+			mw->pos[s*R+o] = MAXWEIGHT_NONE;
+		}
+	}
+	return mw;
+}
+
+void freeMaxweight(Maxweight* mw) {
+	for (size_t i = 0; i < (size_t)mw->regionCnt*mw->regionCnt; i ++) {
+		if (mw->queues[i] != NULL) {
+			freeQueue(mw->queues[i]);
+		}
+	}
+	free(mw->queues);
+	free(mw->serviceTime);
+	free(mw->heap);
+	free(mw->heapSize);
+	free(mw->pos);
+	free(mw->workload);
+	free(mw);
+}
+
+void pushMaxweight(SimContext* ctx, Maxweight* mw, uint32_t server, Job* job) {
+	uint32_t R = mw->regionCnt;
+	uint32_t origin = job->region;
+	Queue** queue = &mw->queues[server*R+origin];
+	if (*queue == NULL) {
+		*queue = newQueue();
+	}
+	pushQueue(*queue, job);
+	TRACE_JOB(ctx, TRACE_ENQUEUE, job, server, (*queue)->size);
+	mw->queueLength ++;
+	mw->workload[server] += (uint64_t)ctx->serverNeeds[job->jobType]*mw->serviceTime[server*R+origin];
+	// Weight of Q(server, origin) rises
+	uint32_t* heap = mw->heap+(size_t)server*R;
+	uint32_t* pos = mw->pos+(size_t)server*R;
+	if (pos[origin] == MAXWEIGHT_NONE) {
+		heap[mw->heapSize[server]] = origin;
+		pos[origin] = mw->heapSize[server] ++;
+	}
+	siftUp(mw, heap, pos, server, pos[origin]);
+}
+
+void popMaxweight(SimContext* ctx, Maxweight* mw, uint32_t server, uint32_t origin) {
+	uint32_t R = mw->regionCnt;
+	Queue* queue = mw->queues[server*R+origin];
+	mw->workload[server] -= (uint64_t)ctx->serverNeeds[queue->head->job->jobType]*mw->serviceTime[server*R+origin];
+	popQueue(queue);
+	mw->queueLength --;
+	// Weight of Q(server, origin) drops, leave the heap once empty
+	uint32_t* heap = mw->heap+(size_t)server*R;
+	uint32_t* pos = mw->pos+(size_t)server*R;
+	uint32_t k = pos[origin];
+	if (queueIsEmpty(queue)) {
+		uint32_t size = -- mw->heapSize[server];
+		pos[origin] = MAXWEIGHT_NONE;
+		if (k < size) {
+			uint32_t moved = heap[size];
+			heap[k] = moved;
+			pos[moved] = k;
+			siftDown(mw, heap, pos, server, k, size);
+			siftUp(mw, heap, pos, server, pos[moved]);
+		}
+	} else {
+		siftDown(mw, heap, pos, server, k, mw->heapSize[server]);
+	}
+}
+
+uint32_t waitMaxweight(Maxweight* mw) {
+	uint32_t R = mw->regionCnt;
+	for (uint32_t s = 0; s < R; s ++) {
+		for (uint32_t k = 0; k < mw->heapSize[s]; k ++) {
+			Queue* queue = mw->queues[s*R+mw->heap[s*R+k]];
+			for (Node* pos = queue->head; pos != NULL; pos = pos->next) {
+				pos->job->waitTime ++;
+			}
+		}
+	}
+	return mw->queueLength;
+}
@@ -0,0 +1,114 @@
+#include <immintrin.h>
+#include <math.h>
+#include "plan.h"
+#include "simulation.h"
+
+/**
+* Run the simulation with the current processor counts, writes the planned
+* metric to metric. Progress output of runSimulation() is silenced. Returns
+* 1 if the run failed.
+*/
+static int evaluate(SimContext* ctx, double* result, uint32_t* evaluationCnt, double* metric) {
+	uint8_t verbose = ctx->verbose;
+	ctx->verbose = 0;
+	int error = runSimulation(ctx, result);
+	ctx->verbose = verbose;
+	if (error) return 1;
+	(*evaluationCnt) ++;
+	*metric = result[ctx->planMetric];
+	if (verbose) {
+		printf("Evaluation %d: ", *evaluationCnt);
+		for (uint32_t r = 0; r < ctx->regionCnt; r ++) {
+			printf("%d ", ctx->procCnt[r]);
+		}
+		printf("-> %lf\n", *metric);
+	}
+	// A run where no job departed has no delay, treat it as missing the target
+	if (isnan(*metric)) *metric = INFINITY;
+	return 0;
+}
+
+/**
+* Offered load of region r in processors, assuming jobs are served locally
+*/
+static uint32_t offeredLoad(SimContext* ctx, uint32_t r) {
+	double load = 0;
+	for (uint8_t j = 0; j < ctx->jobTypeCnt; j ++) {
+		double p0, meanFloor;
+		serviceFloorMoments(ctx, r, j, &p0, &meanFloor);
+		double hold = fmax(1, p0+getMeanServiceTime(ctx, r, r)*meanFloor);
+		load += ctx->arrivalRate[r*ctx->jobTypeCnt+j]*ctx->serverNeeds[j]*hold;
+	}
+	return (uint32_t)ceil(load);
+}
+
+int runPlan(SimContext* ctx, double* result) {
+	// Common random numbers: every evaluation replays the same seed
+	if (!ctx->seeded) {
+		uint32_t seed;
+		_rdrand32_step(&seed);
+		ctx->seed = seed;
+		ctx->seeded = 1;
+	}
+	uint32_t maxNeed = 1;
+	for (uint8_t j = 0; j < ctx->jobTypeCnt; j ++) {
+		if (ctx->serverNeeds[j] > maxNeed) maxNeed = ctx->serverNeeds[j];
+	}
+	for (uint32_t r = 0; r < ctx->regionCnt; r ++) {
+		uint32_t load = offeredLoad(ctx, r);
+		ctx->procCnt[r] = (load > maxNeed) ? load : maxNeed;
+	}
+	uint32_t evaluationCnt = 0;
+	double target = ctx->planTarget;
+	uint32_t round = 0;
+	double metric;
+	if (evaluate(ctx, result, &evaluationCnt, &metric)) return 1;
+	while (metric > target) {
+		if (round == PLAN_MAX_ROUNDS) {
+			fprintf(stderr, "Target %lf not met after %d rounds\n", target, round);
+			return 1;
+		}
+		for (uint32_t r = 0; r < ctx->regionCnt; r ++) {
+			ctx->procCnt[r] += (ctx->procCnt[r] >> 3) + 1;
+		}
+		round ++;
+		if (evaluate(ctx, result, &evaluationCnt, &metric)) return 1;
+	}
+	// Trim regions one by one, largest first
+	uint32_t* order = (uint32_t*)malloc(ctx->regionCnt*sizeof(uint32_t));
+	for (uint32_t r = 0; r < ctx->regionCnt; r ++) {
+		uint32_t i = r;
+		while ((i > 0) && (ctx->procCnt[order[i-1]] < ctx->procCnt[r])) {
+			order[i] = order[i-1];
+			i --;
+		}
+		order[i] = r;
+	}
+	for (uint32_t k = 0; k < ctx->regionCnt; k ++) {
+		uint32_t r = order[k];
+		// Invariant: hi meets the target, lo-1 does not (or is below maxNeed)
+		uint32_t lo = maxNeed;
+		uint32_t hi = ctx->procCnt[r];
+		while (lo < hi) {
+			uint32_t mid = lo+((hi-lo) >> 1);
+			ctx->procCnt[r] = mid;
+			if (evaluate(ctx, result, &evaluationCnt, &metric)) {
+				free(order);
+				return 1;
+			}
+			if (metric <= target) {
+				hi = mid;
+			} else {
+				lo = mid+1;
+			}
+		}
+		ctx->procCnt[r] = hi;
+	}
+	free(order);
+	// Results of the counts found
+	if (evaluate(ctx, result, &evaluationCnt, &metric)) return 1;
+	if (ctx->verbose) {
+		printf("Plan found after %d evaluations\n", evaluationCnt);
+	}
+	return 0;
+}
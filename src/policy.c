@@ -1,103 +1,247 @@
 /**
 * Write all policies here.
 * Uncomment printf lines to see verbose results, only do this on small
-* simulation iterations. Using gdb is better, but printf is just simple and
-* fast.
+* simulation iterations. To follow routing decisions in long runs, build with
+* make TRACE=1 and use --trace instead (see trace.h).
 */
 #include "policy.h"
 
-void fcfsLocal(Server**);
+#include "kernel.h"
 
-void fcfsCross(Server**);
+void fcfsLocal(SimContext*);
 
-void fcfsCrossPart(Server**);
+void fcfsCross(SimContext*);
 
-void o3CrossPart(Server**);
+void fcfsCrossPart(SimContext*);
 
-void jsq(Server**);
+void o3CrossPart(SimContext*);
 
-void jsqPart(Server**);
+void jsq(SimContext*);
 
-void jsqMaxweight(Server**, Queue*);
+void jsqPart(SimContext*);
 
-uint32_t schedule(Server** servers, const char* policy, Queue* commonQueue) {
+void jsqMaxweight(SimContext*);
+
+void jsqD(SimContext*);
+
+void jsqDPart(SimContext*);
+
+void jsqBatch(SimContext*, uint8_t);
+
+void jsqMaxweightCross(SimContext*);
+
+void backfill(SimContext*, uint8_t);
+
+/**
+* Names of policies indexed by PolicyId
+*/
+static const char* policyNames[POLICY_CNT] = {
+	"fcfsLocal", "fcfsCross", "fcfsCrossPart", "o3CrossPart", "jsq", "jsqPart",
+	"jsqMaxweight", "jsqD", "jsqDPart", "jsqBatch", "jsqBatchPart",
+	"jsqMaxweightCross", "backfill", "backfillCross"
+};
+
+uint8_t getPolicyId(const char* policy) {
+	for (uint8_t i = 0; i < POLICY_CNT; i ++) {
+		if (strcmp(policy, policyNames[i]) == 0) {
+			return i;
+		}
+	}
+	return POLICY_CNT;
+}
+
+void initPolicy(SimContext* ctx) {
+	ctx->commonQueue = NULL;
+	ctx->maxweight = NULL;
+	ctx->backfill = NULL;
+	ctx->localityTables = NULL;
+	ctx->batch = NULL;
+	ctx->policyId = getPolicyId(ctx->policy);
+	if (ctx->policyId == POLICY_JSQ_MAXWEIGHT) {
+		ctx->commonQueue = newQueue();
+	}
+	if (ctx->policyId == POLICY_JSQ_MAXWEIGHT_CROSS) {
+		ctx->maxweight = newMaxweight(ctx);
+	}
+	if ((ctx->policyId == POLICY_BACKFILL) || (ctx->policyId == POLICY_BACKFILL_CROSS)) {
+		ctx->backfill = newBackfill(ctx);
+	}
+	if ((ctx->policyId == POLICY_JSQ_BATCH) || (ctx->policyId == POLICY_JSQ_BATCH_PART)) {
+		uint32_t groupCnt = ctx->regionCnt*ctx->jobTypeCnt;
+		ctx->batch = (JsqBatch*)malloc(sizeof(JsqBatch));
+		ctx->batch->groupStart = (uint32_t*)malloc((groupCnt+1)*sizeof(uint32_t));
+		ctx->batch->groupFill = (uint32_t*)malloc(groupCnt*sizeof(uint32_t));
+		ctx->batch->grouped = NULL;
+		ctx->batch->groupedSize = 0;
+		ctx->batch->ranks = (RegionLevel*)malloc(ctx->regionCnt*sizeof(RegionLevel));
+		ctx->batch->tmp = (RegionLevel*)malloc(ctx->regionCnt*sizeof(RegionLevel));
+	}
+	uint8_t sampling = (
+		(ctx->policyId == POLICY_JSQ_D) ||
+		(ctx->policyId == POLICY_JSQ_D_PART) ||
+		(ctx->policyId == POLICY_JSQ_MAXWEIGHT_CROSS)
+	);
+	if (sampling && ctx->localityWeighted && (ctx->topology == NULL)) {
+		// Walker alias tables, so that each sample is O(1) regardless of
+		// regionCnt
+		ctx->localityTables = (gsl_ran_discrete_t**)malloc(ctx->regionCnt*sizeof(gsl_ran_discrete_t*));
+		double* weights = (double*)malloc(ctx->regionCnt*sizeof(double));
+		for (uint32_t j = 0; j < ctx->regionCnt; j ++) {
+			for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+				weights[i] = 1.0/getMeanServiceTime(ctx, i, j);
+			}
+			ctx->localityTables[j] = gsl_ran_discrete_preproc(ctx->regionCnt, weights);
+		}
+		free(weights);
+	}
+	ctx->arrivals = (JobBuffer*)calloc(1, sizeof(JobBuffer));
+}
+
+void freePolicy(SimContext* ctx) {
+	if (ctx->commonQueue != NULL) {
+		freeQueue(ctx->commonQueue);
+		ctx->commonQueue = NULL;
+	}
+	if (ctx->maxweight != NULL) {
+		freeMaxweight(ctx->maxweight);
+		ctx->maxweight = NULL;
+	}
+	if (ctx->backfill != NULL) {
+		freeBackfill(ctx->backfill);
+		ctx->backfill = NULL;
+	}
+	if (ctx->batch != NULL) {
+		free(ctx->batch->groupStart);
+		free(ctx->batch->groupFill);
+		free(ctx->batch->grouped);
+		free(ctx->batch->ranks);
+		free(ctx->batch->tmp);
+		free(ctx->batch);
+		ctx->batch = NULL;
+	}
+	if (ctx->localityTables != NULL) {
+		for (uint32_t j = 0; j < ctx->regionCnt; j ++) {
+			gsl_ran_discrete_free(ctx->localityTables[j]);
+		}
+		free(ctx->localityTables);
+		ctx->localityTables = NULL;
+	}
+	if (ctx->arrivals != NULL) {
+		// Jobs in the buffer are already owned by servers or queues
+		free(ctx->arrivals->jobs);
+		free(ctx->arrivals);
+		ctx->arrivals = NULL;
+	}
+}
+
+uint32_t schedule(SimContext* ctx) {
 	uint32_t sumQueueLength = 0;
-	if (strcmp(policy, "fcfsLocal") == 0) {
-		fcfsLocal(servers);
-	} else if (strcmp(policy, "fcfsCross") == 0) {
-		fcfsCross(servers);
-	} else if (strcmp(policy, "fcfsCrossPart") == 0) {
-		fcfsCrossPart(servers);
-	} else if (strcmp(policy, "o3CrossPart") == 0) {
-		o3CrossPart(servers);
-	} else if (strcmp(policy, "jsq") == 0) {
-		jsq(servers);
-	} else if (strcmp(policy, "jsqPart") == 0) {
-		jsqPart(servers);
-	} else if (strcmp(policy, "jsqMaxweight") == 0) {
-		jsqMaxweight(servers, commonQueue);
+	switch (ctx->policyId) {
+		case POLICY_FCFS_LOCAL: fcfsLocal(ctx); break;
+		case POLICY_FCFS_CROSS: fcfsCross(ctx); break;
+		case POLICY_FCFS_CROSS_PART: fcfsCrossPart(ctx); break;
+		case POLICY_O3_CROSS_PART: o3CrossPart(ctx); break;
+		case POLICY_JSQ: jsq(ctx); break;
+		case POLICY_JSQ_PART: jsqPart(ctx); break;
+		case POLICY_JSQ_MAXWEIGHT: jsqMaxweight(ctx); break;
+		case POLICY_JSQ_D: jsqD(ctx); break;
+		case POLICY_JSQ_D_PART: jsqDPart(ctx); break;
+		case POLICY_JSQ_BATCH: jsqBatch(ctx, 0); break;
+		case POLICY_JSQ_BATCH_PART: jsqBatch(ctx, 1); break;
+		case POLICY_JSQ_MAXWEIGHT_CROSS: jsqMaxweightCross(ctx); break;
+		case POLICY_BACKFILL: backfill(ctx, 0); break;
+		case POLICY_BACKFILL_CROSS: backfill(ctx, 1); break;
+		default: break;
 	}
 	// Serve all jobs in the processors for one time unit and record queue length
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
-		Server* server = servers[i];
-		serveJobs(server);
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		Server* server = ctx->servers[i];
+		kernelServeJobs(ctx, server);
 		/* printf("Server %d working, remaining idle %d\n", i, server->idleCnt); */
 		/* printf("Server %d queue length %d\n", i, getQueueSize(server->waitingQueue)); */
 		sumQueueLength += getQueueSize(server->waitingQueue);
 	}
-	if (commonQueue != NULL) {
-		sumQueueLength += getQueueSize(commonQueue);
+	if (ctx->commonQueue != NULL) {
+		sumQueueLength += getQueueSize(ctx->commonQueue);
+	}
+	if (ctx->maxweight != NULL) {
+		sumQueueLength += waitMaxweight(ctx->maxweight);
 	}
 	return sumQueueLength;
 }
 
-void fcfsLocal(Server** servers) {
-	// First check jobs in the waiting queue. This ensures jobs arriving earlier
-	// than the next iteration but in the queue priors to get served.
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
+/**
+* Serve the heads of all (virtual) waiting queues in FCFS order
+* Shared by the jsq family, where jobs are already routed to the queue of the
+* server that serves them.
+*/
+void serveVirtualQueues(SimContext* ctx) {
+	Server** servers = ctx->servers;
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
 		Server* server = servers[i];
-		while (!queueIsEmpty(server->waitingQueue)) {
-			Job* job = server->waitingQueue->head->job;
-			if (canServe(server, job)) {
-				assignJobToServer(server, job);
-				popQueue(server->waitingQueue);
+		Node* pos = server->waitingQueue->head;
+		while (pos != NULL) {
+			Job* job = pos->job;
+			Node* next = pos->next;
+			if (kernelCanServe(ctx, server, job)) {
+				kernelAssignJob(ctx, server, job);
+				kernelRemoveQueueVirtual(ctx, server, pos);
 			} else {
-				// Block the queue if head cannot be served
+				// Block the queue
 				break;
 			}
+			pos = next;
 		}
 	}
-	// Create random new jobs
-	JobBuffer jobBuffer = newJobs();
-	for (uint32_t i = 0; i < jobBuffer.jobCnt; i ++) {
-		Job* job = jobBuffer.jobs[i];
-		// Only serve the job locally
-		Server* server = servers[job->region];
-		if (canServe(server, job)) {
-			assignJobToServer(server, job);
-		} else {
-			pushQueue(server->waitingQueue, job);
+}
+
+/**
+* Get the remote region the job fits on with the best packing score (ties to
+* the smaller mean service time, then the lower index), -1 if none
+*/
+static int packBestRegion(SimContext* ctx, Job* job) {
+	Server** servers = ctx->servers;
+	int bestRegion = -1;
+	double bestScore = 0;
+	uint32_t minServiceTime = UINT32_MAX;
+	for (uint32_t j = 0; j < ctx->regionCnt; j ++) {
+		Server* server = servers[j];
+		if (!kernelCanServe(ctx, server, job)) continue;
+		double score = kernelPackScore(ctx, server, job);
+		uint32_t serviceTime = kernelServiceTime(ctx, server->region, job->region);
+		if (
+			(bestRegion == -1) ||
+			(score > bestScore) ||
+			((score == bestScore) && (serviceTime < minServiceTime))
+		) {
+			bestRegion = (int)server->region;
+			bestScore = score;
+			minServiceTime = serviceTime;
 		}
 	}
-	// OK to free the pointer to new jobs, as all jobs are either pushed into
-	// processors or waiting queue, which will be freed when servers are freed
-	free(jobBuffer.jobs);
+	return bestRegion;
 }
 
 /**
 * Get the best region that can serve the job
-* Check through all servers and find the one that has the smallest mean service
-* time and is idle. If no available servers can be found, return -1.
+* The job's own region if it fits there. Otherwise check through all servers
+* and find the one that has the smallest mean service time and is idle, or the
+* best packing score if ctx->packing is set (see resource.h). If no available
+* servers can be found, return -1.
 */
-int getBestRegion(Server** servers, Job* job) {
+int getBestRegion(SimContext* ctx, Job* job) {
+	Server** servers = ctx->servers;
 	int bestRegion = -1;
-	if (!canServe(servers[job->region], job)) {
+	if (!kernelCanServe(ctx, servers[job->region], job)) {
+		if (ctx->packing != PACK_FASTEST) {
+			return packBestRegion(ctx, job);
+		}
 		uint32_t minServiceTime = UINT32_MAX;
-		for (uint32_t j = 0; j < REGION_CNT; j ++) {
+		for (uint32_t j = 0; j < ctx->regionCnt; j ++) {
 			Server* server = servers[j];
-			uint32_t serviceTime = MEAN_SERVICE_TIME[server->region*REGION_CNT+job->region];
+			uint32_t serviceTime = kernelServiceTime(ctx, server->region, job->region);
 			if (
-				(canServe(server, job)) &&
+				(kernelCanServe(ctx, server, job)) &&
 				(serviceTime < minServiceTime)
 			) {
 				bestRegion = (int)server->region;
@@ -110,17 +254,50 @@ int getBestRegion(Server** servers, Job* job) {
 	return bestRegion;
 }
 
-void fcfsCross(Server** servers) {
+void fcfsLocal(SimContext* ctx) {
+	Server** servers = ctx->servers;
+	// First check jobs in the waiting queue. This ensures jobs arriving earlier
+	// than the next iteration but in the queue priors to get served.
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		Server* server = servers[i];
+		while (!queueIsEmpty(server->waitingQueue)) {
+			Job* job = server->waitingQueue->head->job;
+			if (kernelCanServe(ctx, server, job)) {
+				kernelAssignJob(ctx, server, job);
+				popQueue(server->waitingQueue);
+			} else {
+				// Block the queue if head cannot be served
+				break;
+			}
+		}
+	}
+	// Create random new jobs
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
+		// Only serve the job locally
+		Server* server = servers[job->region];
+		if (kernelCanServe(ctx, server, job)) {
+			kernelAssignJob(ctx, server, job);
+		} else {
+			kernelEnqueue(ctx, server->waitingQueue, server->region, job);
+		}
+	}
+}
+
+void fcfsCross(SimContext* ctx) {
+	Server** servers = ctx->servers;
 	// First check jobs in the waiting queue. This ensures jobs arriving earlier
 	// than the next iteration but in the queue priors to get served.
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
 		Server* server = servers[i];
 		while (!queueIsEmpty(server->waitingQueue)) {
 			Job* job = server->waitingQueue->head->job;
 			// Check the best region that can serve the job
-			int bestRegion = getBestRegion(servers, job);
+			int bestRegion = getBestRegion(ctx, job);
 			if (bestRegion != -1) {
-				assignJobToServer(servers[bestRegion], job);
+				kernelAssignJob(ctx, servers[bestRegion], job);
 				popQueue(server->waitingQueue);
 			} else {
 				// No region available, block the queue
@@ -129,44 +306,43 @@ void fcfsCross(Server** servers) {
 		}
 	}
 	// Create random new jobs
-	JobBuffer jobBuffer = newJobs();
-	for (uint32_t i = 0; i < jobBuffer.jobCnt; i ++) {
-		Job* job = jobBuffer.jobs[i];
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
 		// Also check the best region for new coming jobs
-		int bestRegion = getBestRegion(servers, job);
+		int bestRegion = getBestRegion(ctx, job);
 		if (bestRegion == -1) {
 			// No region available, push into local quueue
-			pushQueue(servers[job->region]->waitingQueue, job);
+			kernelEnqueue(ctx, servers[job->region]->waitingQueue, job->region, job);
 		} else {
-			assignJobToServer(servers[bestRegion], job);
+			kernelAssignJob(ctx, servers[bestRegion], job);
 		}
 	}
-	// OK to free the pointer to new jobs, as all jobs are either pushed into
-	// processors or waiting queue, which will be freed when servers are freed
-	free(jobBuffer.jobs);
 }
 
-void fcfsCrossPart(Server** servers) {
+void fcfsCrossPart(SimContext* ctx) {
+	Server** servers = ctx->servers;
 	// First check jobs in the waiting queue. This ensures jobs arriving earlier
 	// than the next iteration but in the queue priors to get served.
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
 		Server* server = servers[i];
 		while (!queueIsEmpty(server->waitingQueue)) {
 			Job* job = server->waitingQueue->head->job;
 			// Same as fcfsCross, but only cross when small jobs
 			if (job->jobType == 0) {
 				// Small job, check cross region availability
-				int bestRegion = getBestRegion(servers, job);
+				int bestRegion = getBestRegion(ctx, job);
 				if (bestRegion != -1) {
-					assignJobToServer(servers[bestRegion], job);
+					kernelAssignJob(ctx, servers[bestRegion], job);
 					popQueue(server->waitingQueue);
 				} else {
 					break;
 				}
 			} else {
 				// Large jobs, serve locally
-				if (canServe(server, job)) {
-					assignJobToServer(server, job);
+				if (kernelCanServe(ctx, server, job)) {
+					kernelAssignJob(ctx, server, job);
 					popQueue(server->waitingQueue);
 				} else {
 					break;
@@ -175,44 +351,43 @@ void fcfsCrossPart(Server** servers) {
 		}
 	}
 	// Create random new jobs
-	JobBuffer jobBuffer = newJobs();
-	for (uint32_t i = 0; i < jobBuffer.jobCnt; i ++) {
-		Job* job = jobBuffer.jobs[i];
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
 		// Same as fcfsCross, but only cross when small jobs
 		if (job->jobType == 0) {
 			// Small job, check cross region availability
-			int bestRegion = getBestRegion(servers, job);
+			int bestRegion = getBestRegion(ctx, job);
 			if (bestRegion == -1) {
-				pushQueue(servers[job->region]->waitingQueue, job);
+				kernelEnqueue(ctx, servers[job->region]->waitingQueue, job->region, job);
 			} else {
-				assignJobToServer(servers[bestRegion], job);
+				kernelAssignJob(ctx, servers[bestRegion], job);
 			}
 		} else {
 			// Large jobs, serve locally
-			if (canServe(servers[job->region], job)) {
-				assignJobToServer(servers[job->region], job);
+			if (kernelCanServe(ctx, servers[job->region], job)) {
+				kernelAssignJob(ctx, servers[job->region], job);
 			} else {
-				pushQueue(servers[job->region]->waitingQueue, job);
+				kernelEnqueue(ctx, servers[job->region]->waitingQueue, job->region, job);
 			}
 		}
 	}
-	// OK to free the pointer to new jobs, as all jobs are either pushed into
-	// processors or waiting queue, which will be freed when servers are freed
-	free(jobBuffer.jobs);
 }
 
-void o3CrossPart(Server** servers) {
+void o3CrossPart(SimContext* ctx) {
+	Server** servers = ctx->servers;
 	// Check whether all regions are full (cannot serve smallest job)
 	uint8_t allRegionFull = 1;
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
-		if (canServe(servers[i], NULL)) {
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		if (kernelCanServe(ctx, servers[i], NULL)) {
 			allRegionFull = 0;
 			break;
 		}
 	}
 	// Only scan the queue if at least one region is not congested
 	if (!allRegionFull) {
-		for (uint32_t i = 0; i < REGION_CNT; i ++) {
+		for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
 			Server* server = servers[i];
 			// Same as fcfsCrossPart, but iterate through the queue to find all
 			// possible jobs that can be served
@@ -221,14 +396,14 @@ void o3CrossPart(Server** servers) {
 				Job* job = pos->job;
 				Node* next = pos->next;
 				if (job->jobType == 0) {
-					int bestRegion = getBestRegion(servers, job);
+					int bestRegion = getBestRegion(ctx, job);
 					if (bestRegion != -1) {
-						assignJobToServer(servers[bestRegion], job);
+						kernelAssignJob(ctx, servers[bestRegion], job);
 						removeQueue(server->waitingQueue, pos);
 					}
 				} else {
-					if (canServe(server, job)) {
-						assignJobToServer(server, job);
+					if (kernelCanServe(ctx, server, job)) {
+						kernelAssignJob(ctx, server, job);
 						removeQueue(server->waitingQueue, pos);
 					}
 				}
@@ -238,118 +413,89 @@ void o3CrossPart(Server** servers) {
 	}
 	// Create random new jobs
 	// Same as fcfsCrossPart
-	JobBuffer jobBuffer = newJobs();
-	for (uint32_t i = 0; i < jobBuffer.jobCnt; i ++) {
-		Job* job = jobBuffer.jobs[i];
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
 		if (job->jobType == 0) {
-			int bestRegion = getBestRegion(servers, job);
+			int bestRegion = getBestRegion(ctx, job);
 			if (bestRegion == -1) {
-				pushQueue(servers[job->region]->waitingQueue, job);
+				kernelEnqueue(ctx, servers[job->region]->waitingQueue, job->region, job);
 			} else {
-				assignJobToServer(servers[bestRegion], job);
+				kernelAssignJob(ctx, servers[bestRegion], job);
 			}
 		} else {
-			if (canServe(servers[job->region], job)) {
-				assignJobToServer(servers[job->region], job);
+			if (kernelCanServe(ctx, servers[job->region], job)) {
+				kernelAssignJob(ctx, servers[job->region], job);
 			} else {
-				pushQueue(servers[job->region]->waitingQueue, job);
+				kernelEnqueue(ctx, servers[job->region]->waitingQueue, job->region, job);
 			}
 		}
 	}
-	free(jobBuffer.jobs);
 }
 
-void jsq(Server** servers) {
-	// JSQ (virtual queue) routing
-	JobBuffer jobBuffer = newJobs();
-	for (uint32_t i = 0; i < jobBuffer.jobCnt; i ++) {
-		Job* job = jobBuffer.jobs[i];
-		uint32_t shortestVirtualQueueLength = UINT32_MAX;
-		uint32_t shortestVirtualQueueIndex = 0;
-		for (uint32_t j = 0; j < REGION_CNT; j ++) {
-			uint32_t virtualQueueLength = servers[j]->waitingQueue->virtualSize;
-			if (virtualQueueLength < shortestVirtualQueueLength) {
-				shortestVirtualQueueLength = virtualQueueLength;
-				shortestVirtualQueueIndex = j;
-			}
+/**
+* Return the region with the shortest virtual queue (ties to the lowest index)
+*/
+uint32_t shortestRegion(SimContext* ctx) {
+	Server** servers = ctx->servers;
+	uint32_t shortestVirtualQueueLength = UINT32_MAX;
+	uint32_t shortestVirtualQueueIndex = 0;
+	for (uint32_t j = 0; j < ctx->regionCnt; j ++) {
+		uint32_t virtualQueueLength = servers[j]->waitingQueue->virtualSize;
+		if (virtualQueueLength < shortestVirtualQueueLength) {
+			shortestVirtualQueueLength = virtualQueueLength;
+			shortestVirtualQueueIndex = j;
 		}
-		pushQueueVirtual(servers[shortestVirtualQueueIndex], job);
 	}
-	free(jobBuffer.jobs);
-	// Scheduling
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
-		Server* server = servers[i];
-		Node* pos = server->waitingQueue->head;
-		while (pos != NULL) {
-			Job* job = pos->job;
-			Node* next = pos->next;
-			if (canServe(server, job)) {
-				assignJobToServer(server, job);
-				removeQueueVirtual(server, pos);
-			} else {
-				// Block the queue
-				break;
-			}
-			pos = next;
-		}
+	return shortestVirtualQueueIndex;
+}
+
+void jsq(SimContext* ctx) {
+	Server** servers = ctx->servers;
+	// JSQ (virtual queue) routing
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
+		kernelPushQueueVirtual(ctx, servers[shortestRegion(ctx)], job);
 	}
+	serveVirtualQueues(ctx);
 }
 
-void jsqPart(Server** servers) {
+void jsqPart(SimContext* ctx) {
+	Server** servers = ctx->servers;
 	// Same as jsq, but only route small jobs
 	// JSQ (virtual queue) routing
-	JobBuffer jobBuffer = newJobs();
-	for (uint32_t i = 0; i < jobBuffer.jobCnt; i ++) {
-		Job* job = jobBuffer.jobs[i];
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
 		if (job->jobType == 0) {
-			uint32_t shortestVirtualQueueLength = UINT32_MAX;
-			uint32_t shortestVirtualQueueIndex = 0;
-			for (uint32_t j = 0; j < REGION_CNT; j ++) {
-				uint32_t virtualQueueLength = servers[j]->waitingQueue->virtualSize;
-				if (virtualQueueLength < shortestVirtualQueueLength) {
-					shortestVirtualQueueLength = virtualQueueLength;
-					shortestVirtualQueueIndex = j;
-				}
-			}
-			pushQueueVirtual(servers[shortestVirtualQueueIndex], job);
+			kernelPushQueueVirtual(ctx, servers[shortestRegion(ctx)], job);
 		} else {
-			pushQueueVirtual(servers[job->region], job);
-		}
-	}
-	free(jobBuffer.jobs);
-	// Scheduling
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
-		Server* server = servers[i];
-		Node* pos = server->waitingQueue->head;
-		while (pos != NULL) {
-			Job* job = pos->job;
-			Node* next = pos->next;
-			if (canServe(server, job)) {
-				assignJobToServer(server, job);
-				removeQueueVirtual(server, pos);
-			} else {
-				// Block the queue
-				break;
-			}
-			pos = next;
+			kernelPushQueueVirtual(ctx, servers[job->region], job);
 		}
 	}
+	serveVirtualQueues(ctx);
 }
 
-void jsqMaxweight(Server** servers, Queue* commonQueue) {
+void jsqMaxweight(SimContext* ctx) {
+	Server** servers = ctx->servers;
+	Queue* commonQueue = ctx->commonQueue;
 	// JSQ routing
-	JobBuffer jobBuffer = newJobs();
-	for (uint32_t i = 0; i < jobBuffer.jobCnt; i ++) {
-		Job* job = jobBuffer.jobs[i];
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
 		if (getQueueSize(servers[job->region]->waitingQueue) <= getQueueSize(commonQueue)) {
-			pushQueue(servers[job->region]->waitingQueue, job);
+			kernelEnqueue(ctx, servers[job->region]->waitingQueue, job->region, job);
 		} else {
-			pushQueue(commonQueue, job);
+			kernelEnqueue(ctx, commonQueue, ctx->regionCnt, job);
 		}
 	}
-	free(jobBuffer.jobs);
 	// MaxWeight scheduling
-	for (uint32_t i = 0; i < REGION_CNT; i ++) {
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
 		Server* server = servers[i];
 		// Loop through two queues simultaneously
 		while (!(queueIsEmpty(server->waitingQueue) && (queueIsEmpty(commonQueue)))) {
@@ -358,17 +504,17 @@ void jsqMaxweight(Server** servers, Queue* commonQueue) {
 			double localWeight = 0;
 			double commonWeight = 0;
 			if (localHead != NULL) {
-				localWeight = (double)getQueueSize(server->waitingQueue)/MEAN_SERVICE_TIME[server->region*REGION_CNT+localHead->job->region];
+				localWeight = (double)getQueueSize(server->waitingQueue)/kernelServiceTime(ctx, server->region, localHead->job->region);
 			}
 			if (commonHead != NULL) {
-				commonWeight = (double)getQueueSize(commonQueue)/MEAN_SERVICE_TIME[server->region*REGION_CNT+commonHead->job->region];
+				commonWeight = (double)getQueueSize(commonQueue)/kernelServiceTime(ctx, server->region, commonHead->job->region);
 			}
 			// Select the job that has a larger weight
 			uint8_t serveLocalJob = (localWeight >= commonWeight);
 			Job* job = serveLocalJob ? localHead->job : commonHead->job;
 			Queue* queue = serveLocalJob ? server->waitingQueue : commonQueue;
-			if (canServe(server, job)) {
-				assignJobToServer(server, job);
+			if (kernelCanServe(ctx, server, job)) {
+				kernelAssignJob(ctx, server, job);
 				popQueue(queue);
 			} else {
 				// Block the queue
@@ -377,3 +523,402 @@ void jsqMaxweight(Server** servers, Queue* commonQueue) {
 		}
 	}
 }
+
+/**
+* Sample a region for a job from origin, uniformly or weighted by locality (-w)
+*/
+static inline uint32_t sampleRegion(SimContext* ctx, uint32_t origin) {
+	if (ctx->localityTables != NULL) {
+		return (uint32_t)gsl_ran_discrete(ctx->rng, ctx->localityTables[origin]);
+	} else if ((ctx->topology != NULL) && ctx->localityWeighted) {
+		return sampleTopologyRegion(ctx->topology, ctx->rng, origin);
+	}
+	return (uint32_t)gsl_rng_uniform_int(ctx->rng, ctx->regionCnt);
+}
+
+/**
+* Sample ctx->sampleCnt regions (with replacement) and return the one with the
+* shortest virtual queue. Ties are broken by sampling order. Costs O(d) per job
+* instead of O(regionCnt).
+*/
+uint32_t sampleShortestRegion(SimContext* ctx, Job* job) {
+	Server** servers = ctx->servers;
+	uint32_t shortestVirtualQueueLength = UINT32_MAX;
+	uint32_t shortestVirtualQueueIndex = job->region;
+	for (uint32_t k = 0; k < ctx->sampleCnt; k ++) {
+		uint32_t j = sampleRegion(ctx, job->region);
+		uint32_t virtualQueueLength = servers[j]->waitingQueue->virtualSize;
+		if (virtualQueueLength < shortestVirtualQueueLength) {
+			shortestVirtualQueueLength = virtualQueueLength;
+			shortestVirtualQueueIndex = j;
+		}
+	}
+	return shortestVirtualQueueIndex;
+}
+
+void jsqD(SimContext* ctx) {
+	Server** servers = ctx->servers;
+	// Power of d choices routing
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
+		kernelPushQueueVirtual(ctx, servers[sampleShortestRegion(ctx, job)], job);
+	}
+	serveVirtualQueues(ctx);
+}
+
+void jsqDPart(SimContext* ctx) {
+	Server** servers = ctx->servers;
+	// Same as jsqD, but only route small jobs
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
+		if (job->jobType == 0) {
+			kernelPushQueueVirtual(ctx, servers[sampleShortestRegion(ctx, job)], job);
+		} else {
+			kernelPushQueueVirtual(ctx, servers[job->region], job);
+		}
+	}
+	serveVirtualQueues(ctx);
+}
+
+int compareRegionLevel(const void* a, const void* b) {
+	const RegionLevel* x = (const RegionLevel*)a;
+	const RegionLevel* y = (const RegionLevel*)b;
+	if (x->level != y->level) return (x->level < y->level) ? -1 : 1;
+	if (x->region != y->region) return (x->region < y->region) ? -1 : 1;
+	return 0;
+}
+
+int compareRegion(const void* a, const void* b) {
+	uint32_t x = ((const RegionLevel*)a)->region;
+	uint32_t y = ((const RegionLevel*)b)->region;
+	return (x > y) - (x < y);
+}
+
+/**
+* Virtual size a job of jobType from region origin adds to the queue of region
+*/
+uint64_t virtualCost(SimContext* ctx, uint32_t region, uint32_t origin, uint8_t jobType) {
+	return (uint64_t)ctx->serverNeeds[jobType]*getMeanServiceTime(ctx, region, origin);
+}
+
+/**
+* Count slots at or below level, capped at n
+* Region r at virtual size v offers one slot at each of v, v+c, v+2c, ... where
+* c is the virtual cost of the job there. Only the ranked prefix at or below
+* level is visited.
+*/
+uint32_t countSlots(SimContext* ctx, RegionLevel* ranks, uint32_t origin, uint8_t jobType, uint64_t level, uint32_t n) {
+	uint64_t cnt = 0;
+	for (uint32_t k = 0; (k < ctx->regionCnt) && (ranks[k].level <= level); k ++) {
+		uint64_t cost = virtualCost(ctx, ranks[k].region, origin, jobType);
+		if (cost == 0) return n;
+		cnt += (level-ranks[k].level)/cost + 1;
+		if (cnt >= n) return n;
+	}
+	return (uint32_t)cnt;
+}
+
+/**
+* Route n identical (same region and type) jobs in one water-filling pass
+* Sequential jsq sends each job to the region with the lowest (level, region)
+* and raises that level by the job's cost, so the n jobs end up in the n
+* lowest slots. Binary search the water level L holding n slots, fill every
+* slot below L, then hand out the slots exactly at L by region index. Each
+* region gets as many jobs as routing the n jobs one by one would give it
+* (which of the identically distributed jobs goes where may differ). ranks must
+* be sorted and is kept sorted; tmp needs room for regionCnt entries.
+*/
+void waterFill(SimContext* ctx, RegionLevel* ranks, RegionLevel* tmp, Job** jobs, uint32_t n) {
+	Server** servers = ctx->servers;
+	uint32_t origin = jobs[0]->region;
+	uint8_t jobType = jobs[0]->jobType;
+	uint64_t lo = ranks[0].level;
+	uint64_t hi = lo + (n-1)*virtualCost(ctx, ranks[0].region, origin, jobType);
+	while (lo < hi) {
+		uint64_t mid = lo + (hi-lo)/2;
+		if (countSlots(ctx, ranks, origin, jobType, mid, n) >= n) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	uint64_t level = lo;
+	// Fill all slots strictly below the water level, collect ties at the level
+	uint32_t next = 0;
+	uint32_t touched = 0;
+	uint32_t tieCnt = 0;
+	for (; (touched < ctx->regionCnt) && (ranks[touched].level <= level); touched ++) {
+		Server* server = servers[ranks[touched].region];
+		uint64_t cost = virtualCost(ctx, server->region, origin, jobType);
+		// A zero cost region only takes jobs at the level, otherwise level would
+		// not be the lowest one
+		if ((cost == 0) || ((level-ranks[touched].level)%cost == 0)) {
+			tmp[tieCnt++] = ranks[touched];
+		}
+		if ((cost != 0) && (ranks[touched].level < level)) {
+			uint64_t cnt = (level-1-ranks[touched].level)/cost + 1;
+			for (uint64_t k = 0; k < cnt; k ++) {
+				pushQueueVirtual(ctx, server, jobs[next++]);
+			}
+		}
+	}
+	qsort(tmp, tieCnt, sizeof(RegionLevel), compareRegion);
+	for (uint32_t k = 0; (k < tieCnt) && (next < n); k ++) {
+		Server* server = servers[tmp[k].region];
+		if (virtualCost(ctx, server->region, origin, jobType) == 0) {
+			// Sequential jsq keeps picking a region whose level never rises
+			while (next < n) pushQueueVirtual(ctx, server, jobs[next++]);
+		} else {
+			pushQueueVirtual(ctx, server, jobs[next++]);
+		}
+	}
+	// Only the touched prefix changed, sort it and merge it back
+	for (uint32_t k = 0; k < touched; k ++) {
+		tmp[k].region = ranks[k].region;
+		tmp[k].level = servers[ranks[k].region]->waitingQueue->virtualSize;
+	}
+	qsort(tmp, touched, sizeof(RegionLevel), compareRegionLevel);
+	uint32_t a = 0;
+	uint32_t b = touched;
+	uint32_t out = 0;
+	while (a < touched) {
+		if ((b < ctx->regionCnt) && (compareRegionLevel(&ranks[b], &tmp[a]) < 0)) {
+			ranks[out++] = ranks[b++];
+		} else {
+			ranks[out++] = tmp[a++];
+		}
+	}
+}
+
+void jsqBatch(SimContext* ctx, uint8_t partial) {
+	Server** servers = ctx->servers;
+	// Like jsq (or jsqPart if partial), but route the arrivals of a time unit
+	// in batch. Arrivals are grouped by (region, type) and each group of n jobs
+	// is water filled at once in O(regionCnt (log regionCnt + log n)). With G
+	// non-empty groups (at most regionCnt*jobTypeCnt), a time unit costs G times
+	// that instead of O(arrivals*regionCnt), which pays off when groups are
+	// large. Within a group, each region gets as many jobs as jsq would give it.
+	// Groups are routed one after another in (region, type) order though, and
+	// each one sees the queues the previous ones filled, where jsq interleaves
+	// all arrivals in shuffled order. With several groups in a time unit the job
+	// counts per region differ, so this is a policy of its own: with
+	// -l 30,0,30,0, the queue length is about 0.6 against 3.1 for jsq. For
+	// partial, large jobs are also queued before small ones are routed.
+	JsqBatch* batch = ctx->batch;
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	uint32_t groupCnt = ctx->regionCnt*ctx->jobTypeCnt;
+	uint32_t* groupStart = batch->groupStart;
+	memset(groupStart, 0, (groupCnt+1)*sizeof(uint32_t));
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
+		groupStart[job->region*ctx->jobTypeCnt+job->jobType+1] ++;
+	}
+	for (uint32_t g = 0; g < groupCnt; g ++) {
+		groupStart[g+1] += groupStart[g];
+	}
+	if (jobBuffer->jobCnt > batch->groupedSize) {
+		batch->groupedSize = jobBuffer->jobCnt;
+		batch->grouped = (Job**)realloc(batch->grouped, batch->groupedSize*sizeof(Job*));
+	}
+	Job** grouped = batch->grouped;
+	uint32_t* groupFill = batch->groupFill;
+	memcpy(groupFill, groupStart, groupCnt*sizeof(uint32_t));
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
+		if (partial && (job->jobType != 0)) {
+			// Large jobs stay local
+			kernelPushQueueVirtual(ctx, servers[job->region], job);
+		} else {
+			grouped[groupFill[job->region*ctx->jobTypeCnt+job->jobType] ++] = job;
+		}
+	}
+	RegionLevel* ranks = batch->ranks;
+	for (uint32_t j = 0; j < ctx->regionCnt; j ++) {
+		ranks[j].level = servers[j]->waitingQueue->virtualSize;
+		ranks[j].region = j;
+	}
+	qsort(ranks, ctx->regionCnt, sizeof(RegionLevel), compareRegionLevel);
+	for (uint32_t g = 0; g < groupCnt; g ++) {
+		uint32_t n = groupFill[g] - groupStart[g];
+		if (n > 0) {
+			waterFill(ctx, ranks, batch->tmp, grouped+groupStart[g], n);
+		}
+	}
+	serveVirtualQueues(ctx);
+}
+
+/**
+* MaxWeight scheduling of server over its own queues, until the head of the
+* queue with the largest weight cannot be served
+*/
+void serveMaxweight(SimContext* ctx, Server* server) {
+	Maxweight* mw = ctx->maxweight;
+	uint32_t origin = topMaxweight(mw, server->region);
+	while (origin != MAXWEIGHT_NONE) {
+		Job* job = mw->queues[server->region*ctx->regionCnt+origin]->head->job;
+		if (kernelCanServe(ctx, server, job)) {
+			kernelAssignJob(ctx, server, job);
+			popMaxweight(ctx, mw, server->region, origin);
+		} else {
+			// Block the queue
+			break;
+		}
+		origin = topMaxweight(mw, server->region);
+	}
+}
+
+/**
+* Among the job's own region and ctx->sampleCnt sampled ones, return the one
+* with the least waiting workload once the job joins. Ties go to the smaller mean
+* service time, then to the own region and sampling order.
+*/
+uint32_t routeMaxweight(SimContext* ctx, Job* job) {
+	Maxweight* mw = ctx->maxweight;
+	uint32_t bestRegion = job->region;
+	uint64_t bestWorkload = routeWorkload(ctx, mw, bestRegion, job->region, job->jobType);
+	for (uint32_t k = 0; k < ctx->sampleCnt; k ++) {
+		uint32_t j = sampleRegion(ctx, job->region);
+		uint64_t workload = routeWorkload(ctx, mw, j, job->region, job->jobType);
+		if (
+			(workload < bestWorkload) ||
+			(
+				(workload == bestWorkload) &&
+				(getMeanServiceTime(ctx, j, job->region) < getMeanServiceTime(ctx, bestRegion, job->region))
+			)
+		) {
+			bestRegion = j;
+			bestWorkload = workload;
+		}
+	}
+	return bestRegion;
+}
+
+void jsqMaxweightCross(SimContext* ctx) {
+	Server** servers = ctx->servers;
+	Maxweight* mw = ctx->maxweight;
+	// First serve waiting jobs with the processors freed in the last time unit
+	for (uint32_t s = 0; s < ctx->regionCnt; s ++) {
+		serveMaxweight(ctx, servers[s]);
+	}
+	// Join the server with the least workload. It schedules right away, so
+	// routing only sees jobs that really wait.
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
+		Server* server = servers[routeMaxweight(ctx, job)];
+		pushMaxweight(ctx, mw, server->region, job);
+		serveMaxweight(ctx, server);
+	}
+}
+
+/**
+* Start the heads of the queue of server in FCFS order while they fit, then
+* reserve the time unit the blocked head starts at
+*/
+static void startHeads(SimContext* ctx, Backfill* bf, Server* server) {
+	Queue* queue = server->waitingQueue;
+	bf->shadow[server->region] = BACKFILL_NONE;
+	bf->extra[server->region] = 0;
+	while (!queueIsEmpty(queue)) {
+		Job* job = queue->head->job;
+		if (!kernelCanServe(ctx, server, job)) {
+			reserveBackfill(bf, server, ctx->serverNeeds[job->jobType]);
+			break;
+		}
+		startBackfill(ctx, bf, server, job);
+		popQueue(queue);
+	}
+}
+
+/**
+* Return the server job can start on without delaying its reservation, NULL if
+* none. As getBestRegion, the job's own region goes first, then the smallest
+* mean service time.
+*/
+static Server* backfillServer(SimContext* ctx, Backfill* bf, Job* job, uint8_t cross) {
+	Server* local = ctx->servers[job->region];
+	if (canBackfill(ctx, bf, local, job)) return local;
+	if (!cross) return NULL;
+	Server* bestServer = NULL;
+	uint32_t minServiceTime = UINT32_MAX;
+	for (uint32_t j = 0; j < ctx->regionCnt; j ++) {
+		Server* server = ctx->servers[j];
+		uint32_t serviceTime = getMeanServiceTime(ctx, j, job->region);
+		if ((serviceTime < minServiceTime) && canBackfill(ctx, bf, server, job)) {
+			bestServer = server;
+			minServiceTime = serviceTime;
+		}
+	}
+	return bestServer;
+}
+
+void backfill(SimContext* ctx, uint8_t cross) {
+	Server** servers = ctx->servers;
+	Backfill* bf = ctx->backfill;
+	tickBackfill(bf);
+	uint32_t minNeed = UINT32_MAX;
+	for (uint8_t j = 0; j < ctx->jobTypeCnt; j ++) {
+		if (ctx->serverNeeds[j] < minNeed) minNeed = ctx->serverNeeds[j];
+	}
+	// Serve waiting jobs FCFS with the processors freed in the last time unit
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		startHeads(ctx, bf, servers[i]);
+	}
+	// New jobs start right away if nothing waits before them, otherwise join
+	// the tail of the local queue and may be backfilled below
+	JobBuffer* jobBuffer = ctx->arrivals;
+	kernelNewJobs(ctx, jobBuffer);
+	for (uint32_t i = 0; i < jobBuffer->jobCnt; i ++) {
+		Job* job = jobBuffer->jobs[i];
+		Server* server = servers[job->region];
+		if (queueIsEmpty(server->waitingQueue) && kernelCanServe(ctx, server, job)) {
+			startBackfill(ctx, bf, server, job);
+		} else {
+			kernelEnqueue(ctx, server->waitingQueue, server->region, job);
+			if (server->waitingQueue->size == 1) {
+				reserveBackfill(bf, server, ctx->serverNeeds[job->jobType]);
+			}
+		}
+	}
+	// Servers a job of the smallest type still fits on
+	uint32_t openCnt = 0;
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		if (servers[i]->idleCnt >= minNeed) openCnt ++;
+	}
+	// Backfill jobs behind the blocked heads. With cross, blocked heads may
+	// also start at a remote server, then the next head gets the reservation.
+	for (uint32_t i = 0; (i < ctx->regionCnt) && (openCnt > 0); i ++) {
+		Queue* queue = servers[i]->waitingQueue;
+		if (queueIsEmpty(queue)) continue;
+		Node* pos = cross ? queue->head : queue->head->next;
+		while ((pos != NULL) && (openCnt > 0)) {
+			if (!cross && (servers[i]->idleCnt < minNeed)) break;
+			Job* job = pos->job;
+			Server* server = backfillServer(ctx, bf, job, cross);
+			if (server == NULL) {
+				pos = pos->next;
+				continue;
+			}
+			uint8_t open = (server->idleCnt >= minNeed);
+			startBackfill(ctx, bf, server, job);
+			if (open && (server->idleCnt < minNeed)) openCnt --;
+			if (pos == queue->head) {
+				popQueue(queue);
+				uint32_t idleCnt = servers[i]->idleCnt;
+				startHeads(ctx, bf, servers[i]);
+				if ((idleCnt >= minNeed) && (servers[i]->idleCnt < minNeed)) openCnt --;
+				pos = queue->head;
+			} else {
+				Node* next = pos->next;
+				removeQueue(queue, pos);
+				pos = next;
+			}
+		}
+	}
+}
@@ -0,0 +1,168 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "profile.h"
+
+#define PROFILE_LINE_SIZE 4096
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+* Parse "start:scale ..." into the segments of a region, returns 0 on success
+*/
+static int parseSegments(RegionProfile* region, char* tokens) {
+	if (tokens == NULL) return 1;
+	uint32_t size = 0;
+	char* save;
+	for (char* token = strtok_r(tokens, " \t\r\n", &save); token != NULL; token = strtok_r(NULL, " \t\r\n", &save)) {
+		char* colon = strchr(token, ':');
+		if (colon == NULL) return 1;
+		*colon = '\0';
+		if (region->segmentCnt == size) {
+			size = (size == 0) ? 8 : (size << 1);
+			region->segments = (ProfileSegment*)realloc(region->segments, size*sizeof(ProfileSegment));
+		}
+		ProfileSegment* segment = &region->segments[region->segmentCnt];
+		segment->start = (uint32_t)strtoul(token, NULL, 10);
+		segment->scale = strtod(colon+1, NULL);
+		if (
+			(segment->scale < 0) ||
+			((region->segmentCnt == 0) && (segment->start != 0)) ||
+			((region->segmentCnt > 0) && (segment->start <= region->segments[region->segmentCnt-1].start))
+		) {
+			return 1;
+		}
+		region->segmentCnt ++;
+	}
+	return (region->segmentCnt == 0);
+}
+
+Profile* loadProfile(const char* path, uint32_t regionCnt) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open profile %s\n", path);
+		return NULL;
+	}
+	Profile* profile = (Profile*)malloc(sizeof(Profile));
+	profile->period = 0;
+	profile->regionCnt = regionCnt;
+	profile->regions = (RegionProfile*)calloc(regionCnt, sizeof(RegionProfile));
+	char line[PROFILE_LINE_SIZE];
+	// strtok_r, profiles may be loaded on several threads through libmss.so
+	char* save;
+	uint32_t lineNumber = 0;
+	int error = 0;
+	while (!error && (fgets(line, sizeof(line), file) != NULL)) {
+		lineNumber ++;
+		char* comment = strchr(line, '#');
+		if (comment != NULL) *comment = '\0';
+		char* key = strtok_r(line, " \t\r\n", &save);
+		if (key == NULL) continue;
+		if (strcmp(key, "period") == 0) {
+			char* value = strtok_r(NULL, " \t\r\n", &save);
+			profile->period = (value != NULL) ? (uint32_t)strtoul(value, NULL, 10) : 0;
+			error = (profile->period == 0);
+			continue;
+		}
+		char* end;
+		unsigned long r = strtoul(key, &end, 10);
+		char* kind = strtok_r(NULL, " \t\r\n", &save);
+		if ((*end != '\0') || (r >= regionCnt) || (kind == NULL)) {
+			error = 1;
+			continue;
+		}
+		RegionProfile* region = &profile->regions[r];
+		free(region->segments);
+		region->segments = NULL;
+		region->segmentCnt = 0;
+		if (strcmp(kind, "piecewise") == 0) {
+			region->kind = PROFILE_PIECEWISE;
+			error = parseSegments(region, strtok_r(NULL, "", &save));
+		} else if (strcmp(kind, "sine") == 0) {
+			char* amplitude = strtok_r(NULL, " \t\r\n", &save);
+			char* offset = strtok_r(NULL, " \t\r\n", &save);
+			region->kind = PROFILE_SINE;
+			region->amplitude = (amplitude != NULL) ? strtod(amplitude, NULL) : 0;
+			region->offset = (offset != NULL) ? strtod(offset, NULL) : 0;
+			error = (amplitude == NULL);
+		} else {
+			error = 1;
+		}
+	}
+	fclose(file);
+	if (!error && (profile->period == 0)) {
+		fprintf(stderr, "Profile %s has no period\n", path);
+		freeProfile(profile);
+		return NULL;
+	}
+	if (error) {
+		fprintf(stderr, "Malformed profile %s at line %d\n", path, lineNumber);
+		freeProfile(profile);
+		return NULL;
+	}
+	return profile;
+}
+
+void freeProfile(Profile* profile) {
+	for (uint32_t r = 0; r < profile->regionCnt; r ++) {
+		free(profile->regions[r].segments);
+	}
+	free(profile->regions);
+	free(profile);
+}
+
+/**
+* Scale rates of region r in ctx->rate from the base arrival rates
+*/
+static inline void scaleRegion(SimContext* ctx, uint32_t r, double scale) {
+	uint8_t jobTypeCnt = ctx->jobTypeCnt;
+	for (uint8_t j = 0; j < jobTypeCnt; j ++) {
+		ctx->rate[r*jobTypeCnt+j] = scale*ctx->arrivalRate[r*jobTypeCnt+j];
+	}
+}
+
+void initArrivalRate(SimContext* ctx) {
+	if (ctx->profile == NULL) {
+		ctx->rate = ctx->arrivalRate;
+		return;
+	}
+	ctx->rate = (double*)malloc(ctx->regionCnt*ctx->jobTypeCnt*sizeof(double));
+	memcpy(ctx->rate, ctx->arrivalRate, ctx->regionCnt*ctx->jobTypeCnt*sizeof(double));
+	updateArrivalRate(ctx, 0);
+}
+
+void updateArrivalRate(SimContext* ctx, uint32_t timestamp) {
+	Profile* profile = ctx->profile;
+	if (profile == NULL) return;
+	uint32_t t = timestamp%profile->period;
+	for (uint32_t r = 0; r < profile->regionCnt; r ++) {
+		RegionProfile* region = &profile->regions[r];
+		if (region->kind == PROFILE_PIECEWISE) {
+			uint8_t changed = (t == 0);
+			if (changed) {
+				region->cursor = 0;
+			}
+			while (
+				(region->cursor+1 < region->segmentCnt) &&
+				(region->segments[region->cursor+1].start <= t)
+			) {
+				region->cursor ++;
+				changed = 1;
+			}
+			if (changed) {
+				scaleRegion(ctx, r, region->segments[region->cursor].scale);
+			}
+		} else if (region->kind == PROFILE_SINE) {
+			double scale = 1+region->amplitude*sin(2*M_PI*((double)t-region->offset)/profile->period);
+			scaleRegion(ctx, r, (scale > 0) ? scale : 0);
+		}
+	}
+}
+
+void freeArrivalRate(SimContext* ctx) {
+	if (ctx->rate != ctx->arrivalRate) {
+		free(ctx->rate);
+	}
+	ctx->rate = NULL;
+}
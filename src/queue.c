@@ -6,6 +6,7 @@ Queue* newQueue() {
 	q->tail = NULL;
 	q->size = 0;
 	q->virtualSize = 0;
+	q->freeNodes = NULL;
 	return q;
 }
 
@@ -17,8 +18,21 @@ uint8_t queueIsEmpty(Queue* q) {
 	return (q->size == 0);
 }
 
+/**
+* Keep a node unlinked from q for reuse
+*/
+static inline void releaseNode(Queue* q, Node* node) {
+	node->next = q->freeNodes;
+	q->freeNodes = node;
+}
+
 void pushQueue(Queue* q, Job* job) {
-	Node* node = (Node*)malloc(sizeof(Node));
+	Node* node = q->freeNodes;
+	if (node != NULL) {
+		q->freeNodes = node->next;
+	} else {
+		node = (Node*)malloc(sizeof(Node));
+	}
 	node->job = job;
 	node->next = NULL;
 	node->prev = q->tail;
@@ -37,7 +51,7 @@ void popQueue(Queue* q) {
 	if (!queueIsEmpty(q)) {
 		Node* top = q->head;
 		q->head = q->head->next;
-		free(top);
+		releaseNode(q, top);
 		q->size --;
 		if (q->head == NULL) {
 			q->tail = NULL;
@@ -58,10 +72,21 @@ void removeQueue(Queue* q, Node* node) {
 	} else {
 		q->tail = node->prev;
 	}
-	free(node);
+	releaseNode(q, node);
 	q->size --;
 }
 
+Queue* cloneQueue(Queue* q) {
+	Queue* copy = newQueue();
+	for (Node* pos = q->head; pos != NULL; pos = pos->next) {
+		Job* job = (Job*)malloc(sizeof(Job));
+		*job = *pos->job;
+		pushQueue(copy, job);
+	}
+	copy->virtualSize = q->virtualSize;
+	return copy;
+}
+
 void freeQueue(Queue* q) {
 	while (q->head != NULL) {
 		Node* top = q->head;
@@ -69,5 +94,10 @@ void freeQueue(Queue* q) {
 		free(top->job);
 		free(top);
 	}
+	while (q->freeNodes != NULL) {
+		Node* top = q->freeNodes;
+		q->freeNodes = q->freeNodes->next;
+		free(top);
+	}
 	free(q);
 }
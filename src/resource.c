@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "resource.h"
+#include "server.h"
+
+static const char* packingNames[] = {"fastest", "dot", "bestfit"};
+
+const char* packingName(uint8_t packing) {
+	return (packing <= PACK_BEST_FIT) ? packingNames[packing] : NULL;
+}
+
+/**
+* Parse the comma separated values in the first length characters of source
+* into a new array, NULL if one is not a number up to RESOURCE_VALUE_MAX
+* @param cnt Set to the number of values
+*/
+static uint32_t* parseValues(const char* source, size_t length, uint32_t* cnt) {
+	*cnt = 1;
+	for (size_t i = 0; i < length; i ++) {
+		*cnt += (source[i] == ',');
+	}
+	uint32_t* values = (uint32_t*)malloc(*cnt*sizeof(uint32_t));
+	const char* c = source;
+	for (uint32_t k = 0; k < *cnt; k ++) {
+		uint64_t value = 0;
+		const char* start = c;
+		while ((c < source+length) && isdigit((unsigned char)*c)) {
+			value = value*10+(uint64_t)(*c-'0');
+			if (value > RESOURCE_VALUE_MAX) break;
+			c ++;
+		}
+		if ((c == start) || (value > RESOURCE_VALUE_MAX) || ((c < source+length) && (*c != ','))) {
+			free(values);
+			return NULL;
+		}
+		values[k] = (uint32_t)value;
+		c ++;
+	}
+	return values;
+}
+
+int addResource(SimContext* ctx, const char* spec) {
+	if (ctx->resourceCnt == RESOURCE_MAX) {
+		fprintf(stderr, "At most %d resources including processors\n", RESOURCE_MAX);
+		return 1;
+	}
+	const char* capacityStart = strchr(spec, ':');
+	const char* demandStart = (capacityStart != NULL) ? strchr(capacityStart+1, ':') : NULL;
+	if ((demandStart == NULL) || (capacityStart == spec)) {
+		fprintf(stderr, "Malformed resource %s, expected name:capacity:demand\n", spec);
+		return 1;
+	}
+	uint32_t capacityCnt, demandCnt;
+	uint32_t* capacity = parseValues(capacityStart+1, (size_t)(demandStart-capacityStart-1), &capacityCnt);
+	uint32_t* demand = parseValues(demandStart+1, strlen(demandStart+1), &demandCnt);
+	uint8_t valid = (
+		(capacity != NULL) && (demand != NULL) &&
+		((capacityCnt == 1) || (capacityCnt == ctx->regionCnt)) &&
+		(demandCnt == ctx->jobTypeCnt)
+	);
+	if (!valid) {
+		fprintf(stderr, "Resource %s needs 1 or regionCnt capacities and jobTypeCnt demands\n", spec);
+		free(capacity);
+		free(demand);
+		return 1;
+	}
+	uint32_t k = ctx->resourceCnt-1;
+	uint32_t R = ctx->regionCnt;
+	uint32_t J = ctx->jobTypeCnt;
+	// Processors join the vectors as well
+	for (uint32_t r = 0; r < R; r ++) {
+		valid = valid && (ctx->procCnt[r] <= RESOURCE_VALUE_MAX);
+	}
+	for (uint32_t j = 0; j < J; j ++) {
+		valid = valid && (ctx->serverNeeds[j] <= RESOURCE_VALUE_MAX);
+	}
+	if (!valid) {
+		fprintf(stderr, "Processor counts and server needs must be at most %d with --resource\n", RESOURCE_VALUE_MAX);
+		free(capacity);
+		free(demand);
+		return 1;
+	}
+	ctx->resourceCapacity = (uint32_t*)realloc(ctx->resourceCapacity, (k+1)*R*sizeof(uint32_t));
+	for (uint32_t r = 0; r < R; r ++) {
+		ctx->resourceCapacity[k*R+r] = capacity[(capacityCnt == 1) ? 0 : r];
+	}
+	ctx->resourceDemand = (uint32_t*)realloc(ctx->resourceDemand, (k+1)*J*sizeof(uint32_t));
+	memcpy(ctx->resourceDemand+k*J, demand, J*sizeof(uint32_t));
+	free(capacity);
+	free(demand);
+	size_t nameLength = (size_t)(capacityStart-spec);
+	ctx->resourceNames = (char**)realloc(ctx->resourceNames, (ctx->resourceCnt+1)*sizeof(char*));
+	ctx->resourceNames[ctx->resourceCnt] = (char*)malloc((nameLength+1)*sizeof(char));
+	memcpy(ctx->resourceNames[ctx->resourceCnt], spec, nameLength);
+	ctx->resourceNames[ctx->resourceCnt][nameLength] = '\0';
+	ctx->resourceCnt ++;
+	return 0;
+}
+
+int checkDemands(SimContext* ctx, uint8_t processors) {
+	uint32_t R = ctx->regionCnt;
+	uint32_t J = ctx->jobTypeCnt;
+	for (uint32_t j = 0; j < J; j ++) {
+		uint8_t fits = 0;
+		for (uint32_t r = 0; (r < R) && !fits; r ++) {
+			fits = !processors || (ctx->serverNeeds[j] <= ctx->procCnt[r]);
+			for (uint8_t k = 1; k < ctx->resourceCnt; k ++) {
+				fits = fits && (ctx->resourceDemand[(k-1)*J+j] <= ctx->resourceCapacity[(k-1)*R+r]);
+			}
+		}
+		if (fits) continue;
+		fprintf(stderr, "Job type %d fits on no server, it needs %d processors", j, ctx->serverNeeds[j]);
+		for (uint8_t k = 1; k < ctx->resourceCnt; k ++) {
+			fprintf(stderr, ", %d %s", ctx->resourceDemand[(k-1)*J+j], ctx->resourceNames[k]);
+		}
+		fprintf(stderr, "\n");
+		return 1;
+	}
+	return 0;
+}
+
+void initServerResources(SimContext* ctx, Server* server) {
+	uint32_t R = ctx->regionCnt;
+	for (uint8_t k = 1; k < ctx->resourceCnt; k ++) {
+		server->capacity[k] = ctx->resourceCapacity[(k-1)*R+server->region];
+		server->idle[k] = server->capacity[k];
+	}
+}
+
+void initResources(SimContext* ctx) {
+	uint32_t J = ctx->jobTypeCnt;
+	ctx->demand = (uint32_t*)calloc(J*RESOURCE_MAX, sizeof(uint32_t));
+	for (uint32_t j = 0; j < J; j ++) {
+		ctx->demand[j*RESOURCE_MAX] = ctx->serverNeeds[j];
+		for (uint8_t k = 1; k < ctx->resourceCnt; k ++) {
+			ctx->demand[j*RESOURCE_MAX+k] = ctx->resourceDemand[(k-1)*J+j];
+		}
+	}
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		initServerResources(ctx, ctx->servers[i]);
+	}
+}
+
+void sumUtilization(SimContext* ctx, uint32_t timestamp) {
+	for (uint8_t k = 0; k < ctx->resourceCnt; k ++) {
+		uint64_t busy = 0;
+		uint64_t capacity = 0;
+		for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+			busy += ctx->servers[i]->busy[k];
+			capacity += ctx->servers[i]->capacity[k];
+		}
+		ctx->utilization[k] = ((capacity > 0) && (timestamp > 0)) ? (double)busy/((double)capacity*timestamp) : 0;
+	}
+}
+
+void freeResources(SimContext* ctx) {
+	free(ctx->demand);
+	ctx->demand = NULL;
+}
@@ -0,0 +1,397 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "service.h"
+
+#define SERVICE_LINE_SIZE 4096
+// Survival terms below this end the sum in serviceFloorMoments()
+#define SERVICE_TAIL_EPS 1E-12
+#define SERVICE_TAIL_TERMS 100000
+
+/**
+* Append a (value, weight) pair to d, growing its arrays
+*/
+static void appendValue(ServiceDist* d, double value, double weight) {
+	d->values = (double*)realloc(d->values, (d->valueCnt+1)*sizeof(double));
+	d->weights = (double*)realloc(d->weights, (d->valueCnt+1)*sizeof(double));
+	d->values[d->valueCnt] = value;
+	d->weights[d->valueCnt] = weight;
+	d->valueCnt ++;
+}
+
+/**
+* Parse "value:weight ..." pairs, or "@file" with "value weight" lines, into
+* d. Returns 0 on success. Weights are not normalized yet.
+*/
+static int parseValues(ServiceDist* d, char* tokens) {
+	char* save;
+	char* token = strtok_r(tokens, " \t\r\n", &save);
+	if ((token != NULL) && (token[0] == '@')) {
+		FILE* file = fopen(token+1, "r");
+		if (file == NULL) {
+			fprintf(stderr, "Cannot open histogram %s\n", token+1);
+			return 1;
+		}
+		double value, weight;
+		char line[SERVICE_LINE_SIZE];
+		while (fgets(line, sizeof(line), file) != NULL) {
+			if (line[0] == '#') continue;
+			if (sscanf(line, "%lf %lf", &value, &weight) == 2) {
+				appendValue(d, value, weight);
+			}
+		}
+		fclose(file);
+	} else {
+		for (; token != NULL; token = strtok_r(NULL, " \t\r\n", &save)) {
+			char* colon = strchr(token, ':');
+			if (colon == NULL) return 1;
+			*colon = '\0';
+			appendValue(d, strtod(token, NULL), strtod(colon+1, NULL));
+		}
+	}
+	return (d->valueCnt == 0);
+}
+
+/**
+* Parse the distribution part of a line into d, returns 0 on success
+* save is the strtok_r() position in the line, after kind.
+*/
+static int parseDist(ServiceDist* d, char* kind, char** save) {
+	char* first = strtok_r(NULL, " \t\r\n", save);
+	char* second = NULL;
+	d->a = (first != NULL) ? strtod(first, NULL) : -1;
+	d->b = 0;
+	if (strcmp(kind, "exponential") == 0) {
+		d->kind = SERVICE_EXPONENTIAL;
+		return (first != NULL) && (d->a <= 0);
+	} else if (strcmp(kind, "deterministic") == 0) {
+		d->kind = SERVICE_DETERMINISTIC;
+		return (first == NULL) || (d->a < 0);
+	} else if ((strcmp(kind, "lognormal") == 0) || (strcmp(kind, "pareto") == 0)) {
+		d->kind = (kind[0] == 'l') ? SERVICE_LOGNORMAL : SERVICE_PARETO;
+		second = strtok_r(NULL, " \t\r\n", save);
+		if ((first == NULL) || (second == NULL)) return 1;
+		d->b = strtod(second, NULL);
+		if (d->kind == SERVICE_LOGNORMAL) return (d->b < 0);
+		return (d->a <= 0) || (d->b <= 0);
+	} else if ((strcmp(kind, "hyperexp") == 0) || (strcmp(kind, "empirical") == 0)) {
+		d->kind = (kind[0] == 'h') ? SERVICE_HYPEREXPONENTIAL : SERVICE_EMPIRICAL;
+		// Pairs are parsed again from the first token
+		if (first == NULL) return 1;
+		char* rest = strtok_r(NULL, "", save);
+		char* tokens = (char*)malloc(strlen(first)+((rest != NULL) ? strlen(rest) : 0)+2);
+		strcpy(tokens, first);
+		if (rest != NULL) {
+			strcat(tokens, " ");
+			strcat(tokens, rest);
+		}
+		int error = parseValues(d, tokens);
+		free(tokens);
+		if (error) return 1;
+		if (d->kind == SERVICE_HYPEREXPONENTIAL) {
+			// The line reads probability:mean, stored as mean with its weight
+			for (uint32_t i = 0; i < d->valueCnt; i ++) {
+				double probability = d->values[i];
+				d->values[i] = d->weights[i];
+				d->weights[i] = probability;
+			}
+		}
+		double sum = 0;
+		for (uint32_t i = 0; i < d->valueCnt; i ++) {
+			if ((d->weights[i] < 0) || (d->values[i] < 0)) return 1;
+			if ((d->kind == SERVICE_HYPEREXPONENTIAL) && (d->values[i] <= 0)) return 1;
+			sum += d->weights[i];
+		}
+		if (sum <= 0) return 1;
+		for (uint32_t i = 0; i < d->valueCnt; i ++) {
+			d->weights[i] /= sum;
+		}
+		return 0;
+	}
+	return 1;
+}
+
+/**
+* Copy src into dst with its own arrays and alias table
+*/
+static void copyDist(ServiceDist* dst, const ServiceDist* src) {
+	*dst = *src;
+	dst->values = NULL;
+	dst->weights = NULL;
+	dst->table = NULL;
+	if (src->valueCnt > 0) {
+		dst->values = (double*)malloc(src->valueCnt*sizeof(double));
+		dst->weights = (double*)malloc(src->valueCnt*sizeof(double));
+		memcpy(dst->values, src->values, src->valueCnt*sizeof(double));
+		memcpy(dst->weights, src->weights, src->valueCnt*sizeof(double));
+		dst->table = gsl_ran_discrete_preproc(src->valueCnt, src->weights);
+	}
+}
+
+static void freeDist(ServiceDist* d) {
+	free(d->values);
+	free(d->weights);
+	if (d->table != NULL) {
+		gsl_ran_discrete_free(d->table);
+	}
+	d->values = NULL;
+	d->weights = NULL;
+	d->table = NULL;
+	d->valueCnt = 0;
+}
+
+ServiceModel* loadServiceModel(const char* path, uint32_t regionCnt, uint8_t jobTypeCnt) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open service file %s\n", path);
+		return NULL;
+	}
+	ServiceModel* model = (ServiceModel*)malloc(sizeof(ServiceModel));
+	model->regionCnt = regionCnt;
+	model->jobTypeCnt = jobTypeCnt;
+	model->timeMax = SERVICE_TIME_MAX;
+	model->dists = (ServiceDist*)calloc(regionCnt*jobTypeCnt, sizeof(ServiceDist));
+	for (uint32_t i = 0; i < regionCnt*jobTypeCnt; i ++) {
+		model->dists[i].kind = SERVICE_EXPONENTIAL;
+		model->dists[i].a = -1;
+	}
+	char line[SERVICE_LINE_SIZE];
+	// strtok_r, models may be loaded on several threads through libmss.so
+	char* save;
+	uint32_t lineNumber = 0;
+	int error = 0;
+	while (!error && (fgets(line, sizeof(line), file) != NULL)) {
+		lineNumber ++;
+		char* comment = strchr(line, '#');
+		if (comment != NULL) *comment = '\0';
+		char* region = strtok_r(line, " \t\r\n", &save);
+		if (region == NULL) continue;
+		char* type = strtok_r(NULL, " \t\r\n", &save);
+		char* kind = strtok_r(NULL, " \t\r\n", &save);
+		if ((type == NULL) || (kind == NULL)) {
+			error = 1;
+			break;
+		}
+		uint8_t anyRegion = (strcmp(region, "*") == 0);
+		uint8_t anyType = (strcmp(type, "*") == 0);
+		unsigned long r = anyRegion ? 0 : strtoul(region, NULL, 10);
+		unsigned long j = anyType ? 0 : strtoul(type, NULL, 10);
+		if ((r >= regionCnt) || (j >= jobTypeCnt)) {
+			error = 1;
+			break;
+		}
+		ServiceDist d;
+		memset(&d, 0, sizeof(ServiceDist));
+		error = parseDist(&d, kind, &save);
+		if (!error) {
+			for (uint32_t i = 0; i < regionCnt; i ++) {
+				for (uint8_t k = 0; k < jobTypeCnt; k ++) {
+					if ((anyRegion || (i == r)) && (anyType || (k == j))) {
+						freeDist(&model->dists[i*jobTypeCnt+k]);
+						copyDist(&model->dists[i*jobTypeCnt+k], &d);
+					}
+				}
+			}
+		}
+		free(d.values);
+		free(d.weights);
+	}
+	fclose(file);
+	if (error) {
+		fprintf(stderr, "Malformed service file %s at line %d\n", path, lineNumber);
+		freeServiceModel(model);
+		return NULL;
+	}
+	return model;
+}
+
+void freeServiceModel(ServiceModel* model) {
+	for (uint32_t i = 0; i < model->regionCnt*model->jobTypeCnt; i ++) {
+		freeDist(&model->dists[i]);
+	}
+	free(model->dists);
+	free(model);
+}
+
+void capServiceTimes(SimContext* ctx) {
+	uint32_t maxMean = 1;
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		for (uint32_t j = 0; j < ctx->regionCnt; j ++) {
+			uint32_t mean = getMeanServiceTime(ctx, i, j);
+			if (mean > maxMean) maxMean = mean;
+		}
+	}
+	if (UINT32_MAX/maxMean < ctx->service->timeMax) ctx->service->timeMax = UINT32_MAX/maxMean;
+}
+
+/**
+* Floor a draw into time units, capped at timeMax so that scaling cannot
+* overflow
+*/
+static inline uint32_t toServiceTime(double x, uint32_t timeMax) {
+	return (x < timeMax) ? (uint32_t)floor(x) : timeMax;
+}
+
+/**
+* Value of d->values at the quantile u of d->weights, in the listed order
+*/
+static inline double inverseValue(const ServiceDist* d, double u) {
+	double cdf = 0;
+	for (uint32_t i = 0; i+1 < d->valueCnt; i ++) {
+		cdf += d->weights[i];
+		if (u <= cdf) return d->values[i];
+	}
+	return d->values[d->valueCnt-1];
+}
+
+/**
+* Draw by inversion for antithetic pairs, one uniform per job (two for
+* hyperexp) of the current group (see variance.h)
+*/
+static void fillServiceTimesInverse(SimContext* ctx, ServiceDist* d, uint32_t region, Job** jobs, uint32_t n) {
+	for (uint32_t k = 0; k < n; k ++) {
+		double x = 0;
+		switch (d->kind) {
+			case SERVICE_EXPONENTIAL:
+				x = gsl_cdf_exponential_Pinv(antitheticUniform(ctx, k), (d->a > 0) ? d->a : getMeanServiceTime(ctx, region, region));
+				break;
+			case SERVICE_DETERMINISTIC:
+				x = d->a;
+				break;
+			case SERVICE_LOGNORMAL:
+				x = exp(d->a+d->b*gsl_cdf_ugaussian_Pinv(antitheticUniform(ctx, k)));
+				break;
+			case SERVICE_PARETO:
+				x = d->b*pow(1-antitheticUniform(ctx, k), -1/d->a);
+				break;
+			case SERVICE_HYPEREXPONENTIAL: {
+				double mean = inverseValue(d, antitheticUniform(ctx, (uint64_t)n+k));
+				x = gsl_cdf_exponential_Pinv(antitheticUniform(ctx, k), mean);
+				break;
+			}
+			case SERVICE_EMPIRICAL:
+				x = inverseValue(d, antitheticUniform(ctx, k));
+				break;
+			default:
+				break;
+		}
+		jobs[k]->timeToFinish = toServiceTime(x, ctx->service->timeMax);
+	}
+}
+
+void fillServiceTimes(SimContext* ctx, uint32_t region, uint8_t jobType, Job** jobs, uint32_t n) {
+	ServiceDist* d = &ctx->service->dists[region*ctx->jobTypeCnt+jobType];
+	if (ctx->antithetic != ANTITHETIC_OFF) {
+		fillServiceTimesInverse(ctx, d, region, jobs, n);
+		return;
+	}
+	gsl_rng* rng = ctx->rng;
+	switch (d->kind) {
+		case SERVICE_EXPONENTIAL: {
+			double mean = (d->a > 0) ? d->a : getMeanServiceTime(ctx, region, region);
+			for (uint32_t k = 0; k < n; k ++) {
+				jobs[k]->timeToFinish = toServiceTime(gsl_ran_exponential(rng, mean), ctx->service->timeMax);
+			}
+			break;
+		}
+		case SERVICE_DETERMINISTIC: {
+			uint32_t time = toServiceTime(d->a, ctx->service->timeMax);
+			for (uint32_t k = 0; k < n; k ++) {
+				jobs[k]->timeToFinish = time;
+			}
+			break;
+		}
+		case SERVICE_LOGNORMAL:
+			for (uint32_t k = 0; k < n; k ++) {
+				jobs[k]->timeToFinish = toServiceTime(gsl_ran_lognormal(rng, d->a, d->b), ctx->service->timeMax);
+			}
+			break;
+		case SERVICE_PARETO:
+			for (uint32_t k = 0; k < n; k ++) {
+				jobs[k]->timeToFinish = toServiceTime(gsl_ran_pareto(rng, d->a, d->b), ctx->service->timeMax);
+			}
+			break;
+		case SERVICE_HYPEREXPONENTIAL:
+			for (uint32_t k = 0; k < n; k ++) {
+				double mean = d->values[gsl_ran_discrete(rng, d->table)];
+				jobs[k]->timeToFinish = toServiceTime(gsl_ran_exponential(rng, mean), ctx->service->timeMax);
+			}
+			break;
+		case SERVICE_EMPIRICAL:
+			for (uint32_t k = 0; k < n; k ++) {
+				jobs[k]->timeToFinish = toServiceTime(d->values[gsl_ran_discrete(rng, d->table)], ctx->service->timeMax);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+* E[floor(X)] and P(X < 1) of X ~ Exp(mean), floor(X) is geometric
+*/
+static inline void exponentialFloor(double mean, double* p0, double* meanFloor) {
+	double q = (mean > 0) ? exp(-1/mean) : 0;
+	*p0 = 1-q;
+	*meanFloor = (q < 1) ? q/(1-q) : 0;
+}
+
+/**
+* P(X >= x) for X drawn from a lognormal or pareto d
+*/
+static inline double survival(const ServiceDist* d, double x) {
+	if (d->kind == SERVICE_LOGNORMAL) {
+		return (d->b > 0) ? 0.5*erfc((log(x)-d->a)/(d->b*sqrt(2))) : (exp(d->a) >= x);
+	}
+	return (x <= d->b) ? 1 : pow(d->b/x, d->a);
+}
+
+void serviceFloorMoments(SimContext* ctx, uint32_t region, uint8_t jobType, double* p0, double* meanFloor) {
+	double localMean = getMeanServiceTime(ctx, region, region);
+	if (ctx->service == NULL) {
+		exponentialFloor(localMean, p0, meanFloor);
+		return;
+	}
+	const ServiceDist* d = &ctx->service->dists[region*ctx->jobTypeCnt+jobType];
+	switch (d->kind) {
+		case SERVICE_EXPONENTIAL:
+			exponentialFloor((d->a > 0) ? d->a : localMean, p0, meanFloor);
+			return;
+		case SERVICE_DETERMINISTIC:
+		case SERVICE_EMPIRICAL:
+			*p0 = 0;
+			*meanFloor = 0;
+			for (uint32_t i = 0; i < ((d->kind == SERVICE_EMPIRICAL) ? d->valueCnt : 1); i ++) {
+				double value = (d->kind == SERVICE_EMPIRICAL) ? d->values[i] : d->a;
+				double weight = (d->kind == SERVICE_EMPIRICAL) ? d->weights[i] : 1;
+				*p0 += (value < 1) ? weight : 0;
+				*meanFloor += weight*toServiceTime(value, ctx->service->timeMax);
+			}
+			return;
+		case SERVICE_HYPEREXPONENTIAL:
+			*p0 = 0;
+			*meanFloor = 0;
+			for (uint32_t i = 0; i < d->valueCnt; i ++) {
+				double phaseP0, phaseMeanFloor;
+				exponentialFloor(d->values[i], &phaseP0, &phaseMeanFloor);
+				*p0 += d->weights[i]*phaseP0;
+				*meanFloor += d->weights[i]*phaseMeanFloor;
+			}
+			return;
+		default:
+			break;
+	}
+	// E[floor(X)] is the sum of P(X >= k) over k >= 1
+	*p0 = 1-survival(d, 1);
+	*meanFloor = 0;
+	uint32_t k = 1;
+	for (; k <= SERVICE_TAIL_TERMS; k ++) {
+		double tail = survival(d, k);
+		*meanFloor += tail;
+		if (tail < SERVICE_TAIL_EPS) break;
+	}
+	if ((k > SERVICE_TAIL_TERMS) && (d->kind == SERVICE_PARETO)) {
+		// Remaining terms of b^a*k^-a, by the integral from k
+		*meanFloor += (d->a > 1) ? pow(d->b, d->a)*pow(k, 1-d->a)/(d->a-1) : ctx->service->timeMax;
+	}
+	*meanFloor = fmin(*meanFloor, ctx->service->timeMax);
+}
@@ -0,0 +1,553 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shard.h"
+#include "kernel.h"
+#include "policy.h"
+#include "profile.h"
+
+typedef enum ShardPhase {
+	SHARD_LOCAL,
+	SHARD_ROUTE,
+	SHARD_ACCEPT,
+	SHARD_FINISH
+} ShardPhase;
+
+uint8_t shardable(uint8_t policyId) {
+	return (
+		(policyId == POLICY_FCFS_LOCAL) ||
+		(policyId == POLICY_FCFS_CROSS) ||
+		(policyId == POLICY_FCFS_CROSS_PART) ||
+		(policyId == POLICY_JSQ) ||
+		(policyId == POLICY_JSQ_PART)
+	);
+}
+
+static inline uint8_t routesVirtual(uint8_t policyId) {
+	return (policyId == POLICY_JSQ) || (policyId == POLICY_JSQ_PART);
+}
+
+/**
+* Whether only small jobs (type 0) leave their region
+*/
+static inline uint8_t routesSmallOnly(uint8_t policyId) {
+	return (policyId == POLICY_FCFS_CROSS_PART) || (policyId == POLICY_JSQ_PART);
+}
+
+/**
+* Seed of the rng of region, splitmix64 of (seed, region)
+*/
+static unsigned long regionSeed(uint64_t seed, uint32_t region) {
+	uint64_t z = seed+((uint64_t)region+1)*0x9E3779B97F4A7C15ull;
+	z = (z^(z >> 30))*0xBF58476D1CE4E5B9ull;
+	z = (z^(z >> 27))*0x94D049BB133111EBull;
+	return (unsigned long)(z^(z >> 31));
+}
+
+/**
+* Claim the next chunk of regions [*lo, *hi) of phase for thread self, from its
+* own shard first, then from the others. Returns 0 once all shards are done.
+*/
+static uint8_t claimRegions(Shards* sh, uint32_t self, uint64_t phase, uint32_t* lo, uint32_t* hi) {
+	for (uint32_t k = 0; k < sh->threadCnt; k ++) {
+		uint32_t t = (self+k)%sh->threadCnt;
+		uint64_t size = sh->bound[t+1]-sh->bound[t];
+		uint64_t end = (phase+1)*size;
+		uint64_t next = atomic_load_explicit(&sh->cursor[t].next, memory_order_relaxed);
+		while (next < end) {
+			uint64_t claimed = (next+SHARD_CHUNK < end) ? next+SHARD_CHUNK : end;
+			if (atomic_compare_exchange_weak_explicit(&sh->cursor[t].next, &next, claimed, memory_order_relaxed, memory_order_relaxed)) {
+				*lo = sh->bound[t]+(uint32_t)(next-phase*size);
+				*hi = sh->bound[t]+(uint32_t)(claimed-phase*size);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void addRequest(Shards* sh, uint32_t origin, Job* job, Node* node) {
+	if (sh->requestCnt[origin] == sh->requestSize[origin]) {
+		sh->requestSize[origin] = (sh->requestSize[origin] == 0) ? INIT_JOB_BUFFER_SIZE : (sh->requestSize[origin] << 1);
+		sh->requests[origin] = (ShardRequest*)realloc(sh->requests[origin], sh->requestSize[origin]*sizeof(ShardRequest));
+	}
+	ShardRequest* request = &sh->requests[origin][sh->requestCnt[origin] ++];
+	request->job = job;
+	request->node = node;
+	request->target = SHARD_NONE;
+	request->accepted = 0;
+}
+
+static void postMail(ShardThread* self, uint32_t target, uint32_t origin, uint32_t index) {
+	if (self->mailCnt[target] == self->mailSize[target]) {
+		self->mailSize[target] = (self->mailSize[target] == 0) ? INIT_JOB_BUFFER_SIZE : (self->mailSize[target] << 1);
+		self->mail[target] = (ShardMail*)realloc(self->mail[target], self->mailSize[target]*sizeof(ShardMail));
+	}
+	ShardMail* mail = &self->mail[target][self->mailCnt[target] ++];
+	mail->origin = origin;
+	mail->index = index;
+}
+
+static void addRouted(ShardThread* self, uint32_t target, uint64_t amount) {
+	if (amount == 0) return;
+	if (self->routed[target] == 0) {
+		self->touched[self->touchedCnt ++] = target;
+	}
+	self->routed[target] += amount;
+}
+
+/**
+* getBestRegion() against the snapshot less what the origin routed already,
+* SHARD_NONE if no region fits
+*/
+static uint32_t bestTarget(Shards* sh, ShardThread* self, Job* job) {
+	SimContext* ctx = sh->ctx;
+	uint32_t origin = job->region;
+	uint64_t need = ctx->serverNeeds[job->jobType];
+	if (sh->snapshot[origin]-self->routed[origin] >= need) return origin;
+	uint32_t best = SHARD_NONE;
+	uint32_t minServiceTime = UINT32_MAX;
+	for (uint32_t s = 0; s < ctx->regionCnt; s ++) {
+		uint32_t serviceTime = getMeanServiceTime(ctx, s, origin);
+		if ((sh->snapshot[s]-self->routed[s] >= need) && (serviceTime < minServiceTime)) {
+			best = s;
+			minServiceTime = serviceTime;
+		}
+	}
+	return best;
+}
+
+/**
+* Whether region a sorts before region b in the heap of virtual queue sizes
+* (ties to the lowest index, as shortestRegion())
+*/
+static inline uint8_t heapBefore(Shards* sh, uint32_t a, uint32_t b) {
+	return (sh->snapshot[a] < sh->snapshot[b]) || ((sh->snapshot[a] == sh->snapshot[b]) && (a < b));
+}
+
+static void heapDown(Shards* sh, uint32_t k) {
+	uint32_t R = sh->ctx->regionCnt;
+	uint32_t* heap = sh->heap;
+	for (;;) {
+		uint32_t child = 2*k+1;
+		if (child >= R) break;
+		if ((child+1 < R) && heapBefore(sh, heap[child+1], heap[child])) child ++;
+		if (!heapBefore(sh, heap[child], heap[k])) break;
+		uint32_t region = heap[k];
+		heap[k] = heap[child];
+		heap[child] = region;
+		sh->heapPos[heap[k]] = k;
+		sh->heapPos[region] = child;
+		k = child;
+	}
+}
+
+/**
+* Route the held arrivals of all regions (jsq), on one thread
+* Arrivals are taken in one shuffled order and sent to the shortest virtual
+* queue as it grows, as jsq() does, with the sizes kept in a heap.
+*/
+static void routeVirtual(Shards* sh) {
+	SimContext* ctx = &sh->threads[0].ctx;
+	uint32_t R = ctx->regionCnt;
+	uint8_t smallOnly = routesSmallOnly(ctx->policyId);
+	uint32_t jobCnt = 0;
+	for (uint32_t r = 0; r < R; r ++) {
+		jobCnt += sh->requestCnt[r];
+	}
+	if (jobCnt == 0) return;
+	if (jobCnt > sh->orderSize) {
+		sh->orderSize = jobCnt;
+		sh->order = (ShardMail*)realloc(sh->order, sh->orderSize*sizeof(ShardMail));
+	}
+	uint32_t k = 0;
+	for (uint32_t r = 0; r < R; r ++) {
+		for (uint32_t i = 0; i < sh->requestCnt[r]; i ++) {
+			sh->order[k].origin = r;
+			sh->order[k].index = i;
+			k ++;
+		}
+	}
+	gsl_ran_shuffle(sh->routeRng, sh->order, jobCnt, sizeof(ShardMail));
+	for (uint32_t r = 0; r < R; r ++) {
+		sh->heap[r] = r;
+		sh->heapPos[r] = r;
+	}
+	for (uint32_t i = R/2; i > 0; i --) {
+		heapDown(sh, i-1);
+	}
+	for (k = 0; k < jobCnt; k ++) {
+		uint32_t origin = sh->order[k].origin;
+		ShardRequest* request = &sh->requests[origin][sh->order[k].index];
+		Job* job = request->job;
+		uint32_t target = (smallOnly && (job->jobType != 0)) ? origin : sh->heap[0];
+		sh->snapshot[target] += kernelVirtualSize(ctx, ctx->servers[target], job);
+		heapDown(sh, sh->heapPos[target]);
+		request->target = target;
+		postMail(&sh->threads[0], target, origin, sh->order[k].index);
+	}
+}
+
+static void localPhase(Shards* sh, ShardThread* self, uint32_t r) {
+	SimContext* ctx = &self->ctx;
+	uint8_t policyId = ctx->policyId;
+	uint8_t isVirtual = routesVirtual(policyId);
+	Server* server = ctx->servers[r];
+	Queue* queue = server->waitingQueue;
+	if (!isVirtual) {
+		while (!queueIsEmpty(queue)) {
+			Job* job = queue->head->job;
+			if (!kernelCanServe(ctx, server, job)) break;
+			kernelAssignJob(ctx, server, job);
+			popQueue(queue);
+		}
+	}
+	ctx->rng = sh->rngs[r];
+	JobBuffer* arrivals = &self->arrivals;
+	uint32_t jobCnt = kernelNewRegionJobs(ctx, r, arrivals, 0);
+	TRACE_ARRIVALS(ctx, arrivals->jobs, jobCnt);
+	if (jobCnt > 0) {
+		gsl_ran_shuffle(ctx->rng, arrivals->jobs, jobCnt, sizeof(Job*));
+	}
+	ctx->arrivalCnt += jobCnt;
+	for (uint32_t i = 0; i < jobCnt; i ++) {
+		Job* job = arrivals->jobs[i];
+		if (isVirtual) {
+			addRequest(sh, r, job, NULL);
+		} else if (kernelCanServe(ctx, server, job)) {
+			kernelAssignJob(ctx, server, job);
+		} else if (policyId == POLICY_FCFS_LOCAL) {
+			kernelEnqueue(ctx, queue, r, job);
+		} else {
+			addRequest(sh, r, job, NULL);
+		}
+	}
+	sh->snapshot[r] = isVirtual ? queue->virtualSize : server->idleCnt;
+}
+
+/**
+* Route the waiting jobs of origin r that can leave it (fcfs). The first round
+* takes them from the queue and the held arrivals, later rounds route again
+* those no target accepted.
+*/
+static void routePhase(Shards* sh, ShardThread* self, uint32_t r, uint8_t reroute) {
+	SimContext* ctx = &self->ctx;
+	uint8_t smallOnly = routesSmallOnly(ctx->policyId);
+	for (uint32_t k = 0; k < self->touchedCnt; k ++) {
+		self->routed[self->touched[k]] = 0;
+	}
+	self->touchedCnt = 0;
+	// Queued jobs first, from the head until one fits nowhere, as fcfsCross
+	// drains the queue before arrivals. They are appended after the held
+	// arrivals, mail keeps the order they are posted in.
+	if (!reroute) sh->heldCnt[r] = sh->requestCnt[r];
+	uint32_t heldCnt = sh->heldCnt[r];
+	Node* head = reroute ? NULL : ctx->servers[r]->waitingQueue->head;
+	for (Node* pos = head; pos != NULL; pos = pos->next) {
+		Job* job = pos->job;
+		if (smallOnly && (job->jobType != 0)) break;
+		uint32_t target = bestTarget(sh, self, job);
+		if (target == SHARD_NONE) break;
+		addRouted(self, target, ctx->serverNeeds[job->jobType]);
+		addRequest(sh, r, job, pos);
+		uint32_t index = sh->requestCnt[r]-1;
+		sh->requests[r][index].target = target;
+		postMail(self, target, r, index);
+	}
+	// Later rounds keep the same order, queued jobs then held arrivals
+	uint32_t requestCnt = reroute ? sh->requestCnt[r] : heldCnt;
+	for (uint32_t k = 0; k < requestCnt; k ++) {
+		uint32_t i = reroute ? (heldCnt+k)%requestCnt : k;
+		ShardRequest* request = &sh->requests[r][i];
+		Job* job = request->job;
+		if (request->accepted || (smallOnly && (job->jobType != 0))) continue;
+		uint32_t target = bestTarget(sh, self, job);
+		request->target = target;
+		if (target == SHARD_NONE) continue;
+		addRouted(self, target, ctx->serverNeeds[job->jobType]);
+		postMail(self, target, r, i);
+	}
+}
+
+static int compareMail(const void* a, const void* b) {
+	const ShardMail* x = (const ShardMail*)a;
+	const ShardMail* y = (const ShardMail*)b;
+	if (x->origin != y->origin) return (x->origin < y->origin) ? -1 : 1;
+	return (x->seq < y->seq) ? -1 : (x->seq > y->seq);
+}
+
+static void acceptPhase(Shards* sh, ShardThread* self, uint32_t s) {
+	SimContext* ctx = &self->ctx;
+	Server* server = ctx->servers[s];
+	// All mail of an origin was posted by one thread in order, so sorting by
+	// origin then position keeps the posting order
+	uint32_t mailCnt = 0;
+	for (uint32_t t = 0; t < sh->threadCnt; t ++) {
+		ShardThread* thread = &sh->threads[t];
+		uint32_t cnt = thread->mailCnt[s];
+		if (cnt == 0) continue;
+		if (mailCnt+cnt > self->inboxSize) {
+			while (mailCnt+cnt > self->inboxSize) {
+				self->inboxSize = (self->inboxSize == 0) ? INIT_JOB_BUFFER_SIZE : (self->inboxSize << 1);
+			}
+			self->inbox = (ShardMail*)realloc(self->inbox, self->inboxSize*sizeof(ShardMail));
+		}
+		for (uint32_t k = 0; k < cnt; k ++) {
+			self->inbox[mailCnt] = thread->mail[s][k];
+			self->inbox[mailCnt].seq = mailCnt;
+			mailCnt ++;
+		}
+		thread->mailCnt[s] = 0;
+	}
+	// jsq mail is posted by one thread in routing order
+	if ((mailCnt > 1) && !routesVirtual(ctx->policyId)) {
+		qsort(self->inbox, mailCnt, sizeof(ShardMail), compareMail);
+	}
+	if (routesVirtual(ctx->policyId)) {
+		for (uint32_t k = 0; k < mailCnt; k ++) {
+			ShardRequest* request = &sh->requests[self->inbox[k].origin][self->inbox[k].index];
+			kernelPushQueueVirtual(ctx, server, request->job);
+			request->accepted = 1;
+		}
+		// Serve the virtual queue in FCFS order until the head is blocked
+		Node* pos = server->waitingQueue->head;
+		while (pos != NULL) {
+			Node* next = pos->next;
+			if (!kernelCanServe(ctx, server, pos->job)) break;
+			kernelAssignJob(ctx, server, pos->job);
+			kernelRemoveQueueVirtual(ctx, server, pos);
+			pos = next;
+		}
+		return;
+	}
+	for (uint32_t k = 0; k < mailCnt; k ++) {
+		ShardRequest* request = &sh->requests[self->inbox[k].origin][self->inbox[k].index];
+		if (kernelCanServe(ctx, server, request->job)) {
+			kernelAssignJob(ctx, server, request->job);
+			request->accepted = 1;
+			self->acceptedCnt ++;
+		} else {
+			self->rejectedCnt ++;
+		}
+	}
+	// Idle processors left for the next round
+	sh->snapshot[s] = server->idleCnt;
+}
+
+static void finishPhase(Shards* sh, ShardThread* self, uint32_t r) {
+	SimContext* ctx = &self->ctx;
+	Server* server = ctx->servers[r];
+	Queue* queue = server->waitingQueue;
+	if (!routesVirtual(ctx->policyId)) {
+		// Held arrivals come first in requests, in arrival order
+		for (uint32_t i = 0; i < sh->requestCnt[r]; i ++) {
+			ShardRequest* request = &sh->requests[r][i];
+			if (request->node != NULL) {
+				if (request->accepted) removeQueue(queue, request->node);
+			} else if (!request->accepted) {
+				kernelEnqueue(ctx, queue, r, request->job);
+			}
+		}
+	}
+	sh->requestCnt[r] = 0;
+	kernelServeJobs(ctx, server);
+	sh->queueLength[r] = getQueueSize(queue);
+}
+
+static void runPhase(Shards* sh, uint32_t id, uint64_t phase, uint8_t kind, uint8_t round) {
+	ShardThread* self = &sh->threads[id];
+	uint32_t lo, hi;
+	while (claimRegions(sh, id, phase, &lo, &hi)) {
+		for (uint32_t r = lo; r < hi; r ++) {
+			switch (kind) {
+				case SHARD_LOCAL: localPhase(sh, self, r); break;
+				case SHARD_ROUTE: routePhase(sh, self, r, round > 0); break;
+				case SHARD_ACCEPT: acceptPhase(sh, self, r); break;
+				default: finishPhase(sh, self, r); break;
+			}
+		}
+	}
+}
+
+/**
+* Accepted and rejected requests summed over threads, counted since the start
+* of the run. Only read between the barrier after an accept phase and the
+* next one, while no thread counts.
+*/
+static void sumAccepted(Shards* sh, uint64_t* accepted, uint64_t* rejected) {
+	*accepted = 0;
+	*rejected = 0;
+	for (uint32_t t = 0; t < sh->threadCnt; t ++) {
+		*accepted += sh->threads[t].acceptedCnt;
+		*rejected += sh->threads[t].rejectedCnt;
+	}
+}
+
+/**
+* Run all time units as thread id, thread 0 also updates arrival rates and sums
+* queue lengths between phases
+*/
+static void runShard(Shards* sh, uint32_t id) {
+	SimContext* ctx = sh->ctx;
+	uint8_t routes = (ctx->policyId != POLICY_FCFS_LOCAL);
+	uint64_t phase = 0;
+	uint64_t accepted = 0;
+	uint64_t rejected = 0;
+	for (uint32_t timestamp = 0; timestamp < ctx->simulationTime; timestamp ++) {
+		if ((id == 0) && ctx->verbose) printf("%d/%d\r", timestamp+1, ctx->simulationTime);
+		runPhase(sh, id, phase ++, SHARD_LOCAL, 0);
+		pthread_barrier_wait(&sh->barrier);
+		if (routesVirtual(ctx->policyId)) {
+			if (id == 0) routeVirtual(sh);
+			pthread_barrier_wait(&sh->barrier);
+			runPhase(sh, id, phase ++, SHARD_ACCEPT, 0);
+			pthread_barrier_wait(&sh->barrier);
+		} else if (routes) {
+			// Route again the jobs targets turned down, against the idle
+			// processors they left, until a round starts none or turns none
+			// down. Every round but the last starts a job, so this ends.
+			for (uint8_t round = 0; ; round = 1) {
+				runPhase(sh, id, phase ++, SHARD_ROUTE, round);
+				pthread_barrier_wait(&sh->barrier);
+				runPhase(sh, id, phase ++, SHARD_ACCEPT, round);
+				pthread_barrier_wait(&sh->barrier);
+				uint64_t acceptedNow, rejectedNow;
+				sumAccepted(sh, &acceptedNow, &rejectedNow);
+				uint8_t done = (acceptedNow == accepted) || (rejectedNow == rejected);
+				accepted = acceptedNow;
+				rejected = rejectedNow;
+				if (done) break;
+			}
+		}
+		// Rates are only read by the local phase
+		if ((id == 0) && (timestamp+1 < ctx->simulationTime)) {
+			updateArrivalRate(ctx, timestamp+1);
+		}
+		runPhase(sh, id, phase ++, SHARD_FINISH, 0);
+		pthread_barrier_wait(&sh->barrier);
+		if (id == 0) {
+			uint32_t queueLength = 0;
+			for (uint32_t r = 0; r < ctx->regionCnt; r ++) {
+				queueLength += sh->queueLength[r];
+			}
+			sh->queueLengthSum += queueLength/ctx->regionCnt;
+		}
+	}
+}
+
+static void* shardThread(void* arg) {
+	ShardThread* self = (ShardThread*)arg;
+	runShard(self->shards, self->id);
+	return NULL;
+}
+
+double runShards(SimContext* ctx) {
+	uint32_t R = ctx->regionCnt;
+	uint32_t T = (ctx->threadCnt < R) ? ctx->threadCnt : R;
+	Shards* sh = (Shards*)malloc(sizeof(Shards));
+	sh->ctx = ctx;
+	sh->threadCnt = T;
+	sh->bound = (uint32_t*)malloc((T+1)*sizeof(uint32_t));
+	for (uint32_t t = 0; t <= T; t ++) {
+		sh->bound[t] = (uint32_t)((uint64_t)R*t/T);
+	}
+	sh->cursor = (ShardCursor*)aligned_alloc(_Alignof(ShardCursor), T*sizeof(ShardCursor));
+	for (uint32_t t = 0; t < T; t ++) {
+		atomic_init(&sh->cursor[t].next, 0);
+	}
+	pthread_barrier_init(&sh->barrier, NULL, T);
+	sh->rngs = (gsl_rng**)malloc(R*sizeof(gsl_rng*));
+	for (uint32_t r = 0; r < R; r ++) {
+		sh->rngs[r] = gsl_rng_alloc(gsl_rng_default);
+		gsl_rng_set(sh->rngs[r], regionSeed(ctx->seed, r));
+	}
+	sh->requests = (ShardRequest**)calloc(R, sizeof(ShardRequest*));
+	sh->requestCnt = (uint32_t*)calloc(R, sizeof(uint32_t));
+	sh->requestSize = (uint32_t*)calloc(R, sizeof(uint32_t));
+	sh->heldCnt = (uint32_t*)calloc(R, sizeof(uint32_t));
+	sh->snapshot = (uint64_t*)calloc(R, sizeof(uint64_t));
+	sh->queueLength = (uint32_t*)calloc(R, sizeof(uint32_t));
+	sh->queueLengthSum = 0;
+	sh->routeRng = gsl_rng_alloc(gsl_rng_default);
+	gsl_rng_set(sh->routeRng, regionSeed(ctx->seed, R));
+	sh->order = NULL;
+	sh->orderSize = 0;
+	sh->heap = (uint32_t*)malloc(R*sizeof(uint32_t));
+	sh->heapPos = (uint32_t*)malloc(R*sizeof(uint32_t));
+	sh->threads = (ShardThread*)malloc(T*sizeof(ShardThread));
+	for (uint32_t t = 0; t < T; t ++) {
+		ShardThread* thread = &sh->threads[t];
+		thread->ctx = *ctx;
+		thread->ctx.rng = NULL;
+		thread->ctx.delayHistogram = (uint32_t*)calloc(DELAY_HISTOGRAM_SIZE, sizeof(uint32_t));
+		thread->ctx.jobPool = NULL;
+		thread->ctx.jobPoolCnt = 0;
+		thread->ctx.jobPoolSize = 0;
+		thread->ctx.arrivalCnt = 0;
+		thread->shards = sh;
+		thread->id = t;
+		thread->mail = (ShardMail**)calloc(R, sizeof(ShardMail*));
+		thread->mailCnt = (uint32_t*)calloc(R, sizeof(uint32_t));
+		thread->mailSize = (uint32_t*)calloc(R, sizeof(uint32_t));
+		thread->inbox = NULL;
+		thread->inboxSize = 0;
+		thread->routed = (uint64_t*)calloc(R, sizeof(uint64_t));
+		thread->touched = (uint32_t*)malloc(R*sizeof(uint32_t));
+		thread->touchedCnt = 0;
+		thread->acceptedCnt = 0;
+		thread->rejectedCnt = 0;
+		thread->arrivals.jobs = NULL;
+		thread->arrivals.jobCnt = 0;
+		thread->arrivals.size = 0;
+	}
+	for (uint32_t t = 1; t < T; t ++) {
+		pthread_create(&sh->threads[t].thread, NULL, shardThread, &sh->threads[t]);
+	}
+	runShard(sh, 0);
+	for (uint32_t t = 1; t < T; t ++) {
+		pthread_join(sh->threads[t].thread, NULL);
+	}
+	double queueLengthSum = (double)sh->queueLengthSum;
+	for (uint32_t t = 0; t < T; t ++) {
+		ShardThread* thread = &sh->threads[t];
+		for (uint32_t i = 0; i < DELAY_HISTOGRAM_SIZE; i ++) {
+			ctx->delayHistogram[i] += thread->ctx.delayHistogram[i];
+		}
+		ctx->arrivalCnt += thread->ctx.arrivalCnt;
+		free(thread->ctx.delayHistogram);
+		freeJobPool(&thread->ctx);
+		for (uint32_t r = 0; r < R; r ++) {
+			free(thread->mail[r]);
+		}
+		free(thread->mail);
+		free(thread->mailCnt);
+		free(thread->mailSize);
+		free(thread->inbox);
+		free(thread->routed);
+		free(thread->touched);
+		free(thread->arrivals.jobs);
+	}
+	free(sh->threads);
+	for (uint32_t r = 0; r < R; r ++) {
+		gsl_rng_free(sh->rngs[r]);
+		free(sh->requests[r]);
+	}
+	free(sh->rngs);
+	free(sh->requests);
+	free(sh->requestCnt);
+	free(sh->requestSize);
+	free(sh->heldCnt);
+	free(sh->snapshot);
+	free(sh->queueLength);
+	gsl_rng_free(sh->routeRng);
+	free(sh->order);
+	free(sh->heap);
+	free(sh->heapPos);
+	pthread_barrier_destroy(&sh->barrier);
+	free(sh->cursor);
+	free(sh->bound);
+	free(sh);
+	return queueLengthSum;
+}
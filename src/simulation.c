@@ -0,0 +1,882 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <immintrin.h>
+#include <time.h>
+#include "simulation.h"
+#include "shard.h"
+
+/**
+* Split a string from source by a delimiter (comma) and store to destination
+* NOTE This function modifies destination array but not source array
+* NOTE Please specify the number of tokens after splitting, it cannot be larger
+* than the actual number. Make sure that destination has enough memory
+* allocated before calling this function. destination can only be an array of
+* uint32_t or double which stores the number converted from splitted string.
+* @param source Source string, does not modify
+* @param destination Destination, a pointer to array of uint32_t or double
+* @param size Number of tokens after splitting
+* @param type Type of destination array. 0 for uint32_t and 1 for double
+*/
+void split(const char* source, void* destination, uint32_t size, uint8_t type) {
+	char* tmp = (char*)malloc((strlen(source)+1)*sizeof(char));
+	strcpy(tmp, source);
+	// strtok_r, mss.py parses contexts on several threads through libmss.so
+	char* save;
+	if (type == 0) {
+		uint32_t* d = (uint32_t*)destination;
+		*d = (uint32_t)atoi(strtok_r(tmp, ",", &save));
+		for (uint32_t i = 1; i < size; i ++) {
+			*(d+i) = (uint32_t)atoi(strtok_r(NULL, ",", &save));
+		}
+	} else if (type == 1) {
+		char* eptr;
+		double* d = (double*)destination;
+		*d = strtod(strtok_r(tmp, ",", &save), &eptr);
+		for (uint32_t i = 1; i < size; i ++) {
+			*(d+i) = strtod(strtok_r(NULL, ",", &save), &eptr);
+		}
+	}
+	free(tmp);
+}
+
+/**
+* Split a comma separated list of any length into a new uint32_t array
+* @param cnt Set to the number of tokens
+*/
+static uint32_t* splitList(const char* source, uint32_t* cnt) {
+	*cnt = 1;
+	for (const char* c = source; *c != '\0'; c ++) {
+		*cnt += (*c == ',');
+	}
+	uint32_t* list = (uint32_t*)malloc(*cnt*sizeof(uint32_t));
+	split(source, list, *cnt, 0);
+	return list;
+}
+
+SimContext* newSimContext() {
+	SimContext* ctx = (SimContext*)malloc(sizeof(SimContext));
+	// Default parameters
+	ctx->rng = NULL;
+	ctx->seed = 0;
+	ctx->seeded = 0;
+	ctx->simulationTime = 1E5;
+	ctx->jobTypeCnt = 2;
+	ctx->regionCnt = 2;
+	ctx->procCnt = (uint32_t*)malloc(ctx->regionCnt*sizeof(uint32_t));
+	ctx->procCnt[0] = 48;
+	ctx->procCnt[1] = 48;
+	ctx->arrivalRate = (double*)malloc(ctx->regionCnt*ctx->jobTypeCnt*sizeof(double));
+	ctx->arrivalRate[0] = 10;
+	ctx->arrivalRate[1] = 4;
+	ctx->arrivalRate[2] = 10;
+	ctx->arrivalRate[3] = 4;
+	ctx->serverNeeds = (uint32_t*)malloc(ctx->jobTypeCnt*sizeof(uint32_t));
+	ctx->serverNeeds[0] = 1;
+	ctx->serverNeeds[1] = 4;
+	ctx->meanServiceTime = (uint32_t*)malloc(ctx->regionCnt*ctx->regionCnt*sizeof(uint32_t));
+	ctx->meanServiceTime[0] = 1;
+	ctx->meanServiceTime[1] = 2;
+	ctx->meanServiceTime[2] = 2;
+	ctx->meanServiceTime[3] = 1;
+	ctx->sampleCnt = 2;
+	ctx->localityWeighted = 0;
+	ctx->resourceCnt = 1;
+	ctx->resourceNames = (char**)malloc(sizeof(char*));
+	ctx->resourceNames[0] = (char*)malloc((strlen("processors")+1)*sizeof(char));
+	strcpy(ctx->resourceNames[0], "processors");
+	ctx->resourceCapacity = NULL;
+	ctx->resourceDemand = NULL;
+	ctx->packing = PACK_FASTEST;
+	ctx->utilization = (double*)calloc(RESOURCE_MAX, sizeof(double));
+	strcpy(ctx->policy, "fcfsLocal");
+	ctx->verbose = 0;
+	ctx->approx = APPROX_NONE;
+	ctx->planMetric = PLAN_NONE;
+	ctx->planTarget = 0;
+	ctx->varianceMode = VR_NONE;
+	ctx->replicationCnt = 1;
+	ctx->profilePath = NULL;
+	ctx->profile = NULL;
+	ctx->servicePath = NULL;
+	ctx->service = NULL;
+	ctx->topologyPath = NULL;
+	ctx->topology = NULL;
+	ctx->tracePath = NULL;
+	ctx->traceSample = 1;
+	ctx->trace = NULL;
+	ctx->feedName = NULL;
+	ctx->feed = NULL;
+	ctx->metricsInterval = 0;
+	ctx->arrivalCnt = 0;
+	ctx->threadCnt = 0;
+	ctx->splitBounds = NULL;
+	ctx->splitBoundCnt = 0;
+	ctx->splitLevels = NULL;
+	ctx->splitLevelCnt = 0;
+	ctx->splitFactor = SPLIT_DEFAULT_FACTOR;
+	ctx->splitProbability = NULL;
+	ctx->cacheDir = NULL;
+	ctx->antithetic = ANTITHETIC_OFF;
+	ctx->antitheticTick = 0;
+	ctx->antitheticGroup = 0;
+	ctx->workRate = NULL;
+	ctx->offeredWork = 0;
+	ctx->meanOfferedWork = 0;
+	ctx->rate = NULL;
+	ctx->demand = NULL;
+	ctx->delayHistogram = NULL;
+	ctx->servers = NULL;
+	ctx->commonQueue = NULL;
+	ctx->maxweight = NULL;
+	ctx->backfill = NULL;
+	ctx->localityTables = NULL;
+	ctx->batch = NULL;
+	ctx->policyId = 0;
+	ctx->arrivals = NULL;
+	ctx->jobPool = NULL;
+	ctx->jobPoolCnt = 0;
+	ctx->jobPoolSize = 0;
+	return ctx;
+}
+
+void freeSimContext(SimContext* ctx) {
+	free(ctx->procCnt);
+	free(ctx->arrivalRate);
+	free(ctx->serverNeeds);
+	free(ctx->meanServiceTime);
+	for (uint8_t k = 0; k < ctx->resourceCnt; k ++) {
+		free(ctx->resourceNames[k]);
+	}
+	free(ctx->resourceNames);
+	free(ctx->resourceCapacity);
+	free(ctx->resourceDemand);
+	free(ctx->utilization);
+	free(ctx->profilePath);
+	if (ctx->profile != NULL) {
+		freeProfile(ctx->profile);
+	}
+	free(ctx->servicePath);
+	if (ctx->service != NULL) {
+		freeServiceModel(ctx->service);
+	}
+	free(ctx->tracePath);
+	free(ctx->feedName);
+	free(ctx->splitBounds);
+	free(ctx->splitLevels);
+	free(ctx->splitProbability);
+	free(ctx->cacheDir);
+	free(ctx->topologyPath);
+	if (ctx->topology != NULL) {
+		freeTopology(ctx->topology);
+	}
+	free(ctx);
+}
+
+SimContext* cloneSimContext(SimContext* ctx, unsigned long seed) {
+	SimContext* clone = (SimContext*)malloc(sizeof(SimContext));
+	*clone = *ctx;
+	clone->rng = gsl_rng_alloc(gsl_rng_default);
+	gsl_rng_set(clone->rng, seed);
+	clone->servers = (Server**)malloc(ctx->regionCnt*sizeof(Server*));
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		clone->servers[i] = cloneServer(ctx->servers[i]);
+	}
+	if (ctx->commonQueue != NULL) {
+		clone->commonQueue = cloneQueue(ctx->commonQueue);
+	}
+	clone->arrivals = (JobBuffer*)calloc(1, sizeof(JobBuffer));
+	clone->jobPool = NULL;
+	clone->jobPoolCnt = 0;
+	clone->jobPoolSize = 0;
+	return clone;
+}
+
+void freeSimContextClone(SimContext* clone) {
+	for (uint32_t i = 0; i < clone->regionCnt; i ++) {
+		freeServer(clone->servers[i]);
+	}
+	free(clone->servers);
+	if (clone->commonQueue != NULL) {
+		freeQueue(clone->commonQueue);
+	}
+	free(clone->arrivals->jobs);
+	free(clone->arrivals);
+	freeJobPool(clone);
+	gsl_rng_free(clone->rng);
+	free(clone);
+}
+
+int parseArgs(SimContext* ctx, int argc, const char* argv[]) {
+	// Resources are added once all options are parsed, as they depend on the
+	// dimensions
+	const char* resourceSpecs[RESOURCE_MAX];
+	uint32_t resourceSpecCnt = 0;
+	for (int i = 1; i < argc; i ++) {
+		if (strcmp(argv[i], "-t") == 0) {
+			if (i + 1 < argc) {
+				ctx->simulationTime = (uint32_t)atoi(argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "-n") == 0) {
+			if (i + 1 < argc) {
+				// One count for all servers, or one per region
+				uint32_t tokenCnt = 1;
+				for (const char* c = argv[i+1]; *c != '\0'; c ++) {
+					tokenCnt += (*c == ',');
+				}
+				if (tokenCnt == 1) {
+					uint32_t procCnt = (uint32_t)atoi(argv[i+1]);
+					for (uint32_t r = 0; r < ctx->regionCnt; r ++) {
+						ctx->procCnt[r] = procCnt;
+					}
+				} else if (tokenCnt == ctx->regionCnt) {
+					split(argv[i+1], ctx->procCnt, ctx->regionCnt, 0);
+				} else {
+					fprintf(stderr, "-n needs 1 or regionCnt processor counts\n");
+					return 1;
+				}
+			}
+		} else if (strcmp(argv[i], "-j") == 0) {
+			if (i + 1 < argc) {
+				ctx->jobTypeCnt = (uint8_t)atoi(argv[i+1]);
+				ctx->arrivalRate = (double*)realloc(ctx->arrivalRate, ctx->regionCnt*ctx->jobTypeCnt*sizeof(double));
+				ctx->serverNeeds = (uint32_t*)realloc(ctx->serverNeeds, ctx->jobTypeCnt*sizeof(uint32_t));
+			}
+		} else if (strcmp(argv[i], "-l") == 0) {
+			if (i + 1 < argc) {
+				split(argv[i+1], ctx->arrivalRate, ctx->regionCnt*ctx->jobTypeCnt, 1);
+			}
+		} else if (strcmp(argv[i], "-s") == 0) {
+			if (i + 1 < argc) {
+				split(argv[i+1], ctx->serverNeeds, ctx->jobTypeCnt, 0);
+			}
+		} else if (strcmp(argv[i], "-r") == 0) {
+			if (i + 1 < argc) {
+				ctx->regionCnt = (uint32_t)atoi(argv[i+1]);
+				ctx->arrivalRate = (double*)realloc(ctx->arrivalRate, ctx->regionCnt*ctx->jobTypeCnt*sizeof(double));
+				uint32_t procCnt = ctx->procCnt[0];
+				ctx->procCnt = (uint32_t*)realloc(ctx->procCnt, ctx->regionCnt*sizeof(uint32_t));
+				for (uint32_t r = 0; r < ctx->regionCnt; r ++) {
+					ctx->procCnt[r] = procCnt;
+				}
+				// Allocated by -a only, a topology needs no regionCnt^2 matrix
+				free(ctx->meanServiceTime);
+				ctx->meanServiceTime = NULL;
+			}
+		} else if (strcmp(argv[i], "-a") == 0) {
+			if (i + 1 < argc) {
+				if (ctx->meanServiceTime == NULL) {
+					ctx->meanServiceTime = (uint32_t*)malloc(ctx->regionCnt*ctx->regionCnt*sizeof(uint32_t));
+				}
+				split(argv[i+1], ctx->meanServiceTime, ctx->regionCnt*ctx->regionCnt, 0);
+			}
+		} else if (strcmp(argv[i], "-p") == 0) {
+			if (i + 1 < argc) {
+				strncpy(ctx->policy, argv[i+1], sizeof(ctx->policy)-1);
+				ctx->policy[sizeof(ctx->policy)-1] = '\0';
+			}
+		} else if (strcmp(argv[i], "-d") == 0) {
+			if (i + 1 < argc) {
+				ctx->sampleCnt = (uint32_t)atoi(argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "-w") == 0) {
+			ctx->localityWeighted = 1;
+		} else if (strcmp(argv[i], "-e") == 0) {
+			if (i + 1 < argc) {
+				ctx->seed = strtoull(argv[i+1], NULL, 10);
+				ctx->seeded = 1;
+			}
+		} else if (strcmp(argv[i], "-v") == 0) {
+			ctx->verbose = 1;
+		} else if (strcmp(argv[i], "--approx") == 0) {
+			if (i + 1 < argc) {
+				if (strcmp(argv[i+1], "fluid") == 0) {
+					ctx->approx = APPROX_FLUID;
+				} else if (strcmp(argv[i+1], "none") == 0) {
+					ctx->approx = APPROX_NONE;
+				} else {
+					fprintf(stderr, "Unknown approximation %s\n", argv[i+1]);
+					return 1;
+				}
+			}
+		} else if (strcmp(argv[i], "--plan") == 0) {
+			if (i + 1 < argc) {
+				const char* colon = strchr(argv[i+1], ':');
+				size_t length = (colon != NULL) ? (size_t)(colon-argv[i+1]) : 0;
+				if ((length == 4) && (strncmp(argv[i+1], "mean", length) == 0)) {
+					ctx->planMetric = PLAN_MEAN;
+				} else if ((length == 3) && (strncmp(argv[i+1], "p99", length) == 0)) {
+					ctx->planMetric = PLAN_P99;
+				} else {
+					fprintf(stderr, "Unknown plan target %s\n", argv[i+1]);
+					return 1;
+				}
+				ctx->planTarget = strtod(colon+1, NULL);
+			}
+		} else if (strcmp(argv[i], "--reps") == 0) {
+			if (i + 1 < argc) {
+				ctx->replicationCnt = (uint32_t)atoi(argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--vr") == 0) {
+			if (i + 1 < argc) {
+				if (strcmp(argv[i+1], "none") == 0) {
+					ctx->varianceMode = VR_NONE;
+				} else if (strcmp(argv[i+1], "antithetic") == 0) {
+					ctx->varianceMode = VR_ANTITHETIC;
+				} else if (strcmp(argv[i+1], "control") == 0) {
+					ctx->varianceMode = VR_CONTROL;
+				} else if (strcmp(argv[i+1], "both") == 0) {
+					ctx->varianceMode = VR_BOTH;
+				} else {
+					fprintf(stderr, "Unknown variance reduction %s\n", argv[i+1]);
+					return 1;
+				}
+			}
+		} else if (strcmp(argv[i], "--profile") == 0) {
+			if (i + 1 < argc) {
+				free(ctx->profilePath);
+				ctx->profilePath = (char*)malloc((strlen(argv[i+1])+1)*sizeof(char));
+				strcpy(ctx->profilePath, argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--service") == 0) {
+			if (i + 1 < argc) {
+				free(ctx->servicePath);
+				ctx->servicePath = (char*)malloc((strlen(argv[i+1])+1)*sizeof(char));
+				strcpy(ctx->servicePath, argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--trace") == 0) {
+			if (i + 1 < argc) {
+				free(ctx->tracePath);
+				ctx->tracePath = (char*)malloc((strlen(argv[i+1])+1)*sizeof(char));
+				strcpy(ctx->tracePath, argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--trace-sample") == 0) {
+			if (i + 1 < argc) {
+				ctx->traceSample = (uint32_t)atoi(argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--feed") == 0) {
+			if (i + 1 < argc) {
+				free(ctx->feedName);
+				ctx->feedName = (char*)malloc((strlen(argv[i+1])+1)*sizeof(char));
+				strcpy(ctx->feedName, argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--metrics-every") == 0) {
+			if (i + 1 < argc) {
+				ctx->metricsInterval = (uint32_t)atoi(argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--threads") == 0) {
+			if (i + 1 < argc) {
+				ctx->threadCnt = (uint32_t)atoi(argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--split") == 0) {
+			if (i + 1 < argc) {
+				free(ctx->splitBounds);
+				ctx->splitBounds = splitList(argv[i+1], &ctx->splitBoundCnt);
+			}
+		} else if (strcmp(argv[i], "--split-levels") == 0) {
+			if (i + 1 < argc) {
+				free(ctx->splitLevels);
+				ctx->splitLevels = splitList(argv[i+1], &ctx->splitLevelCnt);
+			}
+		} else if (strcmp(argv[i], "--split-factor") == 0) {
+			if (i + 1 < argc) {
+				ctx->splitFactor = (uint32_t)atoi(argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--resource") == 0) {
+			if (i + 1 < argc) {
+				if (resourceSpecCnt+1 == RESOURCE_MAX) {
+					fprintf(stderr, "At most %d resources including processors\n", RESOURCE_MAX);
+					return 1;
+				}
+				resourceSpecs[resourceSpecCnt ++] = argv[i+1];
+			}
+		} else if (strcmp(argv[i], "--packing") == 0) {
+			if (i + 1 < argc) {
+				if (strcmp(argv[i+1], "fastest") == 0) {
+					ctx->packing = PACK_FASTEST;
+				} else if (strcmp(argv[i+1], "dot") == 0) {
+					ctx->packing = PACK_DOT;
+				} else if (strcmp(argv[i+1], "bestfit") == 0) {
+					ctx->packing = PACK_BEST_FIT;
+				} else {
+					fprintf(stderr, "Unknown packing %s\n", argv[i+1]);
+					return 1;
+				}
+			}
+		} else if (strcmp(argv[i], "--cache") == 0) {
+			if (i + 1 < argc) {
+				free(ctx->cacheDir);
+				ctx->cacheDir = (char*)malloc((strlen(argv[i+1])+1)*sizeof(char));
+				strcpy(ctx->cacheDir, argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "--topology") == 0) {
+			if (i + 1 < argc) {
+				free(ctx->topologyPath);
+				ctx->topologyPath = (char*)malloc((strlen(argv[i+1])+1)*sizeof(char));
+				strcpy(ctx->topologyPath, argv[i+1]);
+			}
+		} else if (strcmp(argv[i], "-h") == 0) {
+			printf("MultiServerSimulator\nOptions:\n");
+			printf("%-20s Show this help message.\n", "-h");
+			printf("%-20s Specify policy from fcfsLocal, fcfsCross, fcfsCrossPart, o3CrossPart, jsq, jsqPart, jsqMaxweight, jsqD, jsqDPart, jsqBatch, jsqBatchPart, jsqMaxweightCross, backfill, backfillCross. default fcfsLocal\n", "-p");
+			printf("%-20s Specify a simulation iteration of time units. default 100000\n", "-t time");
+			printf("%-20s Specify number of processors for each server. Either one num for all servers, or regionCnt values separated by a comma (`,` with no spaces) where the ith entry is for the server in the ith region. A list must be set after -r. default 48\n", "-n [num...]");
+			printf("%-20s Specify job type count as jobCnt. Must be set before (and together with) -l and -s. default 2\n", "-j jobCnt");
+			printf("%-20s Specify arrival rate. Must be set together with -j. lambda must have size of regionCnt*jobCnt and is separated by a comma (`,` with no spaces). This represents a 2d array in a 1d array format, where the (i*regionCnt+j)th entry means the arrival rate of job type j for the server in the ith region. default 10,4,10,4\n", "-l [lambda...]");
+			printf("%-20s Specify server needs. Must be set together with -j. servers must have size of jobCnt and is separated by a comma (`,` with no spaces). default 1,4\n", "-s [servers...]");
+			printf("%-20s Specify region number as regionCnt. Must be set before (and together with) -a. Must be set before -l. default 2\n", "-r regionCnt");
+			printf("%-20s Specify mean service time across regions. Must be set together with -r. serviceTime must have size of regionCnt^2 and is separated by a comma (`,` with no spaces). This represents a 2d array in a 1d array format, where the (i*regionCnt+j)th entry means the mean service time for the server in the ith region to serve the job from the jth region. default 1,2,2,1\n", "-a [serviceTime...]");
+			printf("%-20s Take mean service times from the topology in file (per-level times for regions, datacenters and zones, plus sparse pairs, see inc/topology.h) instead of -a. Needs no regionCnt^2 matrix.\n", "--topology file");
+			printf("%-20s Add a resource besides processors (e.g. memory, up to %d in all) with a capacity per server (one value, or regionCnt values separated by a comma) and a demand per job type. A job starts only where all its demands fit, see inc/resource.h. Utilization of every resource is printed after the results.\n", "--resource name:c:d", RESOURCE_MAX);
+			printf("%-20s Pick the remote server of fcfsCross, fcfsCrossPart and o3CrossPart by fastest (smallest mean service time), dot (largest dot product of demand and idle resources) or bestfit (least resources left over). default fastest\n", "--packing mode");
+			printf("%-20s Specify number of regions sampled for each arrival by jsqD, jsqDPart and jsqMaxweightCross as d. default 2\n", "-d d");
+			printf("%-20s Sample regions for jsqD, jsqDPart and jsqMaxweightCross with probability proportional to 1/serviceTime instead of uniformly.\n", "-w");
+			printf("%-20s Specify rng seed. default a random seed from rdrand\n", "-e seed");
+			printf("%-20s Run simulation verbosely.\n", "-v");
+			printf("%-20s Scale arrival rates over time by the profile in file (piecewise or sine per region, see inc/profile.h). default constant rates\n", "--profile file");
+			printf("%-20s Draw service times from the distributions in file (exponential, deterministic, lognormal, pareto, hyperexp or empirical per region and job type, see inc/service.h). default exponential\n", "--service file");
+			printf("%-20s Approximate instead of simulating. fluid iterates the deterministic mean-field limit of the model, which takes milliseconds and is meant to screen a sweep before running the simulator. default none\n", "--approx mode");
+			printf("%-20s Record arrive, enqueue, cross-region assign, start and finish events of jobs to a binary file, decoded by scripts/trace.py (see inc/trace.h). Needs a build with make TRACE=1\n", "--trace file");
+			printf("%-20s Trace one arrival in n. default 1\n", "--trace-sample n");
+			printf("%-20s Read arrivals from the shared memory feed name (e.g. /mss) written by a live dispatcher or by obj/feedgen instead of drawing them, see inc/feed.h. The run ends when the producer closes the feed or after -t time units.\n", "--feed name");
+			printf("%-20s Print queue length, queueing delay, 99th percentile delay and arrivals (count and per second of wall clock) of every n time units while running. default 0 (none)\n", "--metrics-every n");
+			printf("%-20s Run one simulation on n threads, regions sharded across them (fcfsLocal, fcfsCross, fcfsCrossPart, jsq and jsqPart). Results depend on the seed only, not on n, but differ from a run without --threads (see inc/shard.h). default 0 (one thread, not sharded)\n", "--threads n");
+			printf("%-20s Estimate P(delay > b) for every bound b by multilevel splitting (RESTART) on the backlog, for tails too rare for a plain run, see inc/splitting.h. Prints the probabilities after the results. Needs --split-levels.\n", "--split b,...");
+			printf("%-20s Increasing backlog thresholds (jobs waiting in all queues) at which runs are split\n", "--split-levels l,...");
+			printf("%-20s Runs per threshold crossing, the one crossing included. default %d\n", "--split-factor f", SPLIT_DEFAULT_FACTOR);
+			printf("%-20s Keep results of seeded runs in directory dir (created if missing) and return them without simulating when the same run is asked again. A run of more time units resumes from the end state of a shorter one. Entries are keyed by all parameters, file contents and the build, see inc/cache.h. Needs -e.\n", "--cache dir");
+			printf("%-20s Run n replications seeded seed, seed+1, ... and print the mean of their results. default 1\n", "--reps n");
+			printf("%-20s Combine replications by antithetic pairs (every replication runs twice, arrivals and service times of the second run mirror the first), a control variate on the offered work (at least 5 replications), or both, and print the variance reduction factors of queue length and delay after the results (see inc/variance.h). default none\n", "--vr mode");
+			printf("%-20s Search the smallest processor count of each region meeting a target queueing delay instead of running once. target is mean:value or p99:value (99th percentile), see inc/plan.h. Prints the counts found before the results.\n", "--plan target");
+			return 1;
+		}
+	}
+#ifndef MSS_TRACE
+	if (ctx->tracePath != NULL) {
+		fprintf(stderr, "Tracing is not compiled in, rebuild with make TRACE=1\n");
+		return 1;
+	}
+#endif
+	if (((ctx->varianceMode != VR_NONE) || (ctx->replicationCnt > 1)) && ((ctx->approx == APPROX_FLUID) || (ctx->planMetric != PLAN_NONE))) {
+		fprintf(stderr, "Replications do not combine with --approx or --plan\n");
+		return 1;
+	}
+	if ((ctx->feedName != NULL) && ((ctx->varianceMode != VR_NONE) || (ctx->replicationCnt > 1) || (ctx->approx == APPROX_FLUID) || (ctx->planMetric != PLAN_NONE))) {
+		fprintf(stderr, "--feed does not combine with replications, --approx or --plan\n");
+		return 1;
+	}
+	if (ctx->threadCnt > 0) {
+		if (!shardable(getPolicyId(ctx->policy))) {
+			fprintf(stderr, "Policy %s cannot run sharded, --threads supports fcfsLocal, fcfsCross, fcfsCrossPart, jsq and jsqPart\n", ctx->policy);
+			return 1;
+		}
+		if ((ctx->feedName != NULL) || (ctx->tracePath != NULL) || (ctx->metricsInterval > 0) || (ctx->varianceMode != VR_NONE)) {
+			fprintf(stderr, "--threads does not combine with --feed, --trace, --metrics-every or --vr\n");
+			return 1;
+		}
+	}
+	if (ctx->splitBounds != NULL) {
+		if ((ctx->splitLevels == NULL) || (ctx->splitFactor < 2)) {
+			fprintf(stderr, "--split needs --split-levels and a --split-factor of at least 2\n");
+			return 1;
+		}
+		for (uint32_t k = 0; k < ctx->splitLevelCnt; k ++) {
+			if ((ctx->splitLevels[k] == 0) || ((k > 0) && (ctx->splitLevels[k] <= ctx->splitLevels[k-1]))) {
+				fprintf(stderr, "--split-levels must be positive and increasing\n");
+				return 1;
+			}
+		}
+		if (!splittable(getPolicyId(ctx->policy))) {
+			fprintf(stderr, "Policy %s cannot be split, its scheduling state is not cloned\n", ctx->policy);
+			return 1;
+		}
+		if ((ctx->profilePath != NULL) || (ctx->feedName != NULL) || (ctx->tracePath != NULL) || (ctx->threadCnt > 0) || (ctx->metricsInterval > 0) || (ctx->varianceMode != VR_NONE) || (ctx->replicationCnt > 1) || (ctx->planMetric != PLAN_NONE) || (ctx->approx != APPROX_NONE)) {
+			fprintf(stderr, "--split does not combine with --profile, --feed, --trace, --threads, --metrics-every, replications, --plan or --approx\n");
+			return 1;
+		}
+		free(ctx->splitProbability);
+		ctx->splitProbability = (double*)calloc(ctx->splitBoundCnt, sizeof(double));
+	}
+	// Added again if parsed again
+	for (uint8_t k = 1; k < ctx->resourceCnt; k ++) {
+		free(ctx->resourceNames[k]);
+	}
+	ctx->resourceCnt = 1;
+	for (uint32_t k = 0; k < resourceSpecCnt; k ++) {
+		if (addResource(ctx, resourceSpecs[k])) {
+			return 1;
+		}
+	}
+	// --plan sets processor counts of its own, at least every server need
+	if (checkDemands(ctx, ctx->planMetric == PLAN_NONE)) {
+		return 1;
+	}
+	if ((ctx->resourceCnt > 1) || (ctx->packing != PACK_FASTEST)) {
+		uint8_t policyId = getPolicyId(ctx->policy);
+		if ((ctx->resourceCnt > 1) && ((policyId == POLICY_BACKFILL) || (policyId == POLICY_BACKFILL_CROSS))) {
+			fprintf(stderr, "Policy %s reserves processors only and does not take --resource\n", ctx->policy);
+			return 1;
+		}
+		if ((ctx->threadCnt > 0) || (ctx->approx != APPROX_NONE)) {
+			fprintf(stderr, "--resource and --packing do not combine with --threads or --approx\n");
+			return 1;
+		}
+	}
+	if (ctx->cacheDir != NULL) {
+		if (!ctx->seeded) {
+			fprintf(stderr, "--cache needs a seed (-e), runs seeded by rdrand are never repeated\n");
+			return 1;
+		}
+		if ((ctx->feedName != NULL) || (ctx->tracePath != NULL) || (ctx->metricsInterval > 0) || (ctx->splitBounds != NULL) || (ctx->approx != APPROX_NONE)) {
+			fprintf(stderr, "--cache does not combine with --feed, --trace, --metrics-every, --split or --approx\n");
+			return 1;
+		}
+	}
+	if ((ctx->planMetric == PLAN_P99) && (ctx->approx == APPROX_FLUID)) {
+		fprintf(stderr, "The fluid approximation has no p99 delay to plan for\n");
+		return 1;
+	}
+	if (ctx->profilePath != NULL) {
+		// Loaded after all options, as files depend on the dimensions
+		if (ctx->profile != NULL) {
+			freeProfile(ctx->profile);
+		}
+		ctx->profile = loadProfile(ctx->profilePath, ctx->regionCnt);
+		if (ctx->profile == NULL) {
+			return 1;
+		}
+	}
+	if (ctx->servicePath != NULL) {
+		if (ctx->service != NULL) {
+			freeServiceModel(ctx->service);
+		}
+		ctx->service = loadServiceModel(ctx->servicePath, ctx->regionCnt, ctx->jobTypeCnt);
+		if (ctx->service == NULL) {
+			return 1;
+		}
+	}
+	if (ctx->topologyPath != NULL) {
+		if (ctx->topology != NULL) {
+			freeTopology(ctx->topology);
+		}
+		ctx->topology = loadTopology(ctx->topologyPath, ctx->regionCnt);
+		if (ctx->topology == NULL) {
+			return 1;
+		}
+	} else if (ctx->meanServiceTime == NULL) {
+		fprintf(stderr, "Mean service times (-a or --topology) must be set together with -r\n");
+		return 1;
+	}
+	if (ctx->service != NULL) {
+		capServiceTimes(ctx);
+	}
+	return 0;
+}
+
+uint32_t getProcCnt(SimContext* ctx, uint32_t* procCnt) {
+	if (procCnt != NULL) {
+		memcpy(procCnt, ctx->procCnt, ctx->regionCnt*sizeof(uint32_t));
+	}
+	return ctx->regionCnt;
+}
+
+void printSimContext(SimContext* ctx) {
+	printf("Running with parameters:\n");
+	printf("Simulation time units: %d\n", ctx->simulationTime);
+	printf("Processor count per server: ");
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		printf("%d ", ctx->procCnt[i]);
+	}
+	printf("\n");
+	printf("Job type count: %d\n", ctx->jobTypeCnt);
+	printf("Arriving rate: ");
+	for (uint32_t i = 0; i < ctx->regionCnt*ctx->jobTypeCnt; i ++) {
+		printf("%lf ", ctx->arrivalRate[i]);
+	}
+	printf("\n");
+	printf("Server needs: ");
+	for (uint8_t i = 0; i < ctx->jobTypeCnt; i ++) {
+		printf("%d ", ctx->serverNeeds[i]);
+	}
+	printf("\n");
+	if (ctx->topologyPath != NULL) {
+		printf("Mean service time topology: %s\n", ctx->topologyPath);
+	} else {
+		printf("Mean service time across servers: ");
+		for (uint32_t i = 0; i < ctx->regionCnt*ctx->regionCnt; i ++) {
+			printf("%d ", ctx->meanServiceTime[i]);
+		}
+		printf("\n");
+	}
+	for (uint8_t k = 1; k < ctx->resourceCnt; k ++) {
+		printf("Capacity of %s per server: ", ctx->resourceNames[k]);
+		for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+			printf("%d ", ctx->resourceCapacity[(k-1)*ctx->regionCnt+i]);
+		}
+		printf("\n");
+		printf("Demand of %s per job type: ", ctx->resourceNames[k]);
+		for (uint8_t j = 0; j < ctx->jobTypeCnt; j ++) {
+			printf("%d ", ctx->resourceDemand[(k-1)*ctx->jobTypeCnt+j]);
+		}
+		printf("\n");
+	}
+	printf("Policy: %s\n", ctx->policy);
+	if (ctx->packing != PACK_FASTEST) {
+		printf("Packing: %s\n", packingName(ctx->packing));
+	}
+	if ((strcmp(ctx->policy, "jsqD") == 0) || (strcmp(ctx->policy, "jsqDPart") == 0)) {
+		printf("Sampled regions per arrival: %d%s\n", ctx->sampleCnt, ctx->localityWeighted ? " (locality weighted)" : "");
+	}
+	if (ctx->profilePath != NULL) {
+		printf("Arrival rate profile: %s\n", ctx->profilePath);
+	}
+	if (ctx->servicePath != NULL) {
+		printf("Service time distributions: %s\n", ctx->servicePath);
+	}
+	if (ctx->approx == APPROX_FLUID) {
+		printf("Approximation: fluid\n");
+	}
+	if (ctx->tracePath != NULL) {
+		printf("Trace: %s (one arrival in %d)\n", ctx->tracePath, ctx->traceSample);
+	}
+	if (ctx->feedName != NULL) {
+		printf("Arrival feed: %s\n", ctx->feedName);
+	}
+	if (ctx->threadCnt > 0) {
+		printf("Threads: %d (regions sharded)\n", ctx->threadCnt);
+	}
+	if (ctx->splitBounds != NULL) {
+		printf("Splitting bounds:");
+		for (uint32_t k = 0; k < ctx->splitBoundCnt; k ++) {
+			printf(" %d", ctx->splitBounds[k]);
+		}
+		printf(", backlog thresholds:");
+		for (uint32_t k = 0; k < ctx->splitLevelCnt; k ++) {
+			printf(" %d", ctx->splitLevels[k]);
+		}
+		printf(", factor %d\n", ctx->splitFactor);
+	}
+	if (ctx->cacheDir != NULL) {
+		printf("Result cache: %s\n", ctx->cacheDir);
+	}
+	if (ctx->metricsInterval > 0) {
+		printf("Rolling metrics every %d time units\n", ctx->metricsInterval);
+	}
+	if ((ctx->varianceMode != VR_NONE) || (ctx->replicationCnt > 1)) {
+		printf("Replications: %d, variance reduction: %s\n", ctx->replicationCnt, varianceModeName(ctx->varianceMode));
+	}
+	if (ctx->planMetric != PLAN_NONE) {
+		printf("Plan target: %s delay %lf\n", (ctx->planMetric == PLAN_MEAN) ? "mean" : "p99", ctx->planTarget);
+	}
+}
+
+/**
+* Smallest delay not exceeded by 99% of the cnt jobs counted in histogram,
+* less those counted in base if not NULL
+*/
+static uint32_t p99Delay(const uint32_t* histogram, const uint32_t* base, uint64_t cnt) {
+	uint32_t delay = 0;
+	uint64_t belowCnt = histogram[0]-((base != NULL) ? base[0] : 0);
+	while ((delay+1 < DELAY_HISTOGRAM_SIZE) && (100*belowCnt < 99*cnt)) {
+		delay ++;
+		belowCnt += histogram[delay]-((base != NULL) ? base[delay] : 0);
+	}
+	return delay;
+}
+
+/**
+* Rolling metrics of the time units since start
+* @param histogram Copy of ctx->delayHistogram at start
+* @param clock Wall clock at start
+*/
+typedef struct Metrics {
+	uint32_t start;
+	uint64_t queueLength;
+	uint64_t arrivalCnt;
+	uint32_t departedJobCnt;
+	uint32_t departedJobDelay;
+	uint32_t* histogram;
+	struct timespec clock;
+} Metrics;
+
+/**
+* Departed job count and delay summed over servers
+*/
+static void sumDeparted(SimContext* ctx, uint32_t* cnt, uint32_t* delay) {
+	*cnt = 0;
+	*delay = 0;
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		*cnt += ctx->servers[i]->departedJobCnt;
+		*delay += ctx->servers[i]->departedJobDelay;
+	}
+}
+
+static void startMetrics(SimContext* ctx, Metrics* metrics, uint32_t start) {
+	metrics->start = start;
+	metrics->queueLength = 0;
+	metrics->arrivalCnt = ctx->arrivalCnt;
+	sumDeparted(ctx, &metrics->departedJobCnt, &metrics->departedJobDelay);
+	memcpy(metrics->histogram, ctx->delayHistogram, DELAY_HISTOGRAM_SIZE*sizeof(uint32_t));
+	clock_gettime(CLOCK_MONOTONIC, &metrics->clock);
+}
+
+/**
+* Print the metrics of the time units from start to end (excluded) and flush,
+* so that they can be followed through a pipe
+*/
+static void printMetrics(SimContext* ctx, Metrics* metrics, uint32_t end) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double seconds = (double)(now.tv_sec-metrics->clock.tv_sec)+1e-9*(double)(now.tv_nsec-metrics->clock.tv_nsec);
+	uint32_t departedJobCnt, departedJobDelay;
+	sumDeparted(ctx, &departedJobCnt, &departedJobDelay);
+	departedJobCnt -= metrics->departedJobCnt;
+	departedJobDelay -= metrics->departedJobDelay;
+	double queueLength = (double)metrics->queueLength/(end-metrics->start);
+	double delay = (double)departedJobDelay/departedJobCnt;
+	uint32_t p99 = p99Delay(ctx->delayHistogram, metrics->histogram, departedJobCnt);
+	uint64_t arrivalCnt = ctx->arrivalCnt-metrics->arrivalCnt;
+	double rate = (seconds > 0) ? (double)arrivalCnt/seconds : 0;
+	if (ctx->verbose) {
+		printf("Time units %d-%d: queue length %lf, queueing delay %lf, 99th percentile %d, arrivals %lu (%.0lf/s)\n", metrics->start+1, end, queueLength, delay, p99, arrivalCnt, rate);
+	} else {
+		printf("metrics %d %lf %lf %d %lu %.0lf\n", end, queueLength, delay, p99, arrivalCnt, rate);
+	}
+	fflush(stdout);
+}
+
+int runSimulation(SimContext* ctx, double* result) {
+	if (ctx->approx == APPROX_FLUID) {
+		runFluid(ctx, result);
+		return 0;
+	}
+
+	// Generate seed
+	if (!ctx->seeded) {
+		uint32_t seed;
+		_rdrand32_step(&seed);
+		ctx->seed = seed;
+	}
+	if ((ctx->cacheDir != NULL) && readCachedResult(ctx, result)) {
+		return 0;
+	}
+	if (ctx->tracePath != NULL) {
+		ctx->trace = openTrace(ctx);
+		if (ctx->trace == NULL) {
+			return 1;
+		}
+	}
+
+	// Init rng
+	ctx->rng = gsl_rng_alloc(gsl_rng_default);
+	gsl_rng_set(ctx->rng, (unsigned long)ctx->seed);
+	ctx->antitheticTick = 0;
+
+	// Start simulation
+	if (ctx->verbose) {
+		printf("Start simulation\n");
+	}
+	// Create servers
+	ctx->servers = (Server**)malloc(ctx->regionCnt*sizeof(Server*));
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		ctx->servers[i] = newServer(i, ctx->procCnt[i]);
+	}
+	ctx->delayHistogram = (uint32_t*)calloc(DELAY_HISTOGRAM_SIZE, sizeof(uint32_t));
+	initResources(ctx);
+	initPolicy(ctx);
+	initArrivalRate(ctx);
+	if (ctx->varianceMode & VR_CONTROL) {
+		initWorkRate(ctx);
+	}
+	ctx->offeredWork = 0;
+	ctx->meanOfferedWork = 0;
+	ctx->arrivalCnt = 0;
+	Metrics metrics;
+	metrics.histogram = NULL;
+	if (ctx->metricsInterval > 0) {
+		metrics.histogram = (uint32_t*)malloc(DELAY_HISTOGRAM_SIZE*sizeof(uint32_t));
+		startMetrics(ctx, &metrics, 0);
+	}
+	// Simulate by time units
+	double expectedQueueLength = 0;
+	uint32_t timestamp = 0;
+	if (ctx->threadCnt > 0) {
+		// All time units at once, see shard.h
+		expectedQueueLength = runShards(ctx);
+		timestamp = ctx->simulationTime;
+	} else if (ctx->splitBounds != NULL) {
+		expectedQueueLength = runSplitting(ctx);
+		timestamp = ctx->simulationTime;
+	} else if (ctx->cacheDir != NULL) {
+		// From the end of a shorter cached run, if any
+		timestamp = resumeCachedState(ctx, &expectedQueueLength);
+	}
+	for (; timestamp < ctx->simulationTime; timestamp ++) {
+		if ((ctx->feed != NULL) && endOfFeed(ctx->feed)) break;
+		if (ctx->verbose) printf("%d/%d\r", timestamp+1, ctx->simulationTime);
+		updateArrivalRate(ctx, timestamp);
+		if (ctx->workRate != NULL) {
+			ctx->meanOfferedWork += meanWorkRate(ctx);
+		}
+		TRACE_TICK(ctx, timestamp);
+		uint32_t queueLength;
+		if (ctx->commonQueue != NULL) {
+			queueLength = schedule(ctx)/(ctx->regionCnt+1);
+		} else {
+			queueLength = schedule(ctx)/ctx->regionCnt;
+		}
+		expectedQueueLength += queueLength;
+		if (metrics.histogram != NULL) {
+			metrics.queueLength += queueLength;
+			if ((timestamp+1-metrics.start) == ctx->metricsInterval) {
+				printMetrics(ctx, &metrics, timestamp+1);
+				startMetrics(ctx, &metrics, timestamp+1);
+			}
+		}
+	}
+	free(metrics.histogram);
+	double queueLengthSum = expectedQueueLength;
+	// A feed closed before the first time unit leaves nothing to average
+	expectedQueueLength = (timestamp > 0) ? expectedQueueLength/timestamp : 0;
+	// For the queueing delay metric, only count jobs that already departed,
+	// since those still in the queue have unknown final waitTime.
+	uint32_t sumDepartedJobCnt, sumDepartedJobDelay;
+	sumDeparted(ctx, &sumDepartedJobCnt, &sumDepartedJobDelay);
+	double expectedJobDelay = (double)sumDepartedJobDelay/sumDepartedJobCnt;
+	// Smallest delay not exceeded by 99% of departed jobs, NaN like the mean
+	// delay if none departed
+	double p99JobDelay = (sumDepartedJobCnt > 0) ? (double)p99Delay(ctx->delayHistogram, NULL, sumDepartedJobCnt) : NAN;
+	if (ctx->verbose) {
+		printf("\n");
+		printf("Stop simulation\n");
+	}
+	result[0] = expectedQueueLength;
+	result[1] = expectedJobDelay;
+	result[2] = p99JobDelay;
+	sumUtilization(ctx, timestamp);
+	if (ctx->cacheDir != NULL) {
+		writeCache(ctx, result, timestamp, queueLengthSum);
+	}
+
+	// Cleanup
+	if (ctx->trace != NULL) {
+		closeTrace(ctx->trace);
+		ctx->trace = NULL;
+	}
+	if (ctx->workRate != NULL) {
+		freeWorkRate(ctx);
+	}
+	freeArrivalRate(ctx);
+	freePolicy(ctx);
+	freeResources(ctx);
+	for (uint32_t i = 0; i < ctx->regionCnt; i ++) {
+		freeServer(ctx->servers[i]);
+	}
+	free(ctx->servers);
+	ctx->servers = NULL;
+	free(ctx->delayHistogram);
+	ctx->delayHistogram = NULL;
+	freeJobPool(ctx);
+	gsl_rng_free(ctx->rng);
+	ctx->rng = NULL;
+	return 0;
+}
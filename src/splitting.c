@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "splitting.h"
+#include "simulation.h"
+#include "server.h"
+#include "policy.h"
+
+/**
+* State of a split run
+* @param main Context of the main run, retrials are cloned from it
+* @param queueCnt Queues the backlog is averaged over (regionCnt, plus the
+* common queue if any)
+* @param histograms Delay histograms by level, those of the main run first,
+* then those of retrials
+* @param retrialCnt Retrials started so far
+* @param retrialUnits Time units run by retrials
+* @param queueLengthSum Sum over time units of the queue length per region of
+* the main run
+*/
+typedef struct Splitting {
+	SimContext* main;
+	uint32_t queueCnt;
+	uint32_t** histograms;
+	uint64_t retrialCnt;
+	uint64_t retrialUnits;
+	double queueLengthSum;
+} Splitting;
+
+uint8_t splittable(uint8_t policyId) {
+	return (
+		(policyId != POLICY_JSQ_MAXWEIGHT_CROSS) &&
+		(policyId != POLICY_BACKFILL) &&
+		(policyId != POLICY_BACKFILL_CROSS)
+	);
+}
+
+/**
+* Seed of the rng of a retrial, splitmix64 of (seed, index)
+*/
+static unsigned long retrialSeed(uint64_t seed, uint64_t index) {
+	uint64_t z = seed+index*0x9E3779B97F4A7C15ull;
+	z = (z^(z >> 30))*0xBF58476D1CE4E5B9ull;
+	z = (z^(z >> 27))*0x94D049BB133111EBull;
+	return (unsigned long)(z^(z >> 31));
+}
+
+/**
+* Level of a backlog, the number of thresholds it reaches
+*/
+static uint32_t levelOf(SimContext* ctx, uint32_t backlog) {
+	uint32_t level = 0;
+	while ((level < ctx->splitLevelCnt) && (backlog >= ctx->splitLevels[level])) {
+		level ++;
+	}
+	return level;
+}
+
+/**
+* Run ctx from timestamp to the end of the simulation, or until its backlog
+* falls below threshold bornLevel (never for the main run, born at level 0)
+* Retrials are cloned and run first for every threshold above fromLevel that
+* backlog reaches, then for every threshold crossed upwards later on.
+*/
+static void runSplit(Splitting* sp, SimContext* ctx, uint32_t timestamp, uint32_t bornLevel, uint32_t fromLevel, uint32_t backlog) {
+	uint8_t isMain = (ctx == sp->main);
+	uint32_t level = levelOf(ctx, backlog);
+	for (;;) {
+		for (uint32_t k = fromLevel+1; k <= level; k ++) {
+			for (uint32_t c = 1; c < ctx->splitFactor; c ++) {
+				sp->retrialCnt ++;
+				SimContext* retrial = cloneSimContext(ctx, retrialSeed(ctx->seed, sp->retrialCnt));
+				runSplit(sp, retrial, timestamp, k, k, backlog);
+				freeSimContextClone(retrial);
+			}
+		}
+		if (timestamp == ctx->simulationTime) break;
+		// Jobs started in this time unit count with the weight of its level
+		ctx->delayHistogram = sp->histograms[(isMain ? 0 : ctx->splitLevelCnt+1)+level];
+		if (isMain && ctx->verbose) printf("%d/%d\r", timestamp+1, ctx->simulationTime);
+		updateArrivalRate(ctx, timestamp);
+		backlog = schedule(ctx);
+		if (isMain) {
+			sp->queueLengthSum += backlog/sp->queueCnt;
+		} else {
+			sp->retrialUnits ++;
+		}
+		timestamp ++;
+		fromLevel = level;
+		level = levelOf(ctx, backlog);
+		if (level < bornLevel) break;
+	}
+}
+
+double runSplitting(SimContext* ctx) {
+	uint32_t levelCnt = ctx->splitLevelCnt+1;
+	Splitting sp;
+	sp.main = ctx;
+	sp.queueCnt = ctx->regionCnt+((ctx->commonQueue != NULL) ? 1 : 0);
+	sp.histograms = (uint32_t**)malloc(2*levelCnt*sizeof(uint32_t*));
+	for (uint32_t l = 0; l < 2*levelCnt; l ++) {
+		sp.histograms[l] = (uint32_t*)calloc(DELAY_HISTOGRAM_SIZE, sizeof(uint32_t));
+	}
+	sp.retrialCnt = 0;
+	sp.retrialUnits = 0;
+	sp.queueLengthSum = 0;
+	uint32_t* histogram = ctx->delayHistogram;
+	runSplit(&sp, ctx, 0, 0, 0, 0);
+	ctx->delayHistogram = histogram;
+	// Weighted count of delays over each bound, the main run by itself for
+	// comparison
+	uint64_t jobCnt = 0;
+	double* mainProbability = (double*)calloc(ctx->splitBoundCnt, sizeof(double));
+	for (uint32_t k = 0; k < ctx->splitBoundCnt; k ++) {
+		ctx->splitProbability[k] = 0;
+	}
+	double weight = 1;
+	for (uint32_t l = 0; l < levelCnt; l ++) {
+		uint32_t* mainHistogram = sp.histograms[l];
+		uint32_t* retrialHistogram = sp.histograms[levelCnt+l];
+		for (uint32_t d = 0; d < DELAY_HISTOGRAM_SIZE; d ++) {
+			histogram[d] += mainHistogram[d];
+			jobCnt += mainHistogram[d];
+			for (uint32_t k = 0; k < ctx->splitBoundCnt; k ++) {
+				if (d <= ctx->splitBounds[k]) continue;
+				ctx->splitProbability[k] += weight*(mainHistogram[d]+retrialHistogram[d]);
+				mainProbability[k] += mainHistogram[d];
+			}
+		}
+		weight /= ctx->splitFactor;
+	}
+	for (uint32_t k = 0; k < ctx->splitBoundCnt; k ++) {
+		ctx->splitProbability[k] = (jobCnt > 0) ? ctx->splitProbability[k]/(double)jobCnt : 0;
+		mainProbability[k] = (jobCnt > 0) ? mainProbability[k]/(double)jobCnt : 0;
+	}
+	if (ctx->verbose) {
+		printf("\n");
+		printf("Retrials: %lu, %lu time units (%lf times the main run)\n", sp.retrialCnt, sp.retrialUnits, (double)sp.retrialUnits/ctx->simulationTime);
+		for (uint32_t k = 0; k < ctx->splitBoundCnt; k ++) {
+			printf("P(delay > %d) by the main run alone: %e\n", ctx->splitBounds[k], mainProbability[k]);
+		}
+	}
+	free(mainProbability);
+	for (uint32_t l = 0; l < 2*levelCnt; l ++) {
+		free(sp.histograms[l]);
+	}
+	free(sp.histograms);
+	return sp.queueLengthSum;
+}
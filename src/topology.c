@@ -0,0 +1,289 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "topology.h"
+
+#define TOPOLOGY_LINE_SIZE 4096
+#define TOPOLOGY_UNSET UINT32_MAX
+
+static const char* levelNames[TOPOLOGY_LEVEL_CNT] = {"local", "datacenter", "zone", "remote"};
+
+/**
+* Parse an unsigned integer token below limit into value, returns 0 on success
+*/
+static int parseIndex(const char* token, uint32_t limit, uint32_t* value) {
+	if (token == NULL) return 1;
+	char* end;
+	unsigned long v = strtoul(token, &end, 10);
+	if ((end == token) || (*end != '\0') || (v >= limit)) return 1;
+	*value = (uint32_t)v;
+	return 0;
+}
+
+/**
+* Insert an overridden pair, doubling the table when it gets half full
+*/
+static void insertPair(Topology* topology, uint64_t key, uint32_t time) {
+	if (2*(topology->pairCnt+1) > topology->pairMask+1) {
+		uint64_t* keys = topology->pairKeys;
+		uint32_t* times = topology->pairTimes;
+		uint64_t size = topology->pairMask+1;
+		topology->pairMask = (size << 1)-1;
+		topology->pairKeys = (uint64_t*)calloc(size << 1, sizeof(uint64_t));
+		topology->pairTimes = (uint32_t*)malloc((size << 1)*sizeof(uint32_t));
+		topology->pairCnt = 0;
+		for (uint64_t i = 0; i < size; i ++) {
+			if (keys[i] != 0) insertPair(topology, keys[i], times[i]);
+		}
+		free(keys);
+		free(times);
+	}
+	uint64_t i = topologyHash(key, topology->pairMask);
+	while ((topology->pairKeys[i] != 0) && (topology->pairKeys[i] != key)) {
+		i = (i+1) & topology->pairMask;
+	}
+	if (topology->pairKeys[i] == 0) topology->pairCnt ++;
+	topology->pairKeys[i] = key;
+	topology->pairTimes[i] = time;
+}
+
+/**
+* Parse one line, returns 0 on success
+*/
+static int parseLine(Topology* topology, char* line) {
+	uint32_t regionCnt = topology->regionCnt;
+	// strtok_r, topologies may be loaded on several threads through libmss.so
+	char* save;
+	char* key = strtok_r(line, " \t\r\n", &save);
+	if (key == NULL) return 0;
+	for (uint8_t level = 0; level < TOPOLOGY_LEVEL_CNT; level ++) {
+		if (strcmp(key, levelNames[level]) == 0) {
+			return parseIndex(strtok_r(NULL, " \t\r\n", &save), UINT32_MAX, &topology->levelTime[level]) ||
+				(topology->levelTime[level] == 0);
+		}
+	}
+	if (strcmp(key, "pair") == 0) {
+		uint32_t server, origin, time;
+		if (
+			parseIndex(strtok_r(NULL, " \t\r\n", &save), regionCnt, &server) ||
+			parseIndex(strtok_r(NULL, " \t\r\n", &save), regionCnt, &origin) ||
+			parseIndex(strtok_r(NULL, " \t\r\n", &save), UINT32_MAX, &time) ||
+			(time == 0)
+		) {
+			return 1;
+		}
+		insertPair(topology, (uint64_t)server*regionCnt+origin+1, time);
+		return 0;
+	}
+	uint32_t first, last, datacenter, zone;
+	char* dash = strchr(key, '-');
+	if (dash != NULL) *dash = '\0';
+	if (
+		parseIndex(key, regionCnt, &first) ||
+		parseIndex((dash != NULL) ? dash+1 : key, regionCnt, &last) ||
+		(last < first) ||
+		parseIndex(strtok_r(NULL, " \t\r\n", &save), regionCnt, &datacenter) ||
+		parseIndex(strtok_r(NULL, " \t\r\n", &save), regionCnt, &zone)
+	) {
+		return 1;
+	}
+	for (uint32_t r = first; r <= last; r ++) {
+		topology->datacenter[r] = datacenter;
+		topology->zone[r] = zone;
+	}
+	return 0;
+}
+
+/**
+* Renumber datacenters and zones from 0 in order of first appearance, giving
+* regions without a line a datacenter and zone of their own. Returns 1 if a
+* datacenter spans several zones.
+*/
+static int renumber(Topology* topology) {
+	uint32_t regionCnt = topology->regionCnt;
+	uint32_t* datacenterIds = (uint32_t*)malloc(regionCnt*sizeof(uint32_t));
+	uint32_t* zoneIds = (uint32_t*)malloc(regionCnt*sizeof(uint32_t));
+	uint32_t* datacenterZone = (uint32_t*)malloc(regionCnt*sizeof(uint32_t));
+	for (uint32_t i = 0; i < regionCnt; i ++) {
+		datacenterIds[i] = TOPOLOGY_UNSET;
+		zoneIds[i] = TOPOLOGY_UNSET;
+	}
+	int error = 0;
+	for (uint32_t r = 0; r < regionCnt; r ++) {
+		uint32_t datacenter, zone;
+		if (topology->datacenter[r] == TOPOLOGY_UNSET) {
+			datacenter = topology->datacenterCnt ++;
+			zone = topology->zoneCnt ++;
+			datacenterZone[datacenter] = zone;
+		} else {
+			if (zoneIds[topology->zone[r]] == TOPOLOGY_UNSET) {
+				zoneIds[topology->zone[r]] = topology->zoneCnt ++;
+			}
+			zone = zoneIds[topology->zone[r]];
+			if (datacenterIds[topology->datacenter[r]] == TOPOLOGY_UNSET) {
+				datacenterIds[topology->datacenter[r]] = topology->datacenterCnt ++;
+				datacenterZone[datacenterIds[topology->datacenter[r]]] = zone;
+			}
+			datacenter = datacenterIds[topology->datacenter[r]];
+			error |= (datacenterZone[datacenter] != zone);
+		}
+		topology->datacenter[r] = datacenter;
+		topology->zone[r] = zone;
+	}
+	free(datacenterIds);
+	free(zoneIds);
+	free(datacenterZone);
+	return error;
+}
+
+/**
+* Sort regions by (zone, datacenter) with two counting sorts, and record the
+* range of every datacenter and zone
+*/
+static void buildOrder(Topology* topology) {
+	uint32_t regionCnt = topology->regionCnt;
+	uint32_t* byDatacenter = (uint32_t*)malloc(regionCnt*sizeof(uint32_t));
+	topology->order = (uint32_t*)malloc(regionCnt*sizeof(uint32_t));
+	topology->datacenterStart = (uint32_t*)calloc(topology->datacenterCnt+1, sizeof(uint32_t));
+	topology->datacenterEnd = (uint32_t*)malloc(topology->datacenterCnt*sizeof(uint32_t));
+	topology->zoneStart = (uint32_t*)calloc(topology->zoneCnt+1, sizeof(uint32_t));
+	topology->zoneEnd = (uint32_t*)malloc(topology->zoneCnt*sizeof(uint32_t));
+	uint32_t* count = (uint32_t*)calloc(topology->datacenterCnt+1, sizeof(uint32_t));
+	for (uint32_t r = 0; r < regionCnt; r ++) {
+		count[topology->datacenter[r]+1] ++;
+	}
+	for (uint32_t d = 0; d < topology->datacenterCnt; d ++) {
+		count[d+1] += count[d];
+	}
+	for (uint32_t r = 0; r < regionCnt; r ++) {
+		byDatacenter[count[topology->datacenter[r]] ++] = r;
+	}
+	free(count);
+	count = topology->zoneStart;
+	for (uint32_t r = 0; r < regionCnt; r ++) {
+		count[topology->zone[r]+1] ++;
+	}
+	for (uint32_t z = 0; z < topology->zoneCnt; z ++) {
+		count[z+1] += count[z];
+	}
+	for (uint32_t z = 0; z < topology->zoneCnt; z ++) {
+		topology->zoneEnd[z] = count[z];
+	}
+	// Stable, so datacenters stay contiguous within their zone
+	for (uint32_t i = 0; i < regionCnt; i ++) {
+		uint32_t r = byDatacenter[i];
+		topology->order[topology->zoneEnd[topology->zone[r]] ++] = r;
+	}
+	for (uint32_t d = 0; d < topology->datacenterCnt; d ++) {
+		topology->datacenterStart[d] = TOPOLOGY_UNSET;
+	}
+	for (uint32_t i = 0; i < regionCnt; i ++) {
+		uint32_t d = topology->datacenter[topology->order[i]];
+		if (topology->datacenterStart[d] == TOPOLOGY_UNSET) {
+			topology->datacenterStart[d] = i;
+		}
+		topology->datacenterEnd[d] = i+1;
+	}
+	free(byDatacenter);
+}
+
+Topology* loadTopology(const char* path, uint32_t regionCnt) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open topology %s\n", path);
+		return NULL;
+	}
+	Topology* topology = (Topology*)calloc(1, sizeof(Topology));
+	topology->regionCnt = regionCnt;
+	topology->datacenter = (uint32_t*)malloc(regionCnt*sizeof(uint32_t));
+	topology->zone = (uint32_t*)malloc(regionCnt*sizeof(uint32_t));
+	for (uint32_t r = 0; r < regionCnt; r ++) {
+		topology->datacenter[r] = TOPOLOGY_UNSET;
+		topology->zone[r] = TOPOLOGY_UNSET;
+	}
+	topology->pairMask = 15;
+	topology->pairKeys = (uint64_t*)calloc(topology->pairMask+1, sizeof(uint64_t));
+	topology->pairTimes = (uint32_t*)malloc((topology->pairMask+1)*sizeof(uint32_t));
+	char line[TOPOLOGY_LINE_SIZE];
+	uint32_t lineNumber = 0;
+	int error = 0;
+	while (!error && (fgets(line, sizeof(line), file) != NULL)) {
+		lineNumber ++;
+		char* comment = strchr(line, '#');
+		if (comment != NULL) *comment = '\0';
+		error = parseLine(topology, line);
+	}
+	fclose(file);
+	if (error) {
+		fprintf(stderr, "Malformed topology %s at line %d\n", path, lineNumber);
+		freeTopology(topology);
+		return NULL;
+	}
+	if ((topology->levelTime[TOPOLOGY_LOCAL] == 0) || (topology->levelTime[TOPOLOGY_REMOTE] == 0)) {
+		fprintf(stderr, "Topology %s needs local and remote\n", path);
+		freeTopology(topology);
+		return NULL;
+	}
+	// Unset levels fall back to the next wider one
+	if (topology->levelTime[TOPOLOGY_ZONE] == 0) {
+		topology->levelTime[TOPOLOGY_ZONE] = topology->levelTime[TOPOLOGY_REMOTE];
+	}
+	if (topology->levelTime[TOPOLOGY_DATACENTER] == 0) {
+		topology->levelTime[TOPOLOGY_DATACENTER] = topology->levelTime[TOPOLOGY_ZONE];
+	}
+	if (renumber(topology)) {
+		fprintf(stderr, "Topology %s has a datacenter in several zones\n", path);
+		freeTopology(topology);
+		return NULL;
+	}
+	buildOrder(topology);
+	return topology;
+}
+
+void freeTopology(Topology* topology) {
+	free(topology->datacenter);
+	free(topology->zone);
+	free(topology->pairKeys);
+	free(topology->pairTimes);
+	free(topology->order);
+	free(topology->datacenterStart);
+	free(topology->datacenterEnd);
+	free(topology->zoneStart);
+	free(topology->zoneEnd);
+	free(topology);
+}
+
+uint32_t sampleTopologyRegion(const Topology* topology, const gsl_rng* rng, uint32_t jobRegion) {
+	uint32_t datacenter = topology->datacenter[jobRegion];
+	uint32_t zone = topology->zone[jobRegion];
+	uint32_t datacenterStart = topology->datacenterStart[datacenter];
+	uint32_t datacenterSize = topology->datacenterEnd[datacenter]-datacenterStart;
+	uint32_t zoneStart = topology->zoneStart[zone];
+	uint32_t zoneSize = topology->zoneEnd[zone]-zoneStart;
+	// Regions in each level other than the narrower ones
+	uint32_t sizes[TOPOLOGY_LEVEL_CNT] = {1, datacenterSize-1, zoneSize-datacenterSize, topology->regionCnt-zoneSize};
+	double weights[TOPOLOGY_LEVEL_CNT];
+	double total = 0;
+	for (uint8_t level = 0; level < TOPOLOGY_LEVEL_CNT; level ++) {
+		weights[level] = (double)sizes[level]/topology->levelTime[level];
+		total += weights[level];
+	}
+	double u = gsl_rng_uniform(rng)*total;
+	uint8_t level = 0;
+	while ((level+1 < TOPOLOGY_LEVEL_CNT) && ((u >= weights[level]) || (sizes[level] == 0))) {
+		u -= weights[level];
+		level ++;
+	}
+	if ((level == TOPOLOGY_LOCAL) || (sizes[level] == 0)) return jobRegion;
+	uint32_t i = (uint32_t)gsl_rng_uniform_int(rng, sizes[level]);
+	// Skip the narrower level nested in the range of this one
+	if (level == TOPOLOGY_DATACENTER) {
+		i += datacenterStart;
+		if (topology->order[i] == jobRegion) i = datacenterStart+datacenterSize-1;
+	} else if (level == TOPOLOGY_ZONE) {
+		i += zoneStart;
+		if (i >= datacenterStart) i += datacenterSize;
+	} else {
+		if (i >= zoneStart) i += zoneSize;
+	}
+	return topology->order[i];
+}
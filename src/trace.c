@@ -0,0 +1,100 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+#ifdef MSS_TRACE
+
+#include <sched.h>
+
+// Writer thread sleep when the ring is empty
+#define TRACE_IDLE_NS 200000
+
+/**
+* Flush events until closeTrace() sets done and the ring is empty
+*/
+static void* writeTrace(void* arg) {
+	Trace* trace = (Trace*)arg;
+	struct timespec idle = {0, TRACE_IDLE_NS};
+	while (1) {
+		uint8_t done = (uint8_t)atomic_load_explicit(&trace->done, memory_order_acquire);
+		uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+		uint64_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+		if (head == tail) {
+			if (done) break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+		// Up to the end of the ring, the rest is written on the next pass
+		uint64_t start = tail & (TRACE_RING_SIZE-1);
+		uint64_t cnt = head-tail;
+		if (start+cnt > TRACE_RING_SIZE) cnt = TRACE_RING_SIZE-start;
+		fwrite(&trace->ring[start], sizeof(TraceEvent), cnt, trace->file);
+		atomic_store_explicit(&trace->tail, tail+cnt, memory_order_release);
+	}
+	return NULL;
+}
+
+void traceWait(Trace* trace) {
+	(void)trace;
+	sched_yield();
+}
+
+Trace* openTrace(SimContext* ctx) {
+	FILE* file = fopen(ctx->tracePath, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot write trace %s\n", ctx->tracePath);
+		return NULL;
+	}
+	TraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "MSSTRACE", sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.sample = ctx->traceSample;
+	header.regionCnt = ctx->regionCnt;
+	header.jobTypeCnt = ctx->jobTypeCnt;
+	header.seed = ctx->seed;
+	fwrite(&header, sizeof(header), 1, file);
+	Trace* trace = (Trace*)malloc(sizeof(Trace));
+	trace->file = file;
+	trace->sample = (ctx->traceSample > 0) ? ctx->traceSample : 1;
+	trace->arrivalCnt = 0;
+	trace->jobCnt = 0;
+	trace->timestamp = 0;
+	trace->ring = (TraceEvent*)malloc(TRACE_RING_SIZE*sizeof(TraceEvent));
+	atomic_init(&trace->head, 0);
+	atomic_init(&trace->tail, 0);
+	atomic_init(&trace->done, 0);
+	if (pthread_create(&trace->writer, NULL, writeTrace, trace) != 0) {
+		fprintf(stderr, "Cannot start trace writer\n");
+		fclose(file);
+		free(trace->ring);
+		free(trace);
+		return NULL;
+	}
+	return trace;
+}
+
+void closeTrace(Trace* trace) {
+	atomic_store_explicit(&trace->done, 1, memory_order_release);
+	pthread_join(trace->writer, NULL);
+	fclose(trace->file);
+	free(trace->ring);
+	free(trace);
+}
+
+#else
+
+struct Trace* openTrace(SimContext* ctx) {
+	(void)ctx;
+	fprintf(stderr, "Tracing is not compiled in, rebuild with make TRACE=1\n");
+	return NULL;
+}
+
+void closeTrace(struct Trace* trace) {
+	(void)trace;
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include <immintrin.h>
+#include "variance.h"
+#include "simulation.h"
+
+static const char* varianceModeNames[] = {"none", "antithetic", "control", "both"};
+
+const char* varianceModeName(uint8_t mode) {
+	return varianceModeNames[mode];
+}
+
+/**
+* Sample variance of n values
+*/
+static double sampleVariance(const double* x, uint32_t n) {
+	double mean = 0;
+	for (uint32_t i = 0; i < n; i ++) {
+		mean += x[i];
+	}
+	mean /= n;
+	double sum = 0;
+	for (uint32_t i = 0; i < n; i ++) {
+		sum += (x[i]-mean)*(x[i]-mean);
+	}
+	return sum/(n-1);
+}
+
+/**
+* Control variate estimate of the mean of y given controls d of known mean 0
+* Writes the variance of the estimate to estimateVariance.
+*/
+static double controlEstimate(const double* y, const double* d, uint32_t n, double* estimateVariance) {
+	double meanY = 0;
+	double meanD = 0;
+	for (uint32_t i = 0; i < n; i ++) {
+		meanY += y[i];
+		meanD += d[i];
+	}
+	meanY /= n;
+	meanD /= n;
+	double covariance = 0;
+	double varianceD = 0;
+	for (uint32_t i = 0; i < n; i ++) {
+		covariance += (y[i]-meanY)*(d[i]-meanD);
+		varianceD += (d[i]-meanD)*(d[i]-meanD);
+	}
+	// Deterministic offered work (e.g. all service times deterministic and no
+	// arrivals varying) leaves nothing to correct by
+	double beta = (varianceD > 0) ? covariance/varianceD : 0;
+	double residual = 0;
+	for (uint32_t i = 0; i < n; i ++) {
+		double r = (y[i]-meanY)-beta*(d[i]-meanD);
+		residual += r*r;
+	}
+	// One more degree of freedom is spent on beta
+	*estimateVariance = residual/(n-2)/n;
+	return meanY-beta*meanD;
+}
+
+void initWorkRate(SimContext* ctx) {
+	uint32_t J = ctx->jobTypeCnt;
+	ctx->workRate = (double*)malloc(ctx->regionCnt*J*sizeof(double));
+	for (uint32_t r = 0; r < ctx->regionCnt; r ++) {
+		for (uint8_t j = 0; j < J; j ++) {
+			double p0, meanFloor;
+			serviceFloorMoments(ctx, r, j, &p0, &meanFloor);
+			ctx->workRate[r*J+j] = ctx->serverNeeds[j]*meanFloor;
+		}
+	}
+}
+
+void freeWorkRate(SimContext* ctx) {
+	free(ctx->workRate);
+	ctx->workRate = NULL;
+}
+
+int runReplications(SimContext* ctx, double* result, double* factor) {
+	uint8_t antithetic = ((ctx->varianceMode & VR_ANTITHETIC) != 0);
+	uint8_t control = ((ctx->varianceMode & VR_CONTROL) != 0);
+	uint32_t n = ctx->replicationCnt;
+	// Variances need 2 units, the control variate enough residual degrees of
+	// freedom once beta is fitted
+	uint32_t minCnt = control ? VR_CONTROL_MIN_REPS : ((ctx->varianceMode != VR_NONE) ? 2 : 1);
+	if (n < minCnt) {
+		fprintf(stderr, "--vr %s needs --reps of at least %d\n", varianceModeName(ctx->varianceMode), minCnt);
+		return 1;
+	}
+	uint8_t seeded = ctx->seeded;
+	uint64_t seed = ctx->seed;
+	if (!seeded) {
+		uint32_t randomSeed;
+		_rdrand32_step(&randomSeed);
+		seed = randomSeed;
+	}
+	uint8_t verbose = ctx->verbose;
+	uint32_t pairSize = antithetic ? 2 : 1;
+	uint32_t runCnt = n*pairSize;
+	// Results of all runs by metric, then the units estimators are built from
+	// (pair means for antithetic, runs otherwise)
+	double* runs = (double*)malloc(SIM_RESULT_CNT*runCnt*sizeof(double));
+	double* units = (double*)calloc(SIM_RESULT_CNT*n, sizeof(double));
+	double* work = (double*)calloc(n, sizeof(double));
+	double run[SIM_RESULT_CNT];
+	ctx->verbose = 0;
+	ctx->seeded = 1;
+	int error = 0;
+	for (uint32_t k = 0; (k < n) && !error; k ++) {
+		for (uint32_t a = 0; a < pairSize; a ++) {
+			ctx->seed = seed+k;
+			if (antithetic) {
+				ctx->antithetic = (a == 0) ? ANTITHETIC_FIRST : ANTITHETIC_MIRROR;
+			}
+			error = runSimulation(ctx, run);
+			if (error) break;
+			for (uint32_t m = 0; m < SIM_RESULT_CNT; m ++) {
+				runs[m*runCnt+k*pairSize+a] = run[m];
+				units[m*n+k] += run[m]/pairSize;
+			}
+			// Offered work per time unit above its mean
+			work[k] += ((double)ctx->offeredWork-ctx->meanOfferedWork)/ctx->simulationTime/pairSize;
+			if (verbose) {
+				printf("Replication %d%s: %lf %lf %lf\n", k+1, antithetic ? ((a == 0) ? "a" : "b") : "", run[0], run[1], run[2]);
+			}
+		}
+	}
+	ctx->antithetic = ANTITHETIC_OFF;
+	ctx->verbose = verbose;
+	ctx->seeded = seeded;
+	ctx->seed = seed;
+	if (error) {
+		free(runs);
+		free(units);
+		free(work);
+		return 1;
+	}
+	for (uint32_t m = 0; m < SIM_RESULT_CNT; m ++) {
+		double* y = units+m*n;
+		result[m] = 0;
+		for (uint32_t k = 0; k < n; k ++) {
+			result[m] += y[k]/n;
+		}
+		// Quantiles are not means of runs, the 99th percentile stays plain
+		if (m >= VR_FACTOR_CNT) continue;
+		double estimateVariance = (n > 1) ? sampleVariance(y, n)/n : 0;
+		if (control) {
+			result[m] = controlEstimate(y, work, n, &estimateVariance);
+		}
+		// Plain mean of as many independent runs
+		double plainVariance = (runCnt > 1) ? sampleVariance(runs+m*runCnt, runCnt)/runCnt : 0;
+		if (estimateVariance > 0) {
+			factor[m] = plainVariance/estimateVariance;
+		} else {
+			factor[m] = (plainVariance > 0) ? INFINITY : 1;
+		}
+		if (verbose) {
+			printf("Standard error of %s: %lf (plain mean of %d runs %lf)\n", (m == 0) ? "queue length" : "queueing delay", sqrt(estimateVariance), runCnt, sqrt(plainVariance));
+		}
+	}
+	free(runs);
+	free(units);
+	free(work);
+	return 0;
+}